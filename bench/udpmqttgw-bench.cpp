@@ -0,0 +1,366 @@
+/**
+ * @file      udpmqttgw-bench.cpp
+ * @brief     Load generator and end-to-end benchmark of the UDP MQTT Gateway
+ *
+ * Sends numbered UDP datagrams at a configurable rate and size to the gateway, subscribes to
+ * the output topic on the broker and reports the sustained throughput, the latency quantiles
+ * and the loss. Sender and subscriber run in this process, so their clocks match.
+ *
+ * @copyright (c) consider it GmbH, 2020
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <MQTTClient.h>
+
+#include "../src/Stats.h"
+
+// static configuration values
+#define HEADER_SIZE 16      // sequence number and send time in front of every payload
+#define SEND_BATCH_SIZE 64  // datagrams per sendmmsg call
+#define SEND_IDLE std::chrono::microseconds(50)
+#define FRAME_HEADER_SIZE 2  // length prefix of coalesced datagrams
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+struct BenchOptions {
+  std::string address{"127.0.0.1"};
+  int         port{59551};
+  int         rate{10000};   // datagrams per second, 0: as fast as possible
+  int         size{64};      // bytes per datagram
+  int         duration{10};  // seconds
+  int         drain{2};      // seconds to wait for late messages after sending
+  std::string broker{"tcp://localhost:1883"};
+  std::string topic{"#"};
+  int         qos{0};
+  bool        coalesced{false};  // gateway packs datagrams into one message (CoalesceMaxMessages)
+};
+
+void printUsage(const char* name) {
+  std::cout << "usage: " << name << " [-h] [-a=ADDRESS] [-p=PORT] [-r=RATE] [-s=SIZE] [-d=SECONDS] [-w=SECONDS] "
+            << "[-b=BROKER] [-t=TOPIC] [-q=QOS] [-f]\n\n"
+            << "optional arguments:\n"
+            << "  -h          show this help message and exit\n"
+            << "  -a=ADDRESS  UDP address of the gateway (default: 127.0.0.1)\n"
+            << "  -p=PORT     UDP port of the gateway (default: 59551)\n"
+            << "  -r=RATE     datagrams per second, 0 sends as fast as possible (default: 10000)\n"
+            << "  -s=SIZE     bytes per datagram, at least " << HEADER_SIZE << " (default: 64)\n"
+            << "  -d=SECONDS  duration of the load (default: 10)\n"
+            << "  -w=SECONDS  time to wait for late messages (default: 2)\n"
+            << "  -b=BROKER   URL of the MQTT broker (default: tcp://localhost:1883)\n"
+            << "  -t=TOPIC    topic filter to subscribe to (default: #)\n"
+            << "  -q=QOS      QoS level of the subscription (default: 0)\n"
+            << "  -f          the gateway coalesces datagrams (CoalesceMaxMessages > 1)\n";
+}
+
+bool parseArgs(int argc, char* argv[], BenchOptions& options) {  // NOLINT(modernize-avoid-c-arrays)
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    std::string val = arg.substr(arg.find('=') + 1);
+
+    if (0 == arg.find("-h")) {
+      printUsage(argv[0]);
+      exit(EXIT_SUCCESS);
+    } else if (0 == arg.find("-a=")) {
+      options.address = val;
+    } else if (0 == arg.find("-p=")) {
+      options.port = std::stoi(val);
+    } else if (0 == arg.find("-r=")) {
+      options.rate = std::stoi(val);
+    } else if (0 == arg.find("-s=")) {
+      options.size = std::stoi(val);
+    } else if (0 == arg.find("-d=")) {
+      options.duration = std::stoi(val);
+    } else if (0 == arg.find("-w=")) {
+      options.drain = std::stoi(val);
+    } else if (0 == arg.find("-b=")) {
+      options.broker = val;
+    } else if (0 == arg.find("-t=")) {
+      options.topic = val;
+    } else if (0 == arg.find("-q=")) {
+      options.qos = std::stoi(val);
+    } else if (0 == arg.find("-f")) {
+      options.coalesced = true;
+    } else {
+      std::cerr << "error: unrecognized arguments: " << arg << "\n";
+      return false;
+    }
+  }
+
+  if (options.size < HEADER_SIZE || options.size > UINT16_MAX || options.rate < 0 || options.duration < 1 ||
+      options.qos < 0 || options.qos > 2) {
+    std::cerr << "error: invalid arguments, see -h\n";
+    return false;
+  }
+  return true;
+}
+
+void writeU64(char* buffer, std::uint64_t value) {
+  for (int i = 7; i >= 0; i--) {
+    buffer[i] = static_cast<char>(value & 0xFFU);
+    value >>= 8U;
+  }
+}
+
+std::uint64_t readU64(const char* buffer) {
+  std::uint64_t value{0};
+  for (int i = 0; i < 8; i++) {
+    value = (value << 8U) | static_cast<unsigned char>(buffer[i]);
+  }
+  return value;
+}
+
+std::uint64_t nowNs() {
+  return static_cast<std::uint64_t>(
+      std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now().time_since_epoch()).count());
+}
+
+/**
+ * @brief Subscriber side: counts the received datagrams and records their latencies
+ *
+ * The MQTT library calls the message callback from one thread only.
+ */
+class Receiver {
+public:
+  explicit Receiver(bool coalesced) : coalesced{coalesced} {}
+
+  LatencyHistogram latency;
+
+  /**
+   * @brief Sequence numbers up to this one are being sent, higher ones are not from this benchmark
+   */
+  void expect(std::uint64_t count) { this->expected.store(count); }
+
+  std::uint64_t unique() const { return this->uniqueCount.load(); }
+  std::uint64_t duplicates() const { return this->duplicateCount.load(); }
+  std::uint64_t malformed() const { return this->malformedCount.load(); }
+
+  Clock::time_point first() {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    return this->firstReceived;
+  }
+  Clock::time_point last() {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    return this->lastReceived;
+  }
+
+  static int onMessageArrived(void* context, char* topicName, int /*topicLen*/, MQTTClient_message* message) {
+    auto* self = static_cast<Receiver*>(context);
+    self->handle(static_cast<const char*>(message->payload), message->payloadlen);
+    MQTTClient_freeMessage(&message);
+    MQTTClient_free(topicName);
+    return 1;
+  }
+
+  static void onConnectionLost(void* /*context*/, char* cause) {
+    std::cerr << "[ERROR] Connection to MQTT broker lost (" << (cause != nullptr ? cause : "unknown cause") << ")\n";
+  }
+
+private:
+  const bool                 coalesced;
+  std::atomic<std::uint64_t> expected{0};
+  std::vector<std::uint8_t>  seen;
+  std::atomic<std::uint64_t> uniqueCount{0};
+  std::atomic<std::uint64_t> duplicateCount{0};
+  std::atomic<std::uint64_t> malformedCount{0};
+  std::mutex                 mutex;
+  Clock::time_point          firstReceived{};
+  Clock::time_point          lastReceived{};
+
+  void handle(const char* payload, int payloadLen) {
+    auto now = Clock::now();
+    {
+      std::lock_guard<std::mutex> lock(this->mutex);
+      if (Clock::time_point{} == this->firstReceived) {
+        this->firstReceived = now;
+      }
+      this->lastReceived = now;
+    }
+
+    if (!this->coalesced) {
+      this->datagram(payload, payloadLen, now);
+      return;
+    }
+
+    int offset{0};
+    while (offset + FRAME_HEADER_SIZE <= payloadLen) {
+      int length =
+          (static_cast<unsigned char>(payload[offset]) << 8U) | static_cast<unsigned char>(payload[offset + 1]);
+      offset += FRAME_HEADER_SIZE;
+      if (offset + length > payloadLen) {
+        break;
+      }
+      this->datagram(payload + offset, length, now);
+      offset += length;
+    }
+    if (offset != payloadLen) {
+      this->malformedCount++;
+    }
+  }
+
+  void datagram(const char* payload, int payloadLen, Clock::time_point now) {
+    if (payloadLen < HEADER_SIZE) {
+      this->malformedCount++;
+      return;
+    }
+
+    std::uint64_t seq  = readU64(payload);
+    std::uint64_t sent = readU64(payload + 8);
+    if (seq >= this->expected.load()) {
+      this->malformedCount++;
+      return;
+    }
+    if (seq >= this->seen.size()) {
+      this->seen.resize(std::max<std::size_t>(seq + 1, 2 * this->seen.size()), 0);
+    }
+    if (0 != this->seen[seq]) {
+      this->duplicateCount++;
+      return;
+    }
+    this->seen[seq] = 1;
+    this->uniqueCount++;
+
+    auto received = static_cast<std::uint64_t>(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(now.time_since_epoch()).count());
+    this->latency.record(std::chrono::nanoseconds(received - sent));
+  }
+};
+
+/**
+ * @brief Sender side: sends numbered datagrams with the configured rate for the configured time
+ *
+ * @return    Number of datagrams sent
+ */
+std::uint64_t sendLoad(const BenchOptions& options, int sockfd, Receiver& receiver) {
+  std::vector<char>           buffers(SEND_BATCH_SIZE * static_cast<std::size_t>(options.size), 'x');
+  std::vector<struct iovec>   iovecs(SEND_BATCH_SIZE);
+  std::vector<struct mmsghdr> msgs(SEND_BATCH_SIZE);
+  for (int i = 0; i < SEND_BATCH_SIZE; i++) {
+    iovecs[i].iov_base         = &buffers[i * static_cast<std::size_t>(options.size)];
+    iovecs[i].iov_len          = static_cast<std::size_t>(options.size);
+    msgs[i].msg_hdr.msg_iov    = &iovecs[i];
+    msgs[i].msg_hdr.msg_iovlen = 1;
+  }
+
+  const auto    start = Clock::now();
+  const auto    end   = start + std::chrono::seconds(options.duration);
+  std::uint64_t seq{0};
+
+  for (auto now = start; now < end; now = Clock::now()) {
+    // number of datagrams, which should have been sent by now
+    std::uint64_t due = SEND_BATCH_SIZE;
+    if (0 != options.rate) {
+      std::chrono::duration<double> elapsed = now - start;
+      auto target = static_cast<std::uint64_t>(elapsed.count() * options.rate);
+      due         = std::min<std::uint64_t>(target > seq ? target - seq : 0, SEND_BATCH_SIZE);
+    }
+    if (0 == due) {
+      std::this_thread::sleep_for(SEND_IDLE);
+      continue;
+    }
+
+    std::uint64_t sentAt = nowNs();
+    for (std::uint64_t i = 0; i < due; i++) {
+      writeU64(static_cast<char*>(iovecs[i].iov_base), seq + i);
+      writeU64(static_cast<char*>(iovecs[i].iov_base) + 8, sentAt);
+    }
+    receiver.expect(seq + due);
+    int sent = sendmmsg(sockfd, msgs.data(), static_cast<unsigned int>(due), 0);
+    if (0 > sent) {
+      std::cerr << "[ERROR] Failed to send UDP datagrams: " << std::strerror(errno) << "\n";
+      break;
+    }
+    seq += static_cast<std::uint64_t>(sent);
+  }
+
+  return seq;
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  BenchOptions options{};
+  if (!parseArgs(argc, argv, options)) {
+    exit(EXIT_FAILURE);
+  }
+
+  // subscribe first, so no message is missed
+  Receiver    receiver(options.coalesced);
+  MQTTClient  client{};
+  std::string clientID = "udpmqttgw-bench-" + std::to_string(getpid());
+  MQTTClient_create(&client, options.broker.c_str(), clientID.c_str(), MQTTCLIENT_PERSISTENCE_NONE, nullptr);
+  MQTTClient_setCallbacks(client, &receiver, Receiver::onConnectionLost, Receiver::onMessageArrived, nullptr);
+
+  MQTTClient_connectOptions connOpts = MQTTClient_connectOptions_initializer;
+  connOpts.cleansession              = 1;
+  int mqttRC                         = MQTTClient_connect(client, &connOpts);
+  if (MQTTCLIENT_SUCCESS != mqttRC) {
+    std::cerr << "[ERROR] Failed to connect to MQTT broker " << options.broker << ", error " << mqttRC << "\n";
+    exit(EXIT_FAILURE);
+  }
+  mqttRC = MQTTClient_subscribe(client, options.topic.c_str(), options.qos);
+  if (MQTTCLIENT_SUCCESS != mqttRC) {
+    std::cerr << "[ERROR] Failed to subscribe to " << options.topic << ", error " << mqttRC << "\n";
+    exit(EXIT_FAILURE);
+  }
+
+  int                sockfd = socket(AF_INET, SOCK_DGRAM, 0);
+  struct sockaddr_in target {};
+  target.sin_family = AF_INET;
+  target.sin_port   = htons(options.port);
+  if (0 > sockfd || 1 != inet_pton(AF_INET, options.address.c_str(), &target.sin_addr) ||
+      0 > connect(sockfd,
+                  reinterpret_cast<struct sockaddr*>(&target),  // NOLINT(cppcoreguidelines-pro-type-reinterpret-cast)
+                  sizeof(target))) {
+    std::cerr << "[ERROR] Could not open UDP socket to " << options.address << ":" << options.port << "\n";
+    exit(EXIT_FAILURE);
+  }
+
+  std::cout << "Sending " << options.size << " byte datagrams to " << options.address << ":" << options.port
+            << " at " << (0 != options.rate ? std::to_string(options.rate) + "/s" : "maximum rate") << " for "
+            << options.duration << " s\n";
+  auto          start = Clock::now();
+  std::uint64_t sent  = sendLoad(options, sockfd, receiver);
+  auto          stop  = Clock::now();
+  close(sockfd);
+
+  std::this_thread::sleep_for(std::chrono::seconds(options.drain));
+  MQTTClient_disconnect(client, 0);
+  MQTTClient_destroy(&client);
+
+  // the receive rate is measured from the first to the last message, so the startup is not included
+  std::chrono::duration<double> sendTime    = stop - start;
+  std::chrono::duration<double> receiveTime = receiver.last() - receiver.first();
+  std::uint64_t                 received    = receiver.unique();
+  double                        sendRate    = static_cast<double>(sent) / sendTime.count();
+  double receiveRate = receiveTime.count() > 0 ? static_cast<double>(received) / receiveTime.count() : 0.0;
+  double loss = sent > 0 ? 100.0 * static_cast<double>(sent - std::min(sent, received)) / static_cast<double>(sent)
+                         : 0.0;
+
+  std::cout << "sent:       " << sent << " (" << static_cast<std::uint64_t>(sendRate) << "/s)\n";
+  std::cout << "received:   " << received << " (" << static_cast<std::uint64_t>(receiveRate)
+            << "/s), duplicates: " << receiver.duplicates() << ", malformed: " << receiver.malformed() << "\n";
+  std::cout << "loss:       " << loss << " %\n";
+  std::cout << "latency:    p50 " << receiver.latency.quantile(0.5) / 1000 << " us, p99 "
+            << receiver.latency.quantile(0.99) / 1000 << " us, p99.9 " << receiver.latency.quantile(0.999) / 1000
+            << " us\n";
+
+  return EXIT_SUCCESS;
+}
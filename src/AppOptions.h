@@ -0,0 +1,1509 @@
+/**
+ * @file      AppOptions.h
+ * @brief     CLI argument and configuration file parser
+ *
+ * @copyright (c) consider it GmbH, 2020
+ */
+
+#ifndef _APPOPTIONS_H
+#define _APPOPTIONS_H
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <sched.h>
+
+#ifdef UDPMQTTGW_MQTT_ASYNC
+#include <MQTTAsync.h>
+#else
+#include <MQTTClient.h>
+#endif
+
+#include "IpAddress.h"
+
+// default values
+#define CONF_FILE "/etc/udpmqttgw.conf"
+#define WORKERS 1
+#define UDP_BATCH_SIZE 16
+#define UDP_MAX_DATAGRAM 2048
+#define UDP_MAX_DATAGRAM_LIMIT 65536
+#define UDP_IO_URING_BUFFERS 256
+#define UDP_IO_URING_BUFFERS_LIMIT 32768
+#define UDP_BIND_ADDRESS "::"  // dual-stack, IPv4 and IPv6
+#define QUEUE_CAPACITY 1024
+#define QUEUE_OVERFLOW OverflowPolicy::DropNewest
+#define QUEUE_OVERFLOW_STR "drop-newest"
+#define SHED_QUEUE_DEPTH 75      // percent of QueueCapacity
+#define SHED_LATENCY 0           // milliseconds, disabled
+#define COALESCE_MAX_MESSAGES 0  // disabled
+#define COALESCE_MAX_BYTES 16384
+#define COALESCE_LINGER 5      // milliseconds
+#define STATS_INTERVAL 0       // seconds, disabled
+#define SHUTDOWN_TIMEOUT 5000  // milliseconds
+#define STATS_HTTP_ADDRESS "127.0.0.1"
+#define STATS_HTTP_PORT 0            // disabled
+#define SPILL_MEMORY 1048576         // bytes
+#define SPILL_SEGMENT_SIZE 16777216  // bytes
+#define SPILL_MAX_SEGMENTS 16
+#define SPILL_REPLAY_RATE 1000  // messages per second
+#define DEDUP_WINDOW 0          // milliseconds, disabled
+#define DEDUP_WINDOW_LIMIT 3600000
+#define DEDUP_CAPACITY 65536
+#define SOURCE_RATE_LIMIT 0  // messages per second, disabled
+#define SOURCE_RATE_BURST 100
+#define SOURCE_PREFIX_LENGTH 32
+#define SOURCE_PREFIX_LENGTH6 128
+#define SOURCE_TABLE_SIZE 4096
+#define COMPRESSION Compression::None
+#define COMPRESSION_STR "none"
+#define COMPRESSION_LEVEL 0  // library default
+#define LATENCY_PROBE LatencyProbe::Off
+#define LATENCY_PROBE_STR "off"
+#define CAPTURE_MAX_SIZE 1073741824  // bytes
+#define LOG_FORMAT LogFormat::Text
+#define LOG_FORMAT_STR "text"
+#define LOG_RATE_LIMIT 10  // messages per second and log statement
+#define REPLAY_SPEED 1.0   // 0: as fast as possible
+#define MQTT_QOS 0
+#define MQTT_KEEP_ALIVE 20      // seconds
+#define MQTT_RETRY 1000         // milliseconds
+#define MQTT_CONN_TIMEOUT 1000  // milliseconds
+#define MQTT_MAX_INFLIGHT 10
+#define MQTT_SEND_QUEUE 1000
+#define MQTT_RECONNECT_MIN 100    // milliseconds
+#define MQTT_RECONNECT_MAX 30000  // milliseconds
+#define MQTT_TOPIC_ALIASES 16     // per connection, if the broker allows that many
+#define MQTT_CONNECTIONS 1        // per worker
+#define MQTT_SHARD_KEY ShardKey::Topic
+#define MQTT_SHARD_KEY_STR "topic"
+#define MQTT_TARGETS_LIMIT 4  // brokers, including MqttUrl
+#define MQTT_TARGET_MODE TargetMode::FanOut
+#define MQTT_TARGET_MODE_STR "fanout"
+#define MQTT_VERSION MQTTVERSION_DEFAULT
+#define MQTT_VERSION_STR "Default"
+#define MQTT_SSL MQTT_SSL_VERSION_TLS_1_2
+#define MQTT_SSL_STR "1.2"
+
+/**
+ * @brief What to do with a received datagram, when the publish queue is full
+ */
+enum class OverflowPolicy {
+  DropOldest,  // discard the oldest queued datagram to make room
+  DropNewest,  // discard the received datagram
+  Block,       // stop receiving until there is room (the kernel drops datagrams then)
+};
+
+/**
+ * @brief Priority class of a route, when a lane is overloaded (ShedQueueDepth, ShedLatency)
+ */
+enum class RoutePriority {
+  Critical,  // queued ahead of the other routes, not coalesced
+  Normal,
+  Bulk,  // published with QoS 0 and dropped first, while the lane is overloaded
+};
+
+/**
+ * @brief Source of the kernel arrival timestamps of the datagrams
+ */
+enum class LatencyProbe {
+  Off,       // no timestamps
+  Software,  // stamped by the kernel when the datagram arrives (SO_TIMESTAMPNS)
+  Hardware,  // stamped by the network card (SO_TIMESTAMPING), falls back to software timestamps
+};
+
+/**
+ * @brief Format of the log lines
+ */
+enum class LogFormat {
+  Text,  // "[LEVEL] message", the timestamps are added by journald
+  Json,  // one JSON object per line with time, level and message
+};
+
+/**
+ * @brief What decides, which MQTT connection of a worker publishes a datagram
+ */
+enum class ShardKey {
+  Topic,   // MQTT topic, keeps the order per topic
+  Source,  // source address (SourcePrefixLength), keeps the order per source
+};
+
+/**
+ * @brief How the datagrams are distributed, if several brokers are configured (MqttTarget)
+ */
+enum class TargetMode {
+  FanOut,    // every broker gets every message
+  Failover,  // the first connected broker gets the message (MqttUrl is the active one)
+};
+
+/**
+ * @brief Compression of the MQTT payloads of a route
+ */
+enum class Compression {
+  None,
+  Lz4,   // LZ4 frame format, fast
+  Zstd,  // Zstandard frame format, optionally with a trained dictionary
+};
+
+/**
+ * @brief Checksum in the trailer of the datagrams, which is verified by a PayloadFilter
+ */
+enum class ChecksumType {
+  None,
+  Crc32,   // CRC-32 (IEEE 802.3, zlib)
+  Crc32c,  // CRC-32C (Castagnoli)
+};
+
+/**
+ * @brief Forwarding of one UDP port to one MQTT topic
+ */
+struct RouteOptions {
+  int         port;
+  std::string topic;
+  Compression compression{Compression::None};  // resolved from Compression and RouteCompression
+
+  int           qos{-1};                          // RouteQos, -1: MqttQosLevel of the broker
+  RoutePriority priority{RoutePriority::Normal};  // RoutePriority
+};
+
+/**
+ * @brief Rule to publish matching datagrams to another topic than the one of their route
+ *
+ * All given conditions have to match. The topic may contain the placeholders {src_ip},
+ * {src_port} and {port} (UDP port of the route).
+ */
+struct TopicRuleOptions {
+  int         port{0};     // UDP port of the route, 0: any
+  IpAddress   srcAddr{};   // IPv4 addresses are mapped
+  IpAddress   srcMask{};   // all zero: any source address
+  int         srcPort{0};  // 0: any
+  std::string prefix{};    // leading payload bytes, empty: any
+  std::string topic{};
+  std::string match{};  // just for debug output
+};
+
+/**
+ * @brief Checks, which the datagrams of a route have to pass to be published
+ *
+ * All given checks have to pass. The checksum is expected in the last 4 bytes of a datagram, in
+ * network byte order, and covers the bytes in front of it.
+ */
+struct PayloadFilterOptions {
+  int          port{0};                       // UDP port of the route, 0: all routes
+  int          minLength{0};                  // bytes
+  int          maxLength{0};                  // bytes, 0: no limit
+  std::string  magic{};                       // expected payload bytes at magicOffset, empty: any
+  int          magicOffset{0};                // bytes
+  ChecksumType checksum{ChecksumType::None};  // of the trailer
+  std::string  dropTypes{};                   // message type bytes at typeOffset, which are dropped
+  int          typeOffset{0};                 // bytes
+  std::string  match{};                       // just for debug output
+};
+
+/**
+ * @brief Additional MQTT broker, with the connection parameters, which differ from the global ones
+ */
+struct MqttTargetOptions {
+  std::string                                      url;
+  std::vector<std::pair<std::string, std::string>> parameters{};  // like ("MqttQosLevel", "1")
+
+  bool operator==(const MqttTargetOptions& other) const {
+    return this->url == other.url && this->parameters == other.parameters;
+  }
+};
+
+/**
+ * @brief Helper class to parse CLI arguments
+ * 
+ * CLI arguments can be specified with an equals sign between the parameter name and the
+ * value, so for `-o=foobar.txt` the option would be `-o`.
+ */
+struct AppOptions {
+  int         verbosity;
+  std::string confPath{CONF_FILE};
+  std::string replayFile{};               // publish the datagrams of a capture file instead of receiving
+  double      replaySpeed{REPLAY_SPEED};  // factor of the recorded timing, 0: as fast as possible
+
+  // config file options
+  int         inputUdpPort{};
+  std::string mqttUrl{};
+  std::string mqttTopic{};
+  std::string mqttClientID{};
+  std::string mqttUsername{};                             // optional
+  std::string mqttPassword{};                             // optional, if no username
+  int         mqttVersion{MQTT_VERSION};                  // optional
+  std::string mqttVersion_str{MQTT_VERSION_STR};          // just for debug output
+  int         mqttQosLevel{MQTT_QOS};                     // optional
+  int         mqttKeepAliveInterval{MQTT_KEEP_ALIVE};     // optional
+  int         mqttRetryInterval{MQTT_RETRY};              // optional
+  int         mqttConnectionTimeout{MQTT_CONN_TIMEOUT};   // optional
+  int         mqttMaxInflight{MQTT_MAX_INFLIGHT};         // optional
+  int         mqttSendQueueSize{MQTT_SEND_QUEUE};         // optional, asynchronous client only
+  int         mqttReconnectMinDelay{MQTT_RECONNECT_MIN};  // optional, milliseconds
+  int         mqttReconnectMaxDelay{MQTT_RECONNECT_MAX};  // optional, milliseconds
+  int         mqttTcpNoDelay{0};                          // optional, disable Nagle's algorithm on the connection
+  int         mqttTopicAliases{MQTT_TOPIC_ALIASES};       // optional, MQTT v5 only, 0 disables topic aliases
+  int         mqttConnections{MQTT_CONNECTIONS};          // optional, connections per worker
+  ShardKey    mqttShardKey{MQTT_SHARD_KEY};               // optional
+  std::string mqttShardKey_str{MQTT_SHARD_KEY_STR};       // just for debug output
+
+  std::vector<MqttTargetOptions> mqttTargets{};                             // optional, brokers besides MqttUrl
+  TargetMode                     mqttTargetMode{MQTT_TARGET_MODE};          // optional
+  std::string                    mqttTargetMode_str{MQTT_TARGET_MODE_STR};  // just for debug output
+
+  int         mqttSslEnableServerCertAuth{1};    // optional, library default is 1
+  int         mqttSslVersion{MQTT_SSL};          // optional
+  std::string mqttSslVersion_str{MQTT_SSL_STR};  // just for debug output
+  int         mqttSslVerify{0};                  // optional, library default is 0
+  std::string mqttSslTrustStore{};               // optional
+  std::string mqttSslKeyStore{};                 // optional
+  std::string mqttSslPrivateKey{};               // optional
+  std::string mqttSslPrivateKeyPasswd{};         // optional
+
+  std::vector<RouteOptions>     routes{};      // additional routes, InputUdpPort/ MqttTopic is the first one
+  std::vector<TopicRuleOptions> topicRules{};  // optional, first matching rule wins
+
+  std::vector<PayloadFilterOptions> payloadFilters{};  // optional, a datagram has to pass all filters of its route
+
+  int              workers{WORKERS};       // optional
+  std::vector<int> workerCpuAffinity{};    // optional, empty: no pinning
+  std::vector<int> receiverCpuAffinity{};  // optional, empty: receiver threads are pinned like their worker
+  int              receiverPriority{0};    // optional, SCHED_FIFO priority of the receiver threads, 0: normal
+
+  IpAddress              udpBindAddress{};      // optional, :: (UDP_BIND_ADDRESS) receives IPv4 and IPv6
+  std::string            udpInterface{};        // optional, network interface to bind to
+  std::vector<IpAddress> udpMulticastGroups{};  // optional, joined by every socket
+
+  int            udpBatchSize{UDP_BATCH_SIZE};                 // optional
+  int            udpMaxDatagramSize{UDP_MAX_DATAGRAM};         // optional
+  int            udpReceiveBufferSize{0};                      // optional, 0 is the system default
+  int            udpReceiveBufferForce{0};                     // optional, needs CAP_NET_ADMIN
+  int            udpBusyPoll{0};                               // optional, microseconds (SO_BUSY_POLL)
+  int            udpSpinTime{0};                               // optional, microseconds polling after a datagram
+#ifdef UDPMQTTGW_IO_URING
+  int            udpIoUring{1};                                // optional, falls back to recvmmsg
+#else
+  int            udpIoUring{0};                                // not built in (UDPMQTTGW_IO_URING)
+#endif
+  int            udpIoUringBuffers{UDP_IO_URING_BUFFERS};      // optional, provided buffers per worker
+  int            queueCapacity{QUEUE_CAPACITY};                // optional
+  OverflowPolicy queueOverflowPolicy{QUEUE_OVERFLOW};          // optional
+  std::string    queueOverflowPolicy_str{QUEUE_OVERFLOW_STR};  // just for debug output
+  int            shedQueueDepth{SHED_QUEUE_DEPTH};             // optional, percent, a lane is overloaded above
+  int            shedLatency{SHED_LATENCY};                    // optional, milliseconds queue latency, 0: disabled
+
+  std::vector<std::pair<int, int>>           routeQos{};         // optional, by UDP port
+  std::vector<std::pair<int, RoutePriority>> routePriorities{};  // optional, by UDP port
+
+  int coalesceMaxMessages{COALESCE_MAX_MESSAGES};  // optional, 0 or 1: one MQTT message per datagram
+  int coalesceMaxBytes{COALESCE_MAX_BYTES};        // optional
+  int coalesceLinger{COALESCE_LINGER};             // optional, milliseconds
+
+  int shutdownTimeout{SHUTDOWN_TIMEOUT};  // optional, milliseconds to deliver the queued messages on SIGTERM
+
+  LogFormat   logFormat{LOG_FORMAT};          // optional
+  std::string logFormat_str{LOG_FORMAT_STR};  // just for debug output
+  int         logRateLimit{LOG_RATE_LIMIT};   // optional, messages per second and log statement, 0: unlimited
+
+  int         statsInterval{STATS_INTERVAL};         // optional, seconds between statistics log lines
+  std::string statsHttpAddress{STATS_HTTP_ADDRESS};  // optional
+  int         statsHttpPort{STATS_HTTP_PORT};        // optional, Prometheus endpoint
+
+  int         spillMemorySize{SPILL_MEMORY};         // optional, bytes buffered per connection during broker outages
+  std::string spillDirectory{};                      // optional, empty: no disk buffer
+  int         spillSegmentSize{SPILL_SEGMENT_SIZE};  // optional, bytes per segment file
+  int         spillMaxSegments{SPILL_MAX_SEGMENTS};  // optional, segment files per worker
+  int         spillReplayRate{SPILL_REPLAY_RATE};    // optional, messages per second after reconnecting
+
+  int dedupWindow{DEDUP_WINDOW};      // optional, milliseconds to drop identical payloads on the same route
+  int dedupCapacity{DEDUP_CAPACITY};  // optional, payloads remembered within the window (all workers)
+
+  int sourceRateLimit{SOURCE_RATE_LIMIT};  // optional, messages per second and source (worker)
+  int sourceRateBurst{SOURCE_RATE_BURST};  // optional, messages
+  int sourceTableSize{SOURCE_TABLE_SIZE};  // optional, tracked sources per worker
+  int fairQueuing{0};                      // optional, publish the sources' datagrams round robin
+
+  int       sourcePrefixLength{SOURCE_PREFIX_LENGTH};                          // optional, groups IPv4 sources
+  int       sourcePrefixLength6{SOURCE_PREFIX_LENGTH6};                        // optional, groups IPv6 sources
+  IpAddress sourceMask{IpAddress::prefixMask(SOURCE_PREFIX_LENGTH, true)};     // derived from sourcePrefixLength
+  IpAddress sourceMask6{IpAddress::prefixMask(SOURCE_PREFIX_LENGTH6, false)};  // derived from sourcePrefixLength6
+
+  Compression                              compression{COMPRESSION};             // optional, of all routes
+  std::string                              compression_str{COMPRESSION_STR};     // just for debug output
+  std::vector<std::pair<int, Compression>> routeCompressions{};                  // optional, by UDP port
+  int                                      compressionLevel{COMPRESSION_LEVEL};  // optional, 0: library default
+  std::string                              compressionDictionary{};              // optional, file of a zstd dictionary
+  std::string                              compressionDictionaryData{};          // content of the dictionary file
+
+  LatencyProbe latencyProbe{LATENCY_PROBE};          // optional
+  std::string  latencyProbe_str{LATENCY_PROBE_STR};  // just for debug output
+  std::string  latencyProbeProperty{};               // optional, MQTT v5 user property with the arrival time
+
+  std::string  captureFile{};                     // optional, records the received datagrams, empty: disabled
+  std::int64_t captureMaxSize{CAPTURE_MAX_SIZE};  // optional, bytes per capture file
+
+  /**
+   * @brief Constructor of the application options parser
+   * 
+   * The constructor parses the CLI arguments to set up the initial config values.
+   * Additional parameters will be read from the specified config file by calling
+   * parseConfFile().
+   */
+  AppOptions(int argc, char* argv[] /* NOLINT(modernize-avoid-c-arrays,cppcoreguidelines-avoid-c-arrays) */) :
+      verbosity{0},
+      applicationName{argv[0]} {
+    std::vector<std::string> cliArgs{};
+    for (int i = 1; i < argc; i++) {
+      cliArgs.emplace_back(argv[i]);
+    }
+
+    while (!cliArgs.empty()) {
+      auto arg = *cliArgs.begin();
+
+      // find flags (but only at the beginning)
+      if (0 == arg.find("-h")) {
+        printUsage();
+        exit(EXIT_SUCCESS);
+        break;
+      }
+      if (0 == arg.find("-v")) {
+        this->verbosity = 0 == arg.find("-vv") ? 2 : 1;
+
+      } else if (0 == arg.find("-c=")) {
+        this->confPath = arg.substr(arg.find('=') + 1);
+
+      } else if (0 == arg.find("-r=")) {
+        this->replayFile = arg.substr(arg.find('=') + 1);
+
+      } else if (0 == arg.find("-s=")) {
+        this->replaySpeed = std::strtod(arg.substr(arg.find('=') + 1).c_str(), nullptr);
+        if (this->replaySpeed < 0) {
+          printUsageShort();
+          std::cerr << "error: the replay speed must not be negative\n";
+          exit(EXIT_FAILURE);
+        }
+
+      } else {
+        printUsageShort();
+        std::cerr << "error: unrecognized arguments: " << arg << "\n";
+        exit(EXIT_FAILURE);
+        break;
+      }
+
+      // remove the parsed argument from the vector
+      cliArgs.erase(cliArgs.begin());
+    }
+  }
+
+  /**
+   * @brief Parse the .conf file specified by the correponding CLI option
+   * 
+   * @return    Returns False, if the configuration is invalid
+   * @exception Will throw a runtime_error, if file could not be opened or has invalid syntax.
+   * @exception Will throw intalid_argument, if integer values could not be parsed
+   */
+  bool parseConfFile() {
+    std::fstream confFile;
+    confFile.open(this->confPath, std::ios::in);
+    if (!confFile.is_open()) {
+      std::cerr << "[ERROR] Unable to open config file\n";
+      throw std::runtime_error("Unable to open config file");
+    }
+
+    // parse config file
+    std::string confLine;
+    int         lineNum{0};
+    while (std::getline(confFile, confLine)) {
+      lineNum++;
+      confLine = trimComment(confLine);
+      confLine = trim(confLine);
+
+      if (confLine.empty()) {
+        continue;
+      }
+
+      // interpret config parameters
+      auto space = confLine.find(' ');
+      if (std::string::npos == space) {
+        std::cerr << "[ERROR] Invalid parameter in .conf file at line " << lineNum << "\n";
+        throw std::runtime_error("Config file: Invalid synatx");
+      }
+      std::string key = confLine.substr(0, space);
+      std::string val = confLine.substr(space + 1, confLine.size() - space);
+
+      if ("InputUdpPort" == key) {
+        this->inputUdpPort = std::stoi(val);
+      } else if ("Route" == key) {
+        auto routeSpace = val.find(' ');
+        if (std::string::npos == routeSpace) {
+          std::cerr << "[ERROR] Invalid Route in .conf file at line " << lineNum << ", expected: Route PORT TOPIC\n";
+          throw std::runtime_error("Config file: Invalid synatx");
+        }
+        this->routes.push_back({std::stoi(val.substr(0, routeSpace)), trim(val.substr(routeSpace + 1))});
+      } else if ("TopicRule" == key) {
+        this->topicRules.push_back(parseTopicRule(val, lineNum));
+      } else if ("PayloadFilter" == key) {
+        this->payloadFilters.push_back(parsePayloadFilter(val, lineNum));
+      } else if ("Workers" == key) {
+        this->workers = std::stoi(val);
+      } else if ("WorkerCpuAffinity" == key) {
+        this->workerCpuAffinity = parseIntList(val);
+      } else if ("ReceiverCpuAffinity" == key) {
+        this->receiverCpuAffinity = parseIntList(val);
+      } else if ("ReceiverPriority" == key) {
+        this->receiverPriority = std::stoi(val);
+      } else if ("UdpBindAddress" == key) {
+        if (!IpAddress::parse(val, this->udpBindAddress)) {
+          std::cerr << "[ERROR] Invalid UdpBindAddress at line " << lineNum << ", expected an IPv4 or IPv6 address\n";
+          throw std::runtime_error("Config file: Invalid synatx");
+        }
+      } else if ("UdpInterface" == key) {
+        this->udpInterface = val;
+      } else if ("UdpMulticastGroup" == key) {
+        IpAddress group{};
+        if (!IpAddress::parse(val, group) || !group.isMulticast()) {
+          std::cerr << "[ERROR] Invalid UdpMulticastGroup at line " << lineNum
+                    << ", expected an IPv4 (224.0.0.0/4) or IPv6 (ff00::/8) multicast address\n";
+          throw std::runtime_error("Config file: Invalid synatx");
+        }
+        this->udpMulticastGroups.push_back(group);
+      } else if ("UdpBatchSize" == key) {
+        this->udpBatchSize = std::stoi(val);
+      } else if ("UdpMaxDatagramSize" == key) {
+        this->udpMaxDatagramSize = std::stoi(val);
+      } else if ("UdpReceiveBufferSize" == key) {
+        this->udpReceiveBufferSize = std::stoi(val);
+      } else if ("UdpReceiveBufferForce" == key) {
+        this->udpReceiveBufferForce = std::stoi(val);
+      } else if ("UdpBusyPoll" == key) {
+        this->udpBusyPoll = std::stoi(val);
+      } else if ("UdpSpinTime" == key) {
+        this->udpSpinTime = std::stoi(val);
+      } else if ("UdpIoUring" == key) {
+        this->udpIoUring = std::stoi(val);
+      } else if ("UdpIoUringBuffers" == key) {
+        this->udpIoUringBuffers = std::stoi(val);
+      } else if ("QueueCapacity" == key) {
+        this->queueCapacity = std::stoi(val);
+      } else if ("ShedQueueDepth" == key) {
+        this->shedQueueDepth = std::stoi(val);
+      } else if ("ShedLatency" == key) {
+        this->shedLatency = std::stoi(val);
+      } else if ("RouteQos" == key) {
+        auto space = val.find(' ');
+        if (std::string::npos == space) {
+          std::cerr << "[ERROR] Invalid RouteQos in .conf file at line " << lineNum
+                    << ", expected: RouteQos PORT QOS\n";
+          throw std::runtime_error("Config file: Invalid synatx");
+        }
+        this->routeQos.emplace_back(std::stoi(val.substr(0, space)), std::stoi(trim(val.substr(space + 1))));
+      } else if ("RoutePriority" == key) {
+        auto space = val.find(' ');
+        if (std::string::npos == space) {
+          std::cerr << "[ERROR] Invalid RoutePriority in .conf file at line " << lineNum
+                    << ", expected: RoutePriority PORT critical|normal|bulk\n";
+          throw std::runtime_error("Config file: Invalid synatx");
+        }
+        this->routePriorities.emplace_back(std::stoi(val.substr(0, space)),
+                                           parseRoutePriority(trim(val.substr(space + 1)), lineNum));
+      } else if ("QueueOverflowPolicy" == key) {
+        this->queueOverflowPolicy_str = val;
+        if ("drop-oldest" == val) {
+          this->queueOverflowPolicy = OverflowPolicy::DropOldest;
+        } else if ("drop-newest" == val) {
+          this->queueOverflowPolicy = OverflowPolicy::DropNewest;
+        } else if ("block" == val) {
+          this->queueOverflowPolicy = OverflowPolicy::Block;
+        } else {
+          std::cerr << "[ERROR] Invalid value for QueueOverflowPolicy\n";
+          throw std::runtime_error("Config file: Invalid synatx");
+        }
+      } else if ("CoalesceMaxMessages" == key) {
+        this->coalesceMaxMessages = std::stoi(val);
+      } else if ("CoalesceMaxBytes" == key) {
+        this->coalesceMaxBytes = std::stoi(val);
+      } else if ("CoalesceLinger" == key) {
+        this->coalesceLinger = std::stoi(val);
+      } else if ("ShutdownTimeout" == key) {
+        this->shutdownTimeout = std::stoi(val);
+      } else if ("LogFormat" == key) {
+        this->logFormat_str = val;
+        if ("text" == val) {
+          this->logFormat = LogFormat::Text;
+        } else if ("json" == val) {
+          this->logFormat = LogFormat::Json;
+        } else {
+          std::cerr << "[ERROR] Invalid value for LogFormat\n";
+          throw std::runtime_error("Config file: Invalid synatx");
+        }
+      } else if ("LogRateLimit" == key) {
+        this->logRateLimit = std::stoi(val);
+      } else if ("StatsInterval" == key) {
+        this->statsInterval = std::stoi(val);
+      } else if ("StatsHttpAddress" == key) {
+        this->statsHttpAddress = val;
+      } else if ("StatsHttpPort" == key) {
+        this->statsHttpPort = std::stoi(val);
+      } else if ("SpillMemorySize" == key) {
+        this->spillMemorySize = std::stoi(val);
+      } else if ("SpillDirectory" == key) {
+        this->spillDirectory = val;
+      } else if ("SpillSegmentSize" == key) {
+        this->spillSegmentSize = std::stoi(val);
+      } else if ("SpillMaxSegments" == key) {
+        this->spillMaxSegments = std::stoi(val);
+      } else if ("SpillReplayRate" == key) {
+        this->spillReplayRate = std::stoi(val);
+      } else if ("DedupWindow" == key) {
+        this->dedupWindow = std::stoi(val);
+      } else if ("DedupCapacity" == key) {
+        this->dedupCapacity = std::stoi(val);
+      } else if ("SourceRateLimit" == key) {
+        this->sourceRateLimit = std::stoi(val);
+      } else if ("SourceRateBurst" == key) {
+        this->sourceRateBurst = std::stoi(val);
+      } else if ("SourcePrefixLength" == key) {
+        this->sourcePrefixLength = std::stoi(val);
+        if (this->sourcePrefixLength < 0 || this->sourcePrefixLength > 32) {
+          std::cerr << "[ERROR] SourcePrefixLength must be between 0 and 32\n";
+          throw std::runtime_error("Config file: Invalid synatx");
+        }
+        this->sourceMask = IpAddress::prefixMask(this->sourcePrefixLength, true);
+      } else if ("SourcePrefixLength6" == key) {
+        this->sourcePrefixLength6 = std::stoi(val);
+        if (this->sourcePrefixLength6 < 0 || this->sourcePrefixLength6 > 128) {
+          std::cerr << "[ERROR] SourcePrefixLength6 must be between 0 and 128\n";
+          throw std::runtime_error("Config file: Invalid synatx");
+        }
+        this->sourceMask6 = IpAddress::prefixMask(this->sourcePrefixLength6, false);
+      } else if ("SourceTableSize" == key) {
+        this->sourceTableSize = std::stoi(val);
+      } else if ("FairQueuing" == key) {
+        this->fairQueuing = std::stoi(val);
+      } else if ("Compression" == key) {
+        this->compression_str = val;
+        this->compression     = parseCompression(val, lineNum);
+      } else if ("RouteCompression" == key) {
+        auto space = val.find(' ');
+        if (std::string::npos == space) {
+          std::cerr << "[ERROR] Invalid RouteCompression in .conf file at line " << lineNum
+                    << ", expected: RouteCompression PORT ALGORITHM\n";
+          throw std::runtime_error("Config file: Invalid synatx");
+        }
+        this->routeCompressions.emplace_back(std::stoi(val.substr(0, space)),
+                                             parseCompression(trim(val.substr(space + 1)), lineNum));
+      } else if ("CompressionLevel" == key) {
+        this->compressionLevel = std::stoi(val);
+      } else if ("CompressionDictionary" == key) {
+        this->compressionDictionary = val;
+      } else if ("LatencyProbe" == key) {
+        this->latencyProbe_str = val;
+        if ("off" == val) {
+          this->latencyProbe = LatencyProbe::Off;
+        } else if ("software" == val) {
+          this->latencyProbe = LatencyProbe::Software;
+        } else if ("hardware" == val) {
+          this->latencyProbe = LatencyProbe::Hardware;
+        } else {
+          std::cerr << "[ERROR] Invalid value for LatencyProbe\n";
+          throw std::runtime_error("Config file: Invalid synatx");
+        }
+      } else if ("LatencyProbeProperty" == key) {
+        this->latencyProbeProperty = val;
+      } else if ("CaptureFile" == key) {
+        this->captureFile = val;
+      } else if ("CaptureMaxSize" == key) {
+        this->captureMaxSize = std::stoll(val);
+      } else if ("MqttUrl" == key) {
+        this->mqttUrl = val;
+      } else if ("MqttTopic" == key) {
+        this->mqttTopic = val;
+      } else if ("MqttConnections" == key) {
+        this->mqttConnections = std::stoi(val);
+      } else if ("MqttShardKey" == key) {
+        this->mqttShardKey_str = val;
+        if ("topic" == val) {
+          this->mqttShardKey = ShardKey::Topic;
+        } else if ("source" == val) {
+          this->mqttShardKey = ShardKey::Source;
+        } else {
+          std::cerr << "[ERROR] Invalid value for MqttShardKey\n";
+          throw std::runtime_error("Config file: Invalid synatx");
+        }
+      } else if ("MqttTarget" == key) {
+        this->mqttTargets.push_back(this->parseMqttTarget(val, lineNum));
+      } else if ("MqttTargetMode" == key) {
+        this->mqttTargetMode_str = val;
+        if ("fanout" == val) {
+          this->mqttTargetMode = TargetMode::FanOut;
+        } else if ("failover" == val) {
+          this->mqttTargetMode = TargetMode::Failover;
+        } else {
+          std::cerr << "[ERROR] Invalid value for MqttTargetMode\n";
+          throw std::runtime_error("Config file: Invalid synatx");
+        }
+      } else {
+        this->parseMqttParameter(key, val);
+      }
+    }
+
+    // check configuration
+    bool returnValue = true;
+    if (this->mqttUrl.empty()) {
+      std::cerr << "[ERROR] MqttUrl must be set in the configuration file\n";
+      returnValue = false;
+    }
+    if ((0 == this->inputUdpPort) != this->mqttTopic.empty()) {
+      std::cerr << "[ERROR] InputUdpPort and MqttTopic must be set together in the configuration file\n";
+      returnValue = false;
+    } else if (0 != this->inputUdpPort) {
+      this->routes.insert(this->routes.begin(), {this->inputUdpPort, this->mqttTopic});
+    }
+    if (this->routes.empty()) {
+      std::cerr << "[ERROR] InputUdpPort and MqttTopic or a Route must be set in the configuration file\n";
+      returnValue = false;
+    }
+    for (std::size_t i = 0; i < this->routes.size(); i++) {
+      if (this->routes[i].port < 1 || this->routes[i].port > UINT16_MAX || this->routes[i].topic.empty()) {
+        std::cerr << "[ERROR] Invalid route " << this->routes[i].port << " -> " << this->routes[i].topic << "\n";
+        returnValue = false;
+      }
+      for (std::size_t j = 0; j < i; j++) {
+        if (this->routes[i].port == this->routes[j].port) {
+          std::cerr << "[ERROR] UDP port " << this->routes[i].port << " is used by more than one route\n";
+          returnValue = false;
+        }
+      }
+    }
+    for (auto& route : this->routes) {
+      route.compression = this->compression;
+    }
+    for (const auto& routeCompression : this->routeCompressions) {
+      bool routeFound{false};
+      for (auto& route : this->routes) {
+        if (route.port == routeCompression.first) {
+          route.compression = routeCompression.second;
+          routeFound        = true;
+        }
+      }
+      if (!routeFound) {
+        std::cerr << "[ERROR] RouteCompression refers to UDP port " << routeCompression.first
+                  << ", which has no route\n";
+        returnValue = false;
+      }
+    }
+    for (const auto& routeQos : this->routeQos) {
+      bool routeFound{false};
+      for (auto& route : this->routes) {
+        if (route.port == routeQos.first) {
+          route.qos  = routeQos.second;
+          routeFound = true;
+        }
+      }
+      if (!routeFound || routeQos.second < 0 || routeQos.second > 2) {
+        std::cerr << "[ERROR] RouteQos " << routeQos.first << " " << routeQos.second
+                  << " refers to no route or the QoS is not 0-2\n";
+        returnValue = false;
+      }
+    }
+    for (const auto& routePriority : this->routePriorities) {
+      bool routeFound{false};
+      for (auto& route : this->routes) {
+        if (route.port == routePriority.first) {
+          route.priority = routePriority.second;
+          routeFound     = true;
+        }
+      }
+      if (!routeFound) {
+        std::cerr << "[ERROR] RoutePriority refers to UDP port " << routePriority.first << ", which has no route\n";
+        returnValue = false;
+      }
+    }
+    if (!this->compressionDictionary.empty()) {
+      std::ifstream dictionaryFile(this->compressionDictionary, std::ios::binary);
+      this->compressionDictionaryData.assign(std::istreambuf_iterator<char>(dictionaryFile),
+                                             std::istreambuf_iterator<char>());
+      if (this->compressionDictionaryData.empty()) {
+        std::cerr << "[ERROR] Could not read CompressionDictionary " << this->compressionDictionary << "\n";
+        returnValue = false;
+      }
+    }
+    for (const auto& rule : this->topicRules) {
+      bool routeFound = (0 == rule.port);
+      for (const auto& route : this->routes) {
+        routeFound = routeFound || (route.port == rule.port);
+      }
+      if (!routeFound) {
+        std::cerr << "[ERROR] TopicRule " << rule.match << " refers to UDP port " << rule.port
+                  << ", which has no route\n";
+        returnValue = false;
+      }
+    }
+    for (const auto& filter : this->payloadFilters) {
+      bool routeFound = (0 == filter.port);
+      for (const auto& route : this->routes) {
+        routeFound = routeFound || (route.port == filter.port);
+      }
+      if (!routeFound) {
+        std::cerr << "[ERROR] PayloadFilter " << filter.match << " refers to UDP port " << filter.port
+                  << ", which has no route\n";
+        returnValue = false;
+      }
+      if (filter.minLength < 0 || filter.maxLength < 0 || filter.magicOffset < 0 || filter.typeOffset < 0 ||
+          (0 != filter.maxLength && filter.maxLength < filter.minLength)) {
+        std::cerr << "[ERROR] PayloadFilter " << filter.match
+                  << ": lengths and offsets must not be negative, maxlen not below minlen\n";
+        returnValue = false;
+      }
+    }
+    if (this->mqttClientID.empty()) {
+      std::cerr << "[ERROR] MqttClientID must be set in the configuration file\n";
+      returnValue = false;
+    }
+
+    if (this->workers < 1) {
+      std::cerr << "[ERROR] Workers must be at least 1\n";
+      returnValue = false;
+    }
+    for (auto cpu : this->workerCpuAffinity) {
+      if (cpu < 0 || cpu >= CPU_SETSIZE) {
+        std::cerr << "[ERROR] Invalid CPU number " << cpu << " in WorkerCpuAffinity\n";
+        returnValue = false;
+      }
+    }
+    for (auto cpu : this->receiverCpuAffinity) {
+      if (cpu < 0 || cpu >= CPU_SETSIZE) {
+        std::cerr << "[ERROR] Invalid CPU number " << cpu << " in ReceiverCpuAffinity\n";
+        returnValue = false;
+      }
+    }
+    if (0 != this->receiverPriority && (this->receiverPriority < sched_get_priority_min(SCHED_FIFO) ||
+                                        this->receiverPriority > sched_get_priority_max(SCHED_FIFO))) {
+      std::cerr << "[ERROR] ReceiverPriority must be 0 or between " << sched_get_priority_min(SCHED_FIFO) << " and "
+                << sched_get_priority_max(SCHED_FIFO) << "\n";
+      returnValue = false;
+    }
+    for (const auto& group : this->udpMulticastGroups) {
+      if (this->udpBindAddress.isV4() && !group.isV4()) {
+        std::cerr << "[ERROR] IPv6 UdpMulticastGroup " << group.toString() << " needs an IPv6 UdpBindAddress\n";
+        returnValue = false;
+      }
+      if (!this->udpBindAddress.isUnspecified() && this->udpBindAddress != group) {
+        std::cerr << "[ERROR] UdpMulticastGroup needs UdpBindAddress to be the group or unspecified (:: or 0.0.0.0)\n";
+        returnValue = false;
+        break;
+      }
+    }
+    if (this->udpBatchSize < 1) {
+      std::cerr << "[ERROR] UdpBatchSize must be at least 1\n";
+      returnValue = false;
+    }
+    if (this->udpMaxDatagramSize < 1 || this->udpMaxDatagramSize > UDP_MAX_DATAGRAM_LIMIT) {
+      std::cerr << "[ERROR] UdpMaxDatagramSize must be between 1 and " << UDP_MAX_DATAGRAM_LIMIT << "\n";
+      returnValue = false;
+    }
+    if (this->udpReceiveBufferSize < 0) {
+      std::cerr << "[ERROR] UdpReceiveBufferSize must not be negative\n";
+      returnValue = false;
+    }
+    if (this->udpBusyPoll < 0 || this->udpSpinTime < 0) {
+      std::cerr << "[ERROR] UdpBusyPoll/ UdpSpinTime must not be negative\n";
+      returnValue = false;
+    }
+#ifndef UDPMQTTGW_IO_URING
+    if (0 != this->udpIoUring) {
+      std::cerr << "[ERROR] UdpIoUring is not built in, see the CMake option UDPMQTTGW_IO_URING\n";
+      returnValue = false;
+    }
+#endif
+    if (this->udpIoUringBuffers < 1 || this->udpIoUringBuffers > UDP_IO_URING_BUFFERS_LIMIT) {
+      std::cerr << "[ERROR] UdpIoUringBuffers must be between 1 and " << UDP_IO_URING_BUFFERS_LIMIT << "\n";
+      returnValue = false;
+    }
+    if (0 != this->receiverPriority && 0 != this->udpSpinTime && this->receiverCpuAffinity.empty()) {
+      // a spinning real-time thread would starve the publisher thread on the same CPU
+      std::cerr << "[ERROR] ReceiverPriority with UdpSpinTime needs dedicated CPUs in ReceiverCpuAffinity\n";
+      returnValue = false;
+    }
+    if (this->queueCapacity < 1) {
+      std::cerr << "[ERROR] QueueCapacity must be at least 1\n";
+      returnValue = false;
+    }
+    if (this->shedQueueDepth < 1 || this->shedQueueDepth > 100 || this->shedLatency < 0) {
+      std::cerr << "[ERROR] ShedQueueDepth must be 1-100 (percent), ShedLatency must not be negative\n";
+      returnValue = false;
+    }
+    if (this->coalesceMaxMessages < 0 || this->coalesceMaxBytes < 1 || this->coalesceLinger < 0) {
+      std::cerr << "[ERROR] CoalesceMaxMessages/ CoalesceLinger must not be negative, CoalesceMaxBytes positive\n";
+      returnValue = false;
+    }
+    if (this->shutdownTimeout < 0) {
+      std::cerr << "[ERROR] ShutdownTimeout must not be negative\n";
+      returnValue = false;
+    }
+    if (this->logRateLimit < 0) {
+      std::cerr << "[ERROR] LogRateLimit must not be negative\n";
+      returnValue = false;
+    }
+    if (this->statsInterval < 0) {
+      std::cerr << "[ERROR] StatsInterval must not be negative\n";
+      returnValue = false;
+    }
+    if (this->statsHttpPort < 0 || this->statsHttpPort > UINT16_MAX) {
+      std::cerr << "[ERROR] StatsHttpPort must be between 0 and " << UINT16_MAX << "\n";
+      returnValue = false;
+    }
+    if (this->mqttReconnectMinDelay < 1 || this->mqttReconnectMaxDelay < this->mqttReconnectMinDelay) {
+      std::cerr << "[ERROR] MqttReconnectMinDelay must be at least 1 and not above MqttReconnectMaxDelay\n";
+      returnValue = false;
+    }
+    if (this->spillMemorySize < 0 || this->spillMaxSegments < 0 || this->spillReplayRate < 1) {
+      std::cerr << "[ERROR] SpillMemorySize/ SpillMaxSegments must not be negative, SpillReplayRate positive\n";
+      returnValue = false;
+    }
+    if (!this->spillDirectory.empty() && this->spillSegmentSize < 2 * UDP_MAX_DATAGRAM_LIMIT) {
+      std::cerr << "[ERROR] SpillSegmentSize must be at least " << 2 * UDP_MAX_DATAGRAM_LIMIT << "\n";
+      returnValue = false;
+    }
+    if (this->dedupWindow < 0 || this->dedupWindow > DEDUP_WINDOW_LIMIT || this->dedupCapacity < 1) {
+      std::cerr << "[ERROR] DedupWindow must be between 0 and " << DEDUP_WINDOW_LIMIT
+                << ", DedupCapacity at least 1\n";
+      returnValue = false;
+    }
+    if (this->sourceRateLimit < 0 || this->sourceRateBurst < 1 || this->sourceTableSize < 1) {
+      std::cerr << "[ERROR] SourceRateLimit must not be negative, SourceRateBurst/ SourceTableSize positive\n";
+      returnValue = false;
+    }
+    if (!this->latencyProbeProperty.empty() &&
+        (LatencyProbe::Off == this->latencyProbe || MQTTVERSION_5 != this->mqttVersion)) {
+      std::cerr << "[ERROR] LatencyProbeProperty needs a LatencyProbe and MqttVersion 5\n";
+      returnValue = false;
+    }
+    if (!this->captureFile.empty() && this->captureMaxSize < 2 * UDP_MAX_DATAGRAM_LIMIT) {
+      std::cerr << "[ERROR] CaptureMaxSize must be at least " << 2 * UDP_MAX_DATAGRAM_LIMIT << "\n";
+      returnValue = false;
+    }
+    if (!this->replayFile.empty()) {
+      this->workers = 1;  // the capture is replayed in order, by a single receiver thread
+    }
+    if (this->mqttMaxInflight < 1) {
+      std::cerr << "[ERROR] MqttMaxInflight must be at least 1\n";
+      returnValue = false;
+    }
+    if (this->mqttSendQueueSize < 1) {
+      std::cerr << "[ERROR] MqttSendQueueSize must be at least 1\n";
+      returnValue = false;
+    }
+    if (this->mqttTargets.size() + 1 > MQTT_TARGETS_LIMIT) {
+      std::cerr << "[ERROR] At most " << MQTT_TARGETS_LIMIT - 1 << " MqttTarget(s) can be added to MqttUrl\n";
+      returnValue = false;
+    }
+    if (this->mqttConnections < 1) {
+      std::cerr << "[ERROR] MqttConnections must be at least 1\n";
+      returnValue = false;
+    }
+    if (this->mqttTopicAliases < 0 || this->mqttTopicAliases > UINT16_MAX) {
+      std::cerr << "[ERROR] MqttTopicAliases must be between 0 and " << UINT16_MAX << "\n";
+      returnValue = false;
+    }
+
+    if (!this->mqttUsername.empty() && this->mqttPassword.empty()) {
+      std::cerr << "[ERROR] MqttPassword must be set when a username is given\n";
+      returnValue = false;
+    }
+
+    return returnValue;
+  }
+
+  /**
+   * @brief Number of MQTT brokers, MqttUrl and the MqttTargets
+   */
+  std::size_t targetCount() const { return 1 + this->mqttTargets.size(); }
+
+  /**
+   * @brief Configuration with the MQTT connection parameters of a broker
+   *
+   * @param target  0 for MqttUrl, then the MqttTargets in order of the configuration file
+   */
+  AppOptions targetOptions(std::size_t target) const {
+    AppOptions options(*this);
+    if (0 != target) {
+      options.mqttUrl = this->mqttTargets[target - 1].url;
+      for (const auto& parameter : this->mqttTargets[target - 1].parameters) {
+        options.parseMqttParameter(parameter.first, parameter.second);
+      }
+    }
+    return options;
+  }
+
+  void printConfig() const {
+    std::cout << "Configuration:\n";
+    for (const auto& route : this->routes) {
+      std::cout << "- Route:                UDP " << route.port << " -> MQTT " << route.topic
+                << (Compression::Lz4 == route.compression ? " (lz4)" : "")
+                << (Compression::Zstd == route.compression ? " (zstd)" : "")
+                << (0 <= route.qos ? " (QoS " + std::to_string(route.qos) + ")" : "")
+                << (RoutePriority::Critical == route.priority ? " (critical)" : "")
+                << (RoutePriority::Bulk == route.priority ? " (bulk)" : "") << "\n";
+    }
+    for (const auto& rule : this->topicRules) {
+      std::cout << "- Topic Rule:           " << rule.match << " -> MQTT " << rule.topic << "\n";
+    }
+    for (const auto& filter : this->payloadFilters) {
+      std::cout << "- Payload Filter:       " << filter.match << "\n";
+    }
+    std::cout << "- MQTT URL:             " << this->mqttUrl << "\n";
+    for (const auto& target : this->mqttTargets) {
+      std::cout << "- MQTT Target:          " << target.url << " (" << this->mqttTargetMode_str << ")";
+      for (const auto& parameter : target.parameters) {
+        std::cout << " " << parameter.first << "=" << parameter.second;
+      }
+      std::cout << "\n";
+    }
+    std::cout << "- MQTT Client ID:       " << this->mqttClientID << "\n";
+    if (!this->mqttUsername.empty()) {
+      std::cout << "- MQTT User Name:       " << this->mqttUsername << "\n";
+      std::cout << "- MQTT Password:        " << this->mqttPassword << "\n";
+    }
+
+    std::cout << "\n";
+    std::cout << "- MQTT Version:         " << this->mqttVersion_str << "\n";
+    std::cout << "- MQTT QOS Level:       " << this->mqttQosLevel << "\n";
+    std::cout << "- MQTT Keep Alive Int.: " << this->mqttKeepAliveInterval << "\n";
+    std::cout << "- MQTT Retry Int.:      " << this->mqttRetryInterval << "\n";
+    std::cout << "- MQTT Max. In-Flight:  " << this->mqttMaxInflight << "\n";
+#ifdef UDPMQTTGW_MQTT_ASYNC
+    std::cout << "- MQTT Send Queue Size: " << this->mqttSendQueueSize << "\n";
+#endif
+    std::cout << "- MQTT Reconnect Delay: " << this->mqttReconnectMinDelay << " - " << this->mqttReconnectMaxDelay
+              << " ms\n";
+    if (0 != this->mqttTcpNoDelay) {
+      std::cout << "- MQTT TCP No Delay:    on\n";
+    }
+    if (MQTTVERSION_5 == this->mqttVersion) {
+      std::cout << "- MQTT Topic Aliases:   " << this->mqttTopicAliases << "\n";
+    }
+    if (this->mqttConnections > 1) {
+      std::cout << "- MQTT Connections:     " << this->mqttConnections << " per worker, by "
+                << this->mqttShardKey_str << "\n";
+    }
+
+    std::cout << "- TLS Server Cert Auth: " << this->mqttSslEnableServerCertAuth << "\n";
+    std::cout << "- TLS Version:          " << this->mqttSslVersion_str << "\n";
+    std::cout << "- TLS Verify:           " << this->mqttSslVerify << "\n";
+    if (!this->mqttSslTrustStore.empty()) {
+      std::cout << "- TLS Trust Store:      " << this->mqttSslTrustStore << "\n";
+    }
+    if (!this->mqttSslKeyStore.empty()) {
+      std::cout << "- TLS Key Store:        " << this->mqttSslKeyStore << "\n";
+    }
+    if (!this->mqttSslPrivateKey.empty()) {
+      std::cout << "- TLS Private Key:      " << this->mqttSslPrivateKey << "\n";
+      std::cout << "- TLS Priv. Key Passwd: " << this->mqttSslPrivateKeyPasswd << "\n";
+    }
+
+    std::cout << "\n";
+    std::cout << "- Workers:              " << this->workers << "\n";
+    if (!this->workerCpuAffinity.empty()) {
+      std::cout << "- Worker CPU Affinity: ";
+      for (auto cpu : this->workerCpuAffinity) {
+        std::cout << " " << cpu;
+      }
+      std::cout << "\n";
+    }
+    if (!this->receiverCpuAffinity.empty()) {
+      std::cout << "- Receiver CPU Affinity:";
+      for (auto cpu : this->receiverCpuAffinity) {
+        std::cout << " " << cpu;
+      }
+      std::cout << "\n";
+    }
+    if (0 != this->receiverPriority) {
+      std::cout << "- Receiver Priority:    " << this->receiverPriority << " (SCHED_FIFO)\n";
+    }
+    std::cout << "- UDP Bind Address:     " << this->udpBindAddress.toString()
+              << (this->udpInterface.empty() ? "" : " on " + this->udpInterface) << "\n";
+    for (const auto& group : this->udpMulticastGroups) {
+      std::cout << "- UDP Multicast Group:  " << group.toString() << "\n";
+    }
+    std::cout << "- UDP Batch Size:       " << this->udpBatchSize << "\n";
+    std::cout << "- UDP Max. Datagram:    " << this->udpMaxDatagramSize << "\n";
+    if (0 != this->udpReceiveBufferSize) {
+      std::cout << "- UDP Receive Buffer:   " << this->udpReceiveBufferSize
+                << (0 != this->udpReceiveBufferForce ? " (forced)" : "") << "\n";
+    }
+    if (0 != this->udpBusyPoll) {
+      std::cout << "- UDP Busy Poll:        " << this->udpBusyPoll << " us\n";
+    }
+    if (0 != this->udpSpinTime) {
+      std::cout << "- UDP Spin Time:        " << this->udpSpinTime << " us\n";
+    }
+    if (0 != this->udpIoUring) {
+      std::cout << "- UDP io_uring Buffers: " << this->udpIoUringBuffers << "\n";
+    }
+    std::cout << "- Queue Capacity:       " << this->queueCapacity << "\n";
+    std::cout << "- Queue Overflow:       " << this->queueOverflowPolicy_str << "\n";
+    std::cout << "- Overload Threshold:   " << this->shedQueueDepth << " % of the queue"
+              << (0 != this->shedLatency ? " or " + std::to_string(this->shedLatency) + " ms latency" : "") << "\n";
+    if (this->coalesceMaxMessages > 1) {
+      std::cout << "- Coalesce Max. Msgs:   " << this->coalesceMaxMessages << "\n";
+      std::cout << "- Coalesce Max. Bytes:  " << this->coalesceMaxBytes << "\n";
+      std::cout << "- Coalesce Linger:      " << this->coalesceLinger << " ms\n";
+    }
+    std::cout << "- Shutdown Timeout:     " << this->shutdownTimeout << " ms\n";
+    std::cout << "- Log Format:           " << this->logFormat_str << ", max. " << this->logRateLimit
+              << " message(s)/s per statement\n";
+    if (0 != this->statsInterval) {
+      std::cout << "- Stats Interval:       " << this->statsInterval << " s\n";
+    }
+    if (0 != this->statsHttpPort) {
+      std::cout << "- Stats HTTP Endpoint:  " << this->statsHttpAddress << ":" << this->statsHttpPort << "\n";
+    }
+    std::cout << "- Spill Memory:         " << this->spillMemorySize << "\n";
+    if (!this->spillDirectory.empty()) {
+      std::cout << "- Spill Directory:      " << this->spillDirectory << " (" << this->spillMaxSegments << " x "
+                << this->spillSegmentSize << " bytes)\n";
+    }
+    std::cout << "- Spill Replay Rate:    " << this->spillReplayRate << " msg/s\n";
+    if (0 != this->dedupWindow) {
+      std::cout << "- Dedup Window:         " << this->dedupWindow << " ms (" << this->dedupCapacity << " payloads)\n";
+    }
+    if (0 != this->sourceRateLimit) {
+      std::cout << "- Source Rate Limit:    " << this->sourceRateLimit << " msg/s (burst " << this->sourceRateBurst
+                << ", " << this->sourceTableSize << " sources)\n";
+    }
+    if (0 != this->sourceRateLimit || 0 != this->fairQueuing) {
+      std::cout << "- Source Prefix Length: " << this->sourcePrefixLength << " (IPv4), " << this->sourcePrefixLength6
+                << " (IPv6)\n";
+    }
+    if (0 != this->fairQueuing) {
+      std::cout << "- Fair Queuing:         on\n";
+    }
+    if (0 != this->compressionLevel) {
+      std::cout << "- Compression Level:    " << this->compressionLevel << "\n";
+    }
+    if (!this->compressionDictionary.empty()) {
+      std::cout << "- Compression Dict.:    " << this->compressionDictionary << "\n";
+    }
+    if (LatencyProbe::Off != this->latencyProbe) {
+      std::cout << "- Latency Probe:        " << this->latencyProbe_str << "\n";
+    }
+    if (!this->latencyProbeProperty.empty()) {
+      std::cout << "- Latency Property:     " << this->latencyProbeProperty << "\n";
+    }
+    if (!this->captureFile.empty()) {
+      std::cout << "- Capture File:         " << this->captureFile << " (max. " << this->captureMaxSize
+                << " bytes)\n";
+    }
+    if (!this->replayFile.empty()) {
+      std::cout << "- Replay File:          " << this->replayFile << " (speed "
+                << (0 == this->replaySpeed ? std::string("max.") : std::to_string(this->replaySpeed)) << ")\n";
+    }
+
+    std::cout << "\n";
+  }
+
+  void printUsageShort() const {
+    std::cout << "usage: " << this->applicationName << " ";
+    std::cout << "[-h] ";
+    std::cout << "[-v] ";
+    std::cout << "[-c=FILE] ";
+    std::cout << "[-r=FILE] ";
+    std::cout << "[-s=SPEED]\n";
+  }
+
+  void printUsage() const {
+    printUsageShort();
+    std::cout << "\n";
+    std::cout << "optional arguments:\n";
+    std::cout << "  -h,          show this help message and exit\n";
+    std::cout << "  -v,          increase output verbosity, -vv also logs every datagram (debug)\n";
+    std::cout << "  -c=FILE,     path to config file (default: " CONF_FILE "\n";
+    std::cout << "  -r=FILE,     replay a capture file (CaptureFile) instead of receiving UDP datagrams\n";
+    std::cout << "  -s=SPEED,    replay speed, factor of the recorded timing, 0 for max. speed (default: 1)\n";
+  }
+
+private:
+  std::string applicationName;
+
+  /**
+   * @brief Parse a parameter of the MQTT connection, like "MqttQosLevel 1"
+   *
+   * These can be set for each MqttTarget as well.
+   *
+   * @return    Returns False, if the key is no parameter of the MQTT connection
+   * @exception Will throw a runtime_error, if the value is invalid
+   * @exception Will throw invalid_argument, if integer values could not be parsed
+   */
+  bool parseMqttParameter(const std::string& key, const std::string& val) {
+    if ("MqttClientID" == key) {
+      this->mqttClientID = val;
+    } else if ("MqttUsername" == key) {
+      this->mqttUsername = val;
+    } else if ("MqttPassword" == key) {
+      this->mqttPassword = val;
+
+    } else if ("MqttVersion" == key) {
+      this->mqttVersion_str = val;
+      if ("default" == val) {
+        this->mqttVersion = MQTTVERSION_DEFAULT;
+      } else if ("3.1" == val) {
+        this->mqttVersion = MQTTVERSION_3_1;
+      } else if ("3.1.1" == val) {
+        this->mqttVersion = MQTTVERSION_3_1_1;
+      } else if ("5" == val) {
+        this->mqttVersion = MQTTVERSION_5;
+      } else {
+        std::cerr << "[ERROR] Invalid value for MqttVersion\n";
+        throw std::runtime_error("Config file: Invalid synatx");
+      }
+    } else if ("MqttQosLevel" == key) {
+      this->mqttQosLevel = std::stoi(val);
+    } else if ("MqttKeepAliveInterval" == key) {
+      this->mqttKeepAliveInterval = std::stoi(val);
+    } else if ("MqttRetryInterval" == key) {
+      this->mqttRetryInterval = std::stoi(val);
+    } else if ("MqttConnectionTimeout" == key) {
+      this->mqttConnectionTimeout = std::stoi(val);
+    } else if ("MqttMaxInflight" == key) {
+      this->mqttMaxInflight = std::stoi(val);
+    } else if ("MqttSendQueueSize" == key) {
+      this->mqttSendQueueSize = std::stoi(val);
+    } else if ("MqttReconnectMinDelay" == key) {
+      this->mqttReconnectMinDelay = std::stoi(val);
+    } else if ("MqttReconnectMaxDelay" == key) {
+      this->mqttReconnectMaxDelay = std::stoi(val);
+    } else if ("MqttTcpNoDelay" == key) {
+      this->mqttTcpNoDelay = std::stoi(val);
+    } else if ("MqttTopicAliases" == key) {
+      this->mqttTopicAliases = std::stoi(val);
+    } else if ("MqttSslEnableServerCertAuth" == key) {
+      this->mqttSslEnableServerCertAuth = std::stoi(val);
+    } else if ("MqttSslVersion" == key) {
+      this->mqttSslVersion_str = val;
+      if ("default" == val) {
+        this->mqttSslVersion = MQTT_SSL_VERSION_DEFAULT;
+      } else if ("1.0" == val) {
+        this->mqttSslVersion = MQTT_SSL_VERSION_TLS_1_0;
+      } else if ("1.1" == val) {
+        this->mqttSslVersion = MQTT_SSL_VERSION_TLS_1_0;
+      } else if ("1.2" == val) {
+        this->mqttSslVersion = MQTT_SSL_VERSION_TLS_1_0;
+      } else {
+        std::cerr << "[ERROR] Invalid value for MqttSslVersion\n";
+        throw std::runtime_error("Config file: Invalid synatx");
+      }
+    } else if ("MqttSslVerify" == key) {
+      this->mqttSslVerify = std::stoi(val);
+    } else if ("MqttSslTrustStore" == key) {
+      this->mqttSslTrustStore = val;
+    } else if ("MqttSslKeyStore" == key) {
+      this->mqttSslKeyStore = val;
+    } else if ("MqttSslPrivateKey" == key) {
+      this->mqttSslPrivateKey = val;
+    } else if ("MqttSslPrivateKeyPasswd" == key) {
+      this->mqttSslPrivateKeyPasswd = val;
+    } else {
+      return false;
+    }
+    return true;
+  }
+
+  /**
+   * @brief Parse the value of a MqttTarget line, like "ssl://host:8883 MqttQosLevel=1,MqttSslVerify=1"
+   *
+   * @exception Will throw a runtime_error, if the target has invalid syntax
+   * @exception Will throw invalid_argument, if integer values could not be parsed
+   */
+  MqttTargetOptions parseMqttTarget(const std::string& val, int lineNum) const {
+    MqttTargetOptions target{};
+
+    auto space = val.find(' ');
+    target.url = val.substr(0, space);
+    if (std::string::npos == space) {
+      return target;
+    }
+
+    std::string parameters = trim(val.substr(space + 1));
+    std::size_t start{0};
+    while (start <= parameters.size()) {
+      auto end = parameters.find(',', start);
+      if (std::string::npos == end) {
+        end = parameters.size();
+      }
+      std::string parameter = parameters.substr(start, end - start);
+      start                 = end + 1;
+
+      // the values are checked on a scratch copy, the target settings are applied by targetOptions()
+      auto       equals = parameter.find('=');
+      AppOptions scratch(*this);
+      if (std::string::npos == equals ||
+          !scratch.parseMqttParameter(trim(parameter.substr(0, equals)), trim(parameter.substr(equals + 1)))) {
+        std::cerr << "[ERROR] Invalid MqttTarget parameter " << parameter << " at line " << lineNum
+                  << ", expected: MqttTarget URL [KEY=VALUE,...] with MQTT connection parameters\n";
+        throw std::runtime_error("Config file: Invalid synatx");
+      }
+      target.parameters.emplace_back(trim(parameter.substr(0, equals)), trim(parameter.substr(equals + 1)));
+    }
+    return target;
+  }
+
+  std::string static trim(const std::string& str, const std::string& whitespace = " \t") {
+    const auto strBegin = str.find_first_not_of(whitespace);
+    if (strBegin == std::string::npos) {
+      return "";  // no content
+    }
+
+    const auto strEnd   = str.find_last_not_of(whitespace);
+    const auto strRange = strEnd - strBegin + 1;
+
+    return str.substr(strBegin, strRange);
+  }
+
+  std::string static trimComment(const std::string& str) {
+    const auto strEnd = str.find_first_of('#');
+    return str.substr(0, strEnd);
+  }
+
+  /**
+   * @brief Parse a comma separated list of integers, like "0,2,4"
+   *
+   * @exception Will throw invalid_argument, if an element is no integer
+   */
+  std::vector<int> static parseIntList(const std::string& str) {
+    std::vector<int> list{};
+    std::size_t      start{0};
+    while (start <= str.size()) {
+      auto end = str.find(',', start);
+      if (std::string::npos == end) {
+        end = str.size();
+      }
+      list.push_back(std::stoi(trim(str.substr(start, end - start))));
+      start = end + 1;
+    }
+    return list;
+  }
+
+  /**
+   * @brief Parse the priority class of a route
+   *
+   * @exception Will throw a runtime_error, if the class is unknown
+   */
+  RoutePriority static parseRoutePriority(const std::string& val, int lineNum) {
+    if ("critical" == val) {
+      return RoutePriority::Critical;
+    }
+    if ("normal" == val) {
+      return RoutePriority::Normal;
+    }
+    if ("bulk" == val) {
+      return RoutePriority::Bulk;
+    }
+    std::cerr << "[ERROR] Invalid route priority " << val << " at line " << lineNum
+              << ", expected critical, normal or bulk\n";
+    throw std::runtime_error("Config file: Invalid synatx");
+  }
+
+  /**
+   * @brief Parse a compression algorithm, which has to be built in
+   *
+   * @exception Will throw a runtime_error, if the algorithm is unknown or not built in
+   */
+  Compression static parseCompression(const std::string& val, int lineNum) {
+    if ("none" == val) {
+      return Compression::None;
+    }
+#ifdef UDPMQTTGW_LZ4
+    if ("lz4" == val) {
+      return Compression::Lz4;
+    }
+#endif
+#ifdef UDPMQTTGW_ZSTD
+    if ("zstd" == val) {
+      return Compression::Zstd;
+    }
+#endif
+    std::cerr << "[ERROR] Invalid or unsupported (not built in) compression " << val << " at line " << lineNum
+              << "\n";
+    throw std::runtime_error("Config file: Invalid synatx");
+  }
+
+  /**
+   * @brief Parse the value of a TopicRule line, like "src=10.0.0.0/8,prefix=02 base/{src_ip}"
+   *
+   * Conditions: port=N, src=IP[/BITS], srcport=N, prefix=HEX or * to match everything.
+   *
+   * @exception Will throw a runtime_error, if the rule has invalid syntax
+   * @exception Will throw invalid_argument, if integer values could not be parsed
+   */
+  TopicRuleOptions static parseTopicRule(const std::string& val, int lineNum) {
+    TopicRuleOptions rule{};
+
+    auto space = val.find(' ');
+    if (std::string::npos == space) {
+      std::cerr << "[ERROR] Invalid TopicRule in .conf file at line " << lineNum
+                << ", expected: TopicRule CONDITIONS TOPIC\n";
+      throw std::runtime_error("Config file: Invalid synatx");
+    }
+    rule.match = val.substr(0, space);
+    rule.topic = trim(val.substr(space + 1));
+
+    std::size_t start{0};
+    while (start <= rule.match.size() && "*" != rule.match) {
+      auto end = rule.match.find(',', start);
+      if (std::string::npos == end) {
+        end = rule.match.size();
+      }
+      std::string condition = rule.match.substr(start, end - start);
+      start                 = end + 1;
+
+      auto        equals = condition.find('=');
+      std::string name   = condition.substr(0, equals);
+      std::string arg    = (std::string::npos == equals) ? "" : condition.substr(equals + 1);
+
+      if ("port" == name) {
+        rule.port = std::stoi(arg);
+      } else if ("srcport" == name) {
+        rule.srcPort = std::stoi(arg);
+      } else if ("src" == name) {
+        auto      slash = arg.find('/');
+        IpAddress addr{};
+        bool      valid = IpAddress::parse(arg.substr(0, slash), addr);
+        int       limit = addr.isV4() ? 32 : 128;
+        int       bits  = (std::string::npos == slash) ? limit : std::stoi(arg.substr(slash + 1));
+        if (!valid || bits < 0 || bits > limit) {
+          std::cerr << "[ERROR] Invalid source address in TopicRule at line " << lineNum << "\n";
+          throw std::runtime_error("Config file: Invalid synatx");
+        }
+        rule.srcMask = IpAddress::prefixMask(bits, addr.isV4());
+        rule.srcAddr = addr & rule.srcMask;
+      } else if ("prefix" == name) {
+        if (!parseHexBytes(arg, rule.prefix)) {
+          std::cerr << "[ERROR] Invalid payload prefix in TopicRule at line " << lineNum << ", expected hex bytes\n";
+          throw std::runtime_error("Config file: Invalid synatx");
+        }
+      } else {
+        std::cerr << "[ERROR] Unknown condition \"" << name << "\" in TopicRule at line " << lineNum << "\n";
+        throw std::runtime_error("Config file: Invalid synatx");
+      }
+    }
+
+    // only known placeholders are allowed, so the topics can be rendered without checks later
+    std::size_t open = rule.topic.find('{');
+    while (std::string::npos != open) {
+      auto        close       = rule.topic.find('}', open);
+      std::string placeholder = rule.topic.substr(open, close - open + 1);
+      if ("{src_ip}" != placeholder && "{src_port}" != placeholder && "{port}" != placeholder) {
+        std::cerr << "[ERROR] Unknown placeholder " << placeholder << " in TopicRule at line " << lineNum << "\n";
+        throw std::runtime_error("Config file: Invalid synatx");
+      }
+      open = rule.topic.find('{', close);
+    }
+
+    return rule;
+  }
+
+  /**
+   * @brief Parse the value of a PayloadFilter line, like "port=4001,minlen=8,magic=CAFE,crc=crc32c"
+   *
+   * Checks: port=N, minlen=N, maxlen=N, magic=HEX[@OFFSET], crc=crc32|crc32c,
+   * droptypes=HEX[/HEX...][@OFFSET] (message type bytes).
+   *
+   * @exception Will throw a runtime_error, if the filter has invalid syntax
+   * @exception Will throw invalid_argument, if integer values could not be parsed
+   */
+  PayloadFilterOptions static parsePayloadFilter(const std::string& val, int lineNum) {
+    PayloadFilterOptions filter{};
+    filter.match = val;
+
+    std::size_t start{0};
+    while (start <= filter.match.size()) {
+      auto end = filter.match.find(',', start);
+      if (std::string::npos == end) {
+        end = filter.match.size();
+      }
+      std::string check = filter.match.substr(start, end - start);
+      start             = end + 1;
+
+      auto        equals = check.find('=');
+      std::string name   = check.substr(0, equals);
+      std::string arg    = (std::string::npos == equals) ? "" : check.substr(equals + 1);
+
+      // the byte checks may take an offset into the payload
+      auto        at     = arg.find('@');
+      int         offset = (std::string::npos == at) ? 0 : std::stoi(arg.substr(at + 1));
+      std::string bytes  = arg.substr(0, at);
+
+      if ("port" == name) {
+        filter.port = std::stoi(arg);
+      } else if ("minlen" == name) {
+        filter.minLength = std::stoi(arg);
+      } else if ("maxlen" == name) {
+        filter.maxLength = std::stoi(arg);
+      } else if ("magic" == name) {
+        filter.magicOffset = offset;
+        if (!parseHexBytes(bytes, filter.magic)) {
+          std::cerr << "[ERROR] Invalid magic bytes in PayloadFilter at line " << lineNum << ", expected hex bytes\n";
+          throw std::runtime_error("Config file: Invalid synatx");
+        }
+      } else if ("crc" == name) {
+        if ("crc32" == arg) {
+          filter.checksum = ChecksumType::Crc32;
+        } else if ("crc32c" == arg) {
+          filter.checksum = ChecksumType::Crc32c;
+        } else {
+          std::cerr << "[ERROR] Invalid checksum " << arg << " in PayloadFilter at line " << lineNum
+                    << ", expected crc32 or crc32c\n";
+          throw std::runtime_error("Config file: Invalid synatx");
+        }
+      } else if ("droptypes" == name) {
+        filter.typeOffset = offset;
+        std::size_t pos{0};
+        while (pos <= bytes.size()) {
+          auto        slash = std::min(bytes.find('/', pos), bytes.size());
+          std::string type{};
+          if (!parseHexBytes(bytes.substr(pos, slash - pos), type) || 1 != type.size()) {
+            std::cerr << "[ERROR] Invalid message type in PayloadFilter at line " << lineNum
+                      << ", expected a hex byte\n";
+            throw std::runtime_error("Config file: Invalid synatx");
+          }
+          filter.dropTypes += type;
+          pos = slash + 1;
+        }
+      } else {
+        std::cerr << "[ERROR] Unknown check \"" << name << "\" in PayloadFilter at line " << lineNum << "\n";
+        throw std::runtime_error("Config file: Invalid synatx");
+      }
+    }
+
+    return filter;
+  }
+
+  /**
+   * @brief Parse hex bytes like "0x02FF" or "02ff" and append them
+   *
+   * @return    Returns False, if the text is no sequence of hex bytes
+   */
+  bool static parseHexBytes(std::string text, std::string& bytes) {
+    if (0 == text.find("0x")) {
+      text = text.substr(2);
+    }
+    if (text.empty() || 0 != text.size() % 2 ||
+        std::string::npos != text.find_first_not_of("0123456789abcdefABCDEF")) {
+      return false;
+    }
+    for (std::size_t i = 0; i < text.size(); i += 2) {
+      bytes.push_back(static_cast<char>(std::stoi(text.substr(i, 2), nullptr, 16)));
+    }
+    return true;
+  }
+};
+
+#endif /* _APPOPTIONS_H */
@@ -0,0 +1,197 @@
+/**
+ * @file      Capture.cpp
+ * @brief     Recording of the received datagrams to a capture file and reading them for a replay
+ *
+ * @copyright (c) consider it GmbH, 2020
+ */
+
+#include "Capture.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "IpAddress.h"
+#include "Log.h"
+
+// static configuration values
+#define CAPTURE_MAGIC "UMGWCAP1"              // file header, version 1 of the record format
+#define CAPTURE_CHUNK_SIZE (8 * 1024 * 1024)  // bytes allocated at once
+#define RECORD_ALIGNMENT 8
+
+namespace {
+
+constexpr std::size_t MAGIC_SIZE  = sizeof(CAPTURE_MAGIC) - 1;
+constexpr std::size_t HEADER_SIZE = sizeof(CaptureRecord);
+
+std::size_t recordSize(std::size_t payloadLen) {
+  std::size_t size = HEADER_SIZE + payloadLen;
+  return (size + RECORD_ALIGNMENT - 1) / RECORD_ALIGNMENT * RECORD_ALIGNMENT;
+}
+
+std::string capturePath(const AppOptions& options, int worker) {
+  return options.workers > 1 ? options.captureFile + "." + std::to_string(worker) : options.captureFile;
+}
+
+}  // namespace
+
+CaptureWriter::CaptureWriter(const AppOptions& options, int worker) :
+    options{options},
+    path{capturePath(options, worker)},
+    maxSize{static_cast<std::size_t>(options.captureMaxSize)} {
+  // the datagrams of a replay are in a capture file already
+  if (options.captureFile.empty() || !options.replayFile.empty()) {
+    return;
+  }
+
+  // the whole file is mapped at once, but the blocks are allocated by reserve(), before they are written
+  this->fd = open(this->path.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, S_IRUSR | S_IWUSR);
+  if (0 <= this->fd) {
+    void* mapping = mmap(nullptr, this->maxSize, PROT_READ | PROT_WRITE, MAP_SHARED, this->fd, 0);
+    if (MAP_FAILED != mapping) {
+      this->data = static_cast<char*>(mapping);
+    }
+  }
+  if (nullptr == this->data || !this->reserve(MAGIC_SIZE)) {
+    LOG_ERROR("Could not create capture file " << this->path << ": " << std::strerror(errno));
+    this->stop();
+    return;
+  }
+
+  std::memcpy(this->data, CAPTURE_MAGIC, MAGIC_SIZE);
+  this->writeOffset = MAGIC_SIZE;
+  if (options.verbosity >= 1) {
+    LOG_INFO("Capturing the received datagrams to " << this->path);
+  }
+}
+
+CaptureWriter::~CaptureWriter() { this->close(); }
+
+void CaptureWriter::close() {
+  // the zero filled rest of the last chunk is cut off, when the gateway is stopped regularly
+  if (0 <= this->fd && 0 != ftruncate(this->fd, static_cast<off_t>(this->writeOffset))) {
+    LOG_WARN("Could not truncate capture file " << this->path << ": " << std::strerror(errno));
+  }
+  this->stop();
+}
+
+void CaptureWriter::record(Packet* const* packets, int count, std::int64_t now) {
+  for (int i = 0; i < count && nullptr != this->data; i++) {
+    const Packet&     packet = *packets[i];
+    const std::size_t size   = recordSize(static_cast<std::size_t>(packet.len));
+    if (!this->reserve(size)) {
+      LOG_WARN("Capture file " << this->path << " is full (CaptureMaxSize), stopped capturing");
+      this->stop();
+      return;
+    }
+
+    CaptureRecord record{};
+    record.timestamp  = 0 != packet.arrival ? packet.arrival : now;
+    record.sourcePort = IpAddress::portOf(packet.source);
+    record.port       = static_cast<std::uint16_t>(this->options.routes[packet.route].port);
+    record.length     = static_cast<std::uint32_t>(packet.len);
+    std::memcpy(record.source, IpAddress::of(packet.source).data(), sizeof(record.source));
+
+    // the padding is zero already, as the file is written only once, and the timestamp goes last, so the record
+    // stays the end marker until it is complete
+    constexpr std::size_t STAMP_SIZE = sizeof(record.timestamp);
+    char*                 out        = this->data + this->writeOffset;
+    std::memcpy(out + HEADER_SIZE, packet.data, static_cast<std::size_t>(packet.len));
+    std::memcpy(out + STAMP_SIZE, reinterpret_cast<const char*>(&record) + STAMP_SIZE, HEADER_SIZE - STAMP_SIZE);
+    std::atomic_thread_fence(std::memory_order_release);
+    std::memcpy(out, &record.timestamp, STAMP_SIZE);
+    this->writeOffset += size;
+  }
+}
+
+bool CaptureWriter::reserve(std::size_t size) {
+  // one more header is kept free for the end marker
+  std::size_t end = this->writeOffset + size + HEADER_SIZE;
+  if (end <= this->allocated) {
+    return true;
+  }
+  if (end > this->maxSize) {
+    return false;
+  }
+
+  // without allocated blocks, writing to the mapping would end with SIGBUS, when the disk is full
+  std::size_t next = std::min(this->maxSize, std::max(end, this->allocated + CAPTURE_CHUNK_SIZE));
+  int         rc   = posix_fallocate(this->fd, static_cast<off_t>(this->allocated),
+                                     static_cast<off_t>(next - this->allocated));
+  if (0 != rc) {
+    errno = rc;
+    return false;
+  }
+  this->allocated = next;
+  return true;
+}
+
+void CaptureWriter::stop() {
+  if (nullptr != this->data) {
+    munmap(this->data, this->maxSize);
+    this->data = nullptr;
+  }
+  if (0 <= this->fd) {
+    ::close(this->fd);
+    this->fd = -1;
+  }
+}
+
+CaptureReader::~CaptureReader() {
+  if (nullptr != this->data) {
+    munmap(this->data, this->size);
+  }
+}
+
+bool CaptureReader::open(const std::string& path) {
+  int         fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  struct stat info {};
+  if (0 > fd || 0 > fstat(fd, &info)) {
+    LOG_ERROR("Could not open capture file " << path << ": " << std::strerror(errno));
+    if (0 <= fd) {
+      close(fd);
+    }
+    return false;
+  }
+
+  this->size = static_cast<std::size_t>(info.st_size);
+  if (this->size >= MAGIC_SIZE) {
+    void* mapping = mmap(nullptr, this->size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (MAP_FAILED != mapping) {
+      this->data = static_cast<char*>(mapping);
+      madvise(this->data, this->size, MADV_SEQUENTIAL);
+    }
+  }
+  close(fd);
+
+  if (nullptr == this->data || 0 != std::memcmp(this->data, CAPTURE_MAGIC, MAGIC_SIZE)) {
+    LOG_ERROR(path << " is no capture file of this version");
+    return false;
+  }
+  this->readOffset = MAGIC_SIZE;
+  return true;
+}
+
+bool CaptureReader::next(const CaptureRecord*& record, const char*& payload) {
+  if (this->readOffset + HEADER_SIZE > this->size) {
+    return false;
+  }
+
+  // the records are aligned to 8 bytes in the mapping, so the header can be used in place
+  const auto* header = reinterpret_cast<const CaptureRecord*>(this->data + this->readOffset);  // NOLINT
+  std::size_t length = recordSize(header->length);
+  if (0 == header->timestamp || this->readOffset + length > this->size) {
+    return false;
+  }
+
+  record  = header;
+  payload = this->data + this->readOffset + HEADER_SIZE;
+  this->readOffset += length;
+  return true;
+}
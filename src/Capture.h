@@ -0,0 +1,127 @@
+/**
+ * @file      Capture.h
+ * @brief     Recording of the received datagrams to a capture file and reading them for a replay
+ *
+ * @copyright (c) consider it GmbH, 2020
+ */
+
+#ifndef _CAPTURE_H
+#define _CAPTURE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include "AppOptions.h"
+#include "Packet.h"
+
+/**
+ * @brief Header of a datagram in a capture file, it is followed by the payload, padded to 8 bytes
+ *
+ * The file starts with CAPTURE_MAGIC and the records follow back to back. A record with a zero
+ * timestamp marks the end, the file is zero-filled in front of the writer, so a capture is
+ * readable up to the last complete record, even if the gateway was killed.
+ */
+struct CaptureRecord {
+  std::int64_t  timestamp;   // arrival, ns since the Unix epoch
+  std::uint8_t  source[16];  // NOLINT(modernize-avoid-c-arrays) IPv6 form of the sender, see IpAddress
+  std::uint16_t sourcePort;  // of the sender
+  std::uint16_t port;        // UDP port of the route, which received the datagram
+  std::uint32_t length;      // of the payload
+};
+
+/**
+ * @brief Appends the received datagrams of a worker to a memory mapped capture file (CaptureFile)
+ *
+ * The file is mapped up to CaptureMaxSize bytes at once and its blocks are allocated a chunk at a
+ * time, so recording a batch only copies the datagrams into the mapping and takes a system call
+ * every few megabytes. The kernel writes the pages back in the background. When the file is full,
+ * the recording stops.
+ *
+ * A writer is not thread-safe, it is meant to be used by the receiver thread only.
+ */
+class CaptureWriter {
+public:
+  /**
+   * @param options Application configuration (CaptureFile, CaptureMaxSize, the routes)
+   * @param worker  Number of the worker, with several workers, each one gets its own file (CaptureFile.N)
+   */
+  CaptureWriter(const AppOptions& options, int worker);
+
+  CaptureWriter(const CaptureWriter&) = delete;
+  CaptureWriter& operator=(const CaptureWriter&) = delete;
+  CaptureWriter(CaptureWriter&&)                 = delete;
+  CaptureWriter& operator=(CaptureWriter&&) = delete;
+  ~CaptureWriter();
+
+  /**
+   * @brief Returns True, while datagrams are recorded
+   */
+  bool enabled() const { return nullptr != this->data; }
+
+  /**
+   * @brief Append a batch of received packets
+   *
+   * @param now   Wall clock time, ns since the Unix epoch, for packets without a kernel arrival time
+   */
+  void record(Packet* const* packets, int count, std::int64_t now);
+
+  /**
+   * @brief Stop the recording and cut off the unused rest of the file
+   */
+  void close();
+
+private:
+  const AppOptions& options;
+  const std::string path;
+  const std::size_t maxSize;
+
+  int         fd{-1};
+  char*       data{nullptr};  // mapping of maxSize bytes
+  std::size_t allocated{0};   // bytes of the file, which have blocks
+  std::size_t writeOffset{0};
+
+  /**
+   * @brief Allocate the blocks for the next bytes of the file
+   *
+   * @return    Returns False, if the file is full or the disk has no space left, the recording stops then
+   */
+  bool reserve(std::size_t size);
+
+  void stop();
+};
+
+/**
+ * @brief Reads the datagrams of a capture file in order, for a replay
+ */
+class CaptureReader {
+public:
+  CaptureReader() = default;
+
+  CaptureReader(const CaptureReader&) = delete;
+  CaptureReader& operator=(const CaptureReader&) = delete;
+  CaptureReader(CaptureReader&&)                 = delete;
+  CaptureReader& operator=(CaptureReader&&) = delete;
+  ~CaptureReader();
+
+  /**
+   * @brief Map a capture file
+   *
+   * @return    Returns False, if it could not be opened or is no capture file (which was already reported)
+   */
+  bool open(const std::string& path);
+
+  /**
+   * @brief Take the next datagram, the pointers are valid as long as the reader
+   *
+   * @return    Returns False at the end of the capture
+   */
+  bool next(const CaptureRecord*& record, const char*& payload);
+
+private:
+  char*       data{nullptr};
+  std::size_t size{0};
+  std::size_t readOffset{0};
+};
+
+#endif /* _CAPTURE_H */
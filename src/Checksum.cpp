@@ -0,0 +1,125 @@
+/**
+ * @file      Checksum.cpp
+ * @brief     CRC-32 checksums of payloads, to validate the received datagrams
+ *
+ * @copyright (c) consider it GmbH, 2020
+ */
+
+#include "Checksum.h"
+
+#include <array>
+#include <cstring>
+
+#if defined(__x86_64__)
+#include <nmmintrin.h>
+#elif defined(__aarch64__) && defined(__ARM_FEATURE_CRC32)
+#include <arm_acle.h>
+#endif
+
+// static configuration values
+#define CRC32_POLYNOMIAL 0xEDB88320U   // reflected
+#define CRC32C_POLYNOMIAL 0x82F63B78U  // reflected
+
+namespace {
+
+/**
+ * @brief Tables for slicing-by-8, [k][i] is the CRC of the byte i followed by k zero bytes
+ */
+class SliceTables {
+public:
+  explicit SliceTables(std::uint32_t polynomial) {
+    for (std::uint32_t i = 0; i < 256; i++) {
+      std::uint32_t crc = i;
+      for (int bit = 0; bit < 8; bit++) {
+        crc = (crc >> 1U) ^ ((crc & 1U) * polynomial);
+      }
+      this->table[0][i] = crc;
+    }
+    for (std::size_t k = 1; k < this->table.size(); k++) {
+      for (std::size_t i = 0; i < 256; i++) {
+        std::uint32_t previous = this->table[k - 1][i];
+        this->table[k][i]      = (previous >> 8U) ^ this->table[0][previous & 0xFFU];
+      }
+    }
+  }
+
+  std::uint32_t crc(const unsigned char* input, std::size_t len) const {
+    const auto&   t   = this->table;
+    std::uint32_t crc = 0xFFFFFFFFU;
+    while (len >= 8) {
+      std::uint32_t one = crc ^ read32(input);
+      std::uint32_t two = read32(input + 4);
+      crc = t[7][one & 0xFFU] ^ t[6][(one >> 8U) & 0xFFU] ^ t[5][(one >> 16U) & 0xFFU] ^ t[4][one >> 24U] ^
+            t[3][two & 0xFFU] ^ t[2][(two >> 8U) & 0xFFU] ^ t[1][(two >> 16U) & 0xFFU] ^ t[0][two >> 24U];
+      input += 8;
+      len -= 8;
+    }
+    while (0 != len--) {
+      crc = t[0][(crc ^ *input++) & 0xFFU] ^ (crc >> 8U);
+    }
+    return ~crc;
+  }
+
+private:
+  std::array<std::array<std::uint32_t, 256>, 8> table{};
+
+  // little endian, independent of the host, as the reflected CRC consumes the bytes in this order
+  static std::uint32_t read32(const unsigned char* p) {
+    return static_cast<std::uint32_t>(p[0]) | static_cast<std::uint32_t>(p[1]) << 8U |
+           static_cast<std::uint32_t>(p[2]) << 16U | static_cast<std::uint32_t>(p[3]) << 24U;
+  }
+};
+
+#if defined(__x86_64__)
+__attribute__((target("sse4.2"))) std::uint32_t castagnoliSse42(const unsigned char* input, std::size_t len) {
+  std::uint64_t crc = 0xFFFFFFFFU;
+  while (len >= 8) {
+    std::uint64_t word{0};
+    std::memcpy(&word, input, sizeof(word));
+    crc = _mm_crc32_u64(crc, word);
+    input += 8;
+    len -= 8;
+  }
+  auto crc32 = static_cast<std::uint32_t>(crc);
+  while (0 != len--) {
+    crc32 = _mm_crc32_u8(crc32, *input++);
+  }
+  return ~crc32;
+}
+#elif defined(__aarch64__) && defined(__ARM_FEATURE_CRC32)
+std::uint32_t castagnoliArm(const unsigned char* input, std::size_t len) {
+  std::uint32_t crc = 0xFFFFFFFFU;
+  while (len >= 8) {
+    std::uint64_t word{0};
+    std::memcpy(&word, input, sizeof(word));
+    crc = __crc32cd(crc, word);
+    input += 8;
+    len -= 8;
+  }
+  while (0 != len--) {
+    crc = __crc32cb(crc, *input++);
+  }
+  return ~crc;
+}
+#endif
+
+}  // namespace
+
+std::uint32_t Crc32::ieee(const void* data, std::size_t len) {
+  static const SliceTables tables(CRC32_POLYNOMIAL);
+  return tables.crc(static_cast<const unsigned char*>(data), len);
+}
+
+std::uint32_t Crc32::castagnoli(const void* data, std::size_t len) {
+  const auto* input = static_cast<const unsigned char*>(data);
+#if defined(__x86_64__)
+  static const bool sse42 = __builtin_cpu_supports("sse4.2");
+  if (sse42) {
+    return castagnoliSse42(input, len);
+  }
+#elif defined(__aarch64__) && defined(__ARM_FEATURE_CRC32)
+  return castagnoliArm(input, len);
+#endif
+  static const SliceTables tables(CRC32C_POLYNOMIAL);
+  return tables.crc(input, len);
+}
@@ -0,0 +1,27 @@
+/**
+ * @file      Checksum.h
+ * @brief     CRC-32 checksums of payloads, to validate the received datagrams
+ *
+ * @copyright (c) consider it GmbH, 2020
+ */
+
+#ifndef _CHECKSUM_H
+#define _CHECKSUM_H
+
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * @brief CRC-32 (IEEE 802.3, zlib) and CRC-32C (Castagnoli, iSCSI, SCTP)
+ *
+ * CRC-32C uses the crc32 instruction of SSE 4.2 (checked at runtime) or of ARMv8 (if the
+ * compiler targets it), which takes 8 bytes per instruction. CRC-32 and the fallback of
+ * CRC-32C use slicing-by-8 tables, which take 8 bytes per iteration in software.
+ */
+class Crc32 {
+public:
+  static std::uint32_t ieee(const void* data, std::size_t len);
+  static std::uint32_t castagnoli(const void* data, std::size_t len);
+};
+
+#endif /* _CHECKSUM_H */
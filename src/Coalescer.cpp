@@ -0,0 +1,124 @@
+/**
+ * @file      Coalescer.cpp
+ * @brief     Aggregation of multiple datagrams into one MQTT message
+ *
+ * @copyright (c) consider it GmbH, 2020
+ */
+
+#include "Coalescer.h"
+
+#include <algorithm>
+
+#include "Log.h"
+
+// static configuration values
+#define COALESCE_MAX_TOPICS 64  // keep the batch buffers of up to this many topics for reuse
+#define FRAME_HEADER_SIZE 2
+
+Coalescer::Coalescer(const AppOptions& options, Outbox& outbox) :
+    options{options},
+    outbox{outbox},
+    maxMessages{options.coalesceMaxMessages},
+    maxBytes{static_cast<std::size_t>(options.coalesceMaxBytes)},
+    linger{std::chrono::milliseconds(options.coalesceLinger)} {}
+
+void Coalescer::add(const std::string& topic, const char* payload, int payloadLen, Compression compression,
+                    Clock::time_point received, std::int64_t arrival, int qos, Clock::time_point now) {
+  auto found = this->batches.find(topic);
+  if (this->batches.end() == found) {
+    found = this->batches.emplace(topic, Batch{}).first;
+    found->second.buffer.reserve(this->maxBytes);
+  }
+  Batch& batch = found->second;
+
+  // a single datagram larger than the limit is published on its own
+  std::size_t frameSize = FRAME_HEADER_SIZE + static_cast<std::size_t>(payloadLen);
+  if (0 != batch.count && batch.buffer.size() + frameSize > this->maxBytes) {
+    this->flush(found->first, batch);
+  }
+
+  if (0 == batch.count) {
+    batch.opened        = now;
+    batch.firstReceived = received;
+    batch.firstArrival  = arrival;
+    batch.compression   = compression;
+    batch.qos           = qos;
+    if (now + this->linger < this->nextDeadline) {
+      this->nextDeadline = now + this->linger;
+    }
+  }
+  batch.qos = std::max(batch.qos, qos);
+  batch.buffer.push_back(static_cast<char>((static_cast<unsigned>(payloadLen) >> 8U) & 0xFFU));
+  batch.buffer.push_back(static_cast<char>(static_cast<unsigned>(payloadLen) & 0xFFU));
+  batch.buffer.append(payload, payloadLen);
+  batch.count++;
+
+  if (batch.count >= this->maxMessages || batch.buffer.size() >= this->maxBytes) {
+    this->flush(found->first, batch);
+    this->updateDeadline();
+  }
+}
+
+void Coalescer::flushExpired(Clock::time_point now) {
+  if (now < this->nextDeadline) {
+    return;
+  }
+
+  for (auto it = this->batches.begin(); it != this->batches.end();) {
+    if (0 != it->second.count && now >= it->second.opened + this->linger) {
+      this->flush(it->first, it->second);
+    }
+
+    // do not keep the buffers of rarely used topics forever
+    if (0 == it->second.count && this->batches.size() > COALESCE_MAX_TOPICS) {
+      it = this->batches.erase(it);
+    } else {
+      ++it;
+    }
+  }
+  this->updateDeadline();
+}
+
+void Coalescer::flushAll() {
+  for (auto& entry : this->batches) {
+    if (0 != entry.second.count) {
+      this->flush(entry.first, entry.second);
+    }
+  }
+  this->nextDeadline = Clock::time_point::max();
+}
+
+std::chrono::milliseconds Coalescer::timeUntilFlush(Clock::time_point now, std::chrono::milliseconds fallback) const {
+  if (Clock::time_point::max() == this->nextDeadline) {
+    return fallback;
+  }
+  if (now >= this->nextDeadline) {
+    return std::chrono::milliseconds(0);
+  }
+
+  // round up, so the deadline has passed after waking up
+  auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(this->nextDeadline - now) +
+                   std::chrono::milliseconds(1);
+  return std::min(remaining, fallback);
+}
+
+void Coalescer::flush(const std::string& topic, Batch& batch) {
+  bool published =
+      this->outbox.send(topic, batch.buffer.data(), static_cast<int>(batch.buffer.size()), batch.compression,
+                        batch.firstReceived, batch.firstArrival, batch.qos);
+  if (published && this->options.verbosity >= 2) {
+    LOG_DEBUG("Successfully published " << batch.count << " coalesced message(s) to MQTT");
+  }
+
+  batch.buffer.clear();
+  batch.count = 0;
+}
+
+void Coalescer::updateDeadline() {
+  this->nextDeadline = Clock::time_point::max();
+  for (const auto& entry : this->batches) {
+    if (0 != entry.second.count && entry.second.opened + this->linger < this->nextDeadline) {
+      this->nextDeadline = entry.second.opened + this->linger;
+    }
+  }
+}
@@ -0,0 +1,97 @@
+/**
+ * @file      Coalescer.h
+ * @brief     Aggregation of multiple datagrams into one MQTT message
+ *
+ * @copyright (c) consider it GmbH, 2020
+ */
+
+#ifndef _COALESCER_H
+#define _COALESCER_H
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+
+#include "AppOptions.h"
+#include "Outbox.h"
+
+/**
+ * @brief Packs the payloads of several datagrams for the same topic into one MQTT message
+ *
+ * Every payload is prefixed with its length as 16 bit unsigned integer in network byte order
+ * (big endian), UDP payloads can not be larger anyway. A message is published, when it holds
+ * the maximum number of datagrams, when the next datagram would exceed the maximum size or
+ * when its first datagram has waited for the linger time.
+ *
+ * A coalescer is not thread-safe, it is meant to be used by the publisher thread only.
+ */
+class Coalescer {
+public:
+  using Clock = std::chrono::steady_clock;
+
+  Coalescer(const AppOptions& options, Outbox& outbox);
+
+  Coalescer(const Coalescer&) = delete;
+  Coalescer& operator=(const Coalescer&) = delete;
+  Coalescer(Coalescer&&)                 = delete;
+  Coalescer& operator=(Coalescer&&) = delete;
+  ~Coalescer()                      = default;
+
+  /**
+   * @brief Returns True, if datagrams should be coalesced at all (CoalesceMaxMessages > 1)
+   */
+  bool enabled() const { return this->maxMessages > 1; }
+
+  /**
+   * @brief Append a payload to the pending message of the topic, publishes full messages
+   *
+   * @param compression  Compression of the route, the first datagram of a message decides
+   * @param received     Reception time of the datagram, the latency of a message is the one of its first datagram
+   * @param arrival      Kernel arrival time of the datagram, see MqttPublisher::publish()
+   * @param qos          QoS level of the datagram, a message is published with the highest one of its datagrams
+   */
+  void add(const std::string& topic, const char* payload, int payloadLen, Compression compression,
+           Clock::time_point received, std::int64_t arrival, int qos, Clock::time_point now);
+
+  /**
+   * @brief Publish all pending messages, whose linger time has expired
+   */
+  void flushExpired(Clock::time_point now);
+
+  /**
+   * @brief Publish all pending messages
+   */
+  void flushAll();
+
+  /**
+   * @brief Time until the next pending message has to be published, or the fallback if none is pending
+   */
+  std::chrono::milliseconds timeUntilFlush(Clock::time_point now, std::chrono::milliseconds fallback) const;
+
+private:
+  struct Batch {
+    std::string       buffer{};
+    int               count{0};
+    Clock::time_point opened{};
+    Clock::time_point firstReceived{};
+    std::int64_t      firstArrival{0};
+    Compression       compression{Compression::None};
+    int               qos{0};
+  };
+
+  const AppOptions&     options;
+  Outbox&               outbox;
+  const int             maxMessages;
+  const std::size_t     maxBytes;
+  const Clock::duration linger;
+  Clock::time_point     nextDeadline{Clock::time_point::max()};  // of the oldest pending message
+
+  std::unordered_map<std::string, Batch> batches;  // pending messages by topic
+
+  void flush(const std::string& topic, Batch& batch);
+  void updateDeadline();
+};
+
+#endif /* _COALESCER_H */
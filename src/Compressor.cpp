@@ -0,0 +1,137 @@
+/**
+ * @file      Compressor.cpp
+ * @brief     Compression of MQTT payloads with LZ4 or Zstandard
+ *
+ * @copyright (c) consider it GmbH, 2020
+ */
+
+#include "Compressor.h"
+
+#include "Log.h"
+
+Compressor::Compressor(const AppOptions& options) : level{options.compressionLevel} {
+#ifdef UDPMQTTGW_LZ4
+  std::size_t rc = LZ4F_createCompressionContext(&this->lz4, LZ4F_VERSION);
+  if (0 != LZ4F_isError(rc)) {
+    LOG_ERROR("Could not create LZ4 compression context: " << LZ4F_getErrorName(rc));
+    this->lz4 = nullptr;
+  }
+#endif
+#ifdef UDPMQTTGW_ZSTD
+  this->zstd = ZSTD_createCCtx();
+  if (!options.compressionDictionaryData.empty()) {
+    this->dictionary = ZSTD_createCDict(options.compressionDictionaryData.data(),
+                                        options.compressionDictionaryData.size(), this->level);
+    if (nullptr == this->dictionary) {
+      // without the dictionary, the consumers could not decompress the payloads
+      LOG_ERROR("Could not load CompressionDictionary " << options.compressionDictionary);
+      ZSTD_freeCCtx(this->zstd);
+      this->zstd = nullptr;
+    }
+  }
+#endif
+}
+
+Compressor::~Compressor() {
+#ifdef UDPMQTTGW_LZ4
+  LZ4F_freeCompressionContext(this->lz4);
+#endif
+#ifdef UDPMQTTGW_ZSTD
+  ZSTD_freeCDict(this->dictionary);
+  ZSTD_freeCCtx(this->zstd);
+#endif
+}
+
+bool Compressor::compress(Compression algorithm, const char* payload, int payloadLen, const char*& compressed,
+                          int& compressedLen) {
+  bool success{false};
+  switch (algorithm) {
+  case Compression::None:
+    break;
+  case Compression::Lz4:
+    success = this->compressLz4(payload, payloadLen, compressedLen);
+    break;
+  case Compression::Zstd:
+    success = this->compressZstd(payload, payloadLen, compressedLen);
+    break;
+  }
+
+  compressed = this->buffer.data();
+  return success;
+}
+
+bool Compressor::compressLz4(const char* payload, int payloadLen, int& compressedLen) {
+#ifdef UDPMQTTGW_LZ4
+  if (nullptr == this->lz4) {
+    return false;
+  }
+
+  // the content size in the header lets the consumer allocate the output at once
+  LZ4F_preferences_t preferences{};
+  preferences.frameInfo.contentSize = static_cast<unsigned long long>(payloadLen);  // NOLINT(google-runtime-int)
+  preferences.compressionLevel      = this->level;
+
+  const auto  srcSize = static_cast<std::size_t>(payloadLen);
+  std::size_t bound   = LZ4F_compressFrameBound(srcSize, &preferences);
+  if (this->buffer.size() < bound) {
+    this->buffer.resize(bound);
+  }
+
+  // the streaming functions reuse the context, unlike LZ4F_compressFrame()
+  std::size_t length = LZ4F_compressBegin(this->lz4, this->buffer.data(), this->buffer.size(), &preferences);
+  if (0 == LZ4F_isError(length)) {
+    std::size_t rc = LZ4F_compressUpdate(this->lz4, this->buffer.data() + length, this->buffer.size() - length,
+                                         payload, srcSize, nullptr);
+    length         = (0 == LZ4F_isError(rc)) ? length + rc : rc;
+  }
+  if (0 == LZ4F_isError(length)) {
+    std::size_t rc =
+        LZ4F_compressEnd(this->lz4, this->buffer.data() + length, this->buffer.size() - length, nullptr);
+    length = (0 == LZ4F_isError(rc)) ? length + rc : rc;
+  }
+  if (0 != LZ4F_isError(length)) {
+    LOG_ERROR("LZ4 compression failed: " << LZ4F_getErrorName(length));
+    return false;
+  }
+
+  compressedLen = static_cast<int>(length);
+  return true;
+#else
+  (void)payload;
+  (void)payloadLen;
+  (void)compressedLen;
+  return false;
+#endif
+}
+
+bool Compressor::compressZstd(const char* payload, int payloadLen, int& compressedLen) {
+#ifdef UDPMQTTGW_ZSTD
+  if (nullptr == this->zstd) {
+    return false;
+  }
+
+  const auto  srcSize = static_cast<std::size_t>(payloadLen);
+  std::size_t bound   = ZSTD_compressBound(srcSize);
+  if (this->buffer.size() < bound) {
+    this->buffer.resize(bound);
+  }
+
+  std::size_t length =
+      (nullptr != this->dictionary)
+          ? ZSTD_compress_usingCDict(this->zstd, this->buffer.data(), this->buffer.size(), payload, srcSize,
+                                     this->dictionary)
+          : ZSTD_compressCCtx(this->zstd, this->buffer.data(), this->buffer.size(), payload, srcSize, this->level);
+  if (0 != ZSTD_isError(length)) {
+    LOG_ERROR("Zstd compression failed: " << ZSTD_getErrorName(length));
+    return false;
+  }
+
+  compressedLen = static_cast<int>(length);
+  return true;
+#else
+  (void)payload;
+  (void)payloadLen;
+  (void)compressedLen;
+  return false;
+#endif
+}
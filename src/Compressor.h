@@ -0,0 +1,68 @@
+/**
+ * @file      Compressor.h
+ * @brief     Compression of MQTT payloads with LZ4 or Zstandard
+ *
+ * @copyright (c) consider it GmbH, 2020
+ */
+
+#ifndef _COMPRESSOR_H
+#define _COMPRESSOR_H
+
+#include <vector>
+
+#include "AppOptions.h"
+
+#ifdef UDPMQTTGW_LZ4
+#include <lz4frame.h>
+#endif
+#ifdef UDPMQTTGW_ZSTD
+#include <zstd.h>
+#endif
+
+/**
+ * @brief Compresses payloads into a reused output buffer
+ *
+ * The compression contexts (and the digested zstd dictionary) are created once and reused for
+ * every message, so only the actual compression costs time per message. Each payload becomes
+ * a complete frame of the standard format, so it can be decompressed on its own by any LZ4 or
+ * zstd implementation (with the same dictionary for zstd).
+ *
+ * A compressor is not thread-safe, it is meant to be used by the publisher thread only.
+ */
+class Compressor {
+public:
+  explicit Compressor(const AppOptions& options);
+
+  Compressor(const Compressor&) = delete;
+  Compressor& operator=(const Compressor&) = delete;
+  Compressor(Compressor&&)                 = delete;
+  Compressor& operator=(Compressor&&) = delete;
+  ~Compressor();
+
+  /**
+   * @brief Compress a payload
+   *
+   * @param compressed     Set to the compressed payload, valid until the next call
+   * @param compressedLen  Set to the length of the compressed payload
+   * @return               Returns False, if the payload could not be compressed
+   */
+  bool compress(Compression algorithm, const char* payload, int payloadLen, const char*& compressed,
+                int& compressedLen);
+
+private:
+  const int         level;
+  std::vector<char> buffer;
+
+#ifdef UDPMQTTGW_LZ4
+  LZ4F_cctx* lz4{nullptr};
+#endif
+#ifdef UDPMQTTGW_ZSTD
+  ZSTD_CCtx*  zstd{nullptr};
+  ZSTD_CDict* dictionary{nullptr};
+#endif
+
+  bool compressLz4(const char* payload, int payloadLen, int& compressedLen);
+  bool compressZstd(const char* payload, int payloadLen, int& compressedLen);
+};
+
+#endif /* _COMPRESSOR_H */
@@ -0,0 +1,108 @@
+/**
+ * @file      ConfigStore.cpp
+ * @brief     Current configuration snapshot, which is replaced when the configuration is reloaded
+ *
+ * @copyright (c) consider it GmbH, 2020
+ */
+
+#include "ConfigStore.h"
+
+#include <stdexcept>
+
+#include "Log.h"
+
+namespace {
+
+bool sameConnection(const AppOptions& a, const AppOptions& b) {
+  return a.mqttUrl == b.mqttUrl && a.mqttClientID == b.mqttClientID && a.mqttUsername == b.mqttUsername &&
+         a.mqttPassword == b.mqttPassword && a.mqttVersion == b.mqttVersion &&
+         a.mqttKeepAliveInterval == b.mqttKeepAliveInterval && a.mqttConnectionTimeout == b.mqttConnectionTimeout &&
+         a.mqttMaxInflight == b.mqttMaxInflight && a.mqttTcpNoDelay == b.mqttTcpNoDelay &&
+         a.mqttTopicAliases == b.mqttTopicAliases && a.mqttConnections == b.mqttConnections &&
+         a.mqttShardKey == b.mqttShardKey && a.mqttTargets == b.mqttTargets && a.mqttTargetMode == b.mqttTargetMode &&
+         a.mqttSslEnableServerCertAuth == b.mqttSslEnableServerCertAuth && a.mqttSslVersion == b.mqttSslVersion &&
+         a.mqttSslVerify == b.mqttSslVerify && a.mqttSslTrustStore == b.mqttSslTrustStore &&
+         a.mqttSslKeyStore == b.mqttSslKeyStore && a.mqttSslPrivateKey == b.mqttSslPrivateKey &&
+         a.mqttSslPrivateKeyPasswd == b.mqttSslPrivateKeyPasswd;
+}
+
+bool sameSockets(const AppOptions& a, const AppOptions& b) {
+  return a.workers == b.workers && a.udpBindAddress == b.udpBindAddress && a.udpInterface == b.udpInterface &&
+         a.udpMulticastGroups == b.udpMulticastGroups && a.udpMaxDatagramSize == b.udpMaxDatagramSize &&
+         a.udpReceiveBufferSize == b.udpReceiveBufferSize && a.udpBusyPoll == b.udpBusyPoll &&
+         a.udpIoUring == b.udpIoUring && a.latencyProbe == b.latencyProbe && a.captureFile == b.captureFile &&
+         a.captureMaxSize == b.captureMaxSize;
+}
+
+}  // namespace
+
+ConfigStore::ConfigStore(const AppOptions& cliOptions, const AppOptions& options) :
+    cliOptions{cliOptions},
+    snapshot{std::make_shared<const AppOptions>(options)} {}
+
+std::shared_ptr<const AppOptions> ConfigStore::current() const {
+  std::lock_guard<std::mutex> lock(this->mutex);
+  return this->snapshot;
+}
+
+bool ConfigStore::reload() {
+  AppOptions parsed(this->cliOptions);
+  try {
+    if (!parsed.parseConfFile()) {
+      LOG_ERROR("Not reloading, because of invalid configuration");
+      return false;
+    }
+  } catch (const std::exception& e) {
+    LOG_ERROR("Not reloading, because of an error parsing configuration: " << e.what());
+    return false;
+  }
+
+  // the new snapshot is a copy of the running one, with the reloadable parameters replaced
+  std::shared_ptr<const AppOptions> running = this->current();
+  auto                              next    = std::make_shared<AppOptions>(*running);
+
+  bool portsChanged = parsed.routes.size() != running->routes.size();
+  for (auto& route : next->routes) {
+    bool routeFound{false};
+    for (const auto& parsedRoute : parsed.routes) {
+      if (parsedRoute.port == route.port) {
+        route.topic       = parsedRoute.topic;
+        route.compression = parsedRoute.compression;
+        route.qos         = parsedRoute.qos;
+        route.priority    = parsedRoute.priority;
+        routeFound        = true;
+      }
+    }
+    portsChanged = portsChanged || !routeFound;
+  }
+  if (portsChanged) {
+    LOG_ERROR("Not reloading, because the UDP ports of the routes changed, this needs a restart");
+    return false;
+  }
+
+  next->topicRules      = parsed.topicRules;
+  next->payloadFilters  = parsed.payloadFilters;
+  next->sourceRateLimit = parsed.sourceRateLimit;
+  next->sourceRateBurst = parsed.sourceRateBurst;
+  next->shutdownTimeout = parsed.shutdownTimeout;
+
+  if (!sameConnection(*running, parsed)) {
+    LOG_WARN("The MQTT connection parameters changed, they take effect after a restart");
+  }
+  if (!sameSockets(*running, parsed)) {
+    LOG_WARN("The UDP socket parameters or the workers changed, they take effect after a restart");
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    this->snapshot = next;
+  }
+  this->snapshotGeneration.fetch_add(1, std::memory_order_release);
+
+  LOG_INFO("Reloaded configuration: " << next->routes.size() << " route(s), " << next->topicRules.size()
+           << " topic rule(s), " << next->payloadFilters.size() << " payload filter(s)");
+  if (next->verbosity >= 1) {
+    next->printConfig();
+  }
+  return true;
+}
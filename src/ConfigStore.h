@@ -0,0 +1,73 @@
+/**
+ * @file      ConfigStore.h
+ * @brief     Current configuration snapshot, which is replaced when the configuration is reloaded
+ *
+ * @copyright (c) consider it GmbH, 2020
+ */
+
+#ifndef _CONFIGSTORE_H
+#define _CONFIGSTORE_H
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+
+#include "AppOptions.h"
+
+/**
+ * @brief Holds the immutable snapshot of the configuration, which the pipelines work with
+ *
+ * A reload parses the configuration file again and publishes a new snapshot, the old one is
+ * not modified. The threads poll generation(), which is one atomic load, and only take the
+ * new snapshot with current() when it changed. The old snapshot lives on, until the last
+ * thread let go of it (like RCU).
+ *
+ * Only the routing and the limits are taken from the reloaded file (topics of the routes,
+ * TopicRule, RouteCompression/ Compression, SourceRateLimit, SourceRateBurst). Everything else
+ * belongs to the sockets, the MQTT connection or the buffers, which are kept, so a reload
+ * neither loses datagrams nor reconnects. Changes of these parameters are reported and take
+ * effect after a restart.
+ *
+ * The set of UDP ports has to stay the same, because the routes are indexed like the sockets.
+ */
+class ConfigStore {
+public:
+  /**
+   * @param cliOptions  Options with only the CLI arguments parsed, the base of every reload
+   * @param options     Running configuration
+   */
+  ConfigStore(const AppOptions& cliOptions, const AppOptions& options);
+
+  ConfigStore(const ConfigStore&) = delete;
+  ConfigStore& operator=(const ConfigStore&) = delete;
+  ConfigStore(ConfigStore&&)                 = delete;
+  ConfigStore& operator=(ConfigStore&&) = delete;
+  ~ConfigStore()                        = default;
+
+  /**
+   * @brief Counter of the published snapshots, changes with every successful reload
+   */
+  std::uint64_t generation() const { return this->snapshotGeneration.load(std::memory_order_acquire); }
+
+  /**
+   * @brief Returns the latest snapshot
+   */
+  std::shared_ptr<const AppOptions> current() const;
+
+  /**
+   * @brief Parse the configuration file again and publish the new snapshot
+   *
+   * @return    Returns False, if the file is invalid or changes the UDP ports, the running configuration is kept then
+   */
+  bool reload();
+
+private:
+  const AppOptions cliOptions;
+
+  mutable std::mutex                mutex;
+  std::shared_ptr<const AppOptions> snapshot;
+  std::atomic<std::uint64_t>        snapshotGeneration{0};
+};
+
+#endif /* _CONFIGSTORE_H */
@@ -0,0 +1,81 @@
+/**
+ * @file      Deduplicator.cpp
+ * @brief     Detection of redundant copies of received datagrams
+ *
+ * @copyright (c) consider it GmbH, 2020
+ */
+
+#include "Deduplicator.h"
+
+#include "Hash.h"
+
+// static configuration values
+#define PROBE_LIMIT 8                          // slots checked per lookup
+#define STAMP_BITS 24U                         // milliseconds, wraps around after 4.6 hours
+#define STAMP_MASK ((1ULL << STAMP_BITS) - 1)
+#define REORDER_TOLERANCE 1000ULL              // milliseconds, another worker may have stamped a later copy first
+#define LOAD_FACTOR 2                          // slots per DedupCapacity entry
+
+namespace {
+
+std::size_t tableSize(const AppOptions& options) {
+  if (0 == options.dedupWindow) {
+    return 1;
+  }
+
+  std::size_t size{1};
+  while (size < static_cast<std::size_t>(options.dedupCapacity) * LOAD_FACTOR) {
+    size <<= 1U;
+  }
+  return size;
+}
+
+}  // namespace
+
+Deduplicator::Deduplicator(const AppOptions& options) :
+    window{static_cast<std::uint64_t>(options.dedupWindow)},
+    mask{tableSize(options) - 1},
+    slots(mask + 1) {}
+
+bool Deduplicator::duplicate(std::size_t route, const char* payload, int payloadLen, Clock::time_point received) {
+  // the low bits of the hash select the slots, the high bits are stored as tag
+  const std::uint64_t hash = Xxh64::hash(payload, static_cast<std::size_t>(payloadLen), route);
+  std::uint64_t       tag  = hash >> STAMP_BITS;
+  if (0 == tag) {
+    tag = 1;
+  }
+  const auto stamp = static_cast<std::uint64_t>(
+                         std::chrono::duration_cast<std::chrono::milliseconds>(received.time_since_epoch()).count()) &
+                     STAMP_MASK;
+
+  // remember the first free slot, or the oldest one
+  std::atomic<std::uint64_t>* target{nullptr};
+  std::uint64_t               targetValue{0};
+  std::uint64_t               targetAge{0};
+  for (std::size_t probe = 0; probe < PROBE_LIMIT; probe++) {
+    auto&         slot  = this->slots[(hash + probe) & this->mask];
+    std::uint64_t value = slot.load(std::memory_order_relaxed);
+
+    std::uint64_t age = (stamp - value) & STAMP_MASK;
+    if (age > STAMP_MASK - REORDER_TOLERANCE) {
+      age = 0;
+    }
+    bool live = 0 != value && age < this->window;
+    if (live && (value >> STAMP_BITS) == tag) {
+      return true;
+    }
+
+    if (!live) {
+      age = STAMP_MASK + 1;
+    }
+    if (nullptr == target || age > targetAge) {
+      target      = &slot;
+      targetValue = value;
+      targetAge   = age;
+    }
+  }
+
+  // if another thread took the slot in the meantime, this payload is just not remembered
+  target->compare_exchange_strong(targetValue, (tag << STAMP_BITS) | stamp, std::memory_order_relaxed);
+  return false;
+}
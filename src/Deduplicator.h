@@ -0,0 +1,65 @@
+/**
+ * @file      Deduplicator.h
+ * @brief     Detection of redundant copies of received datagrams
+ *
+ * @copyright (c) consider it GmbH, 2020
+ */
+
+#ifndef _DEDUPLICATOR_H
+#define _DEDUPLICATOR_H
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "AppOptions.h"
+
+/**
+ * @brief Time-windowed set of payload hashes, to drop copies received over redundant links
+ *
+ * The set is a fixed-size, open-addressed table, which is allocated at startup. Each slot is a
+ * single 64 bit word of a 40 bit hash tag and a 24 bit millisecond timestamp, so it is updated
+ * with one compare-and-swap and the set can be shared by the receiver threads of all workers.
+ * This matters, because the copies come from different source addresses and the kernel
+ * distributes them to different worker sockets.
+ *
+ * A lookup probes a few neighbouring slots only. Entries older than the window count as free,
+ * and if all probed slots are in use, the oldest one is replaced. An overloaded set therefore
+ * misses duplicates, but never drops a datagram, which was not seen before (apart from hash
+ * collisions of 1 in 2^40).
+ */
+class Deduplicator {
+public:
+  using Clock = std::chrono::steady_clock;
+
+  explicit Deduplicator(const AppOptions& options);
+
+  Deduplicator(const Deduplicator&) = delete;
+  Deduplicator& operator=(const Deduplicator&) = delete;
+  Deduplicator(Deduplicator&&)                 = delete;
+  Deduplicator& operator=(Deduplicator&&) = delete;
+  ~Deduplicator()                         = default;
+
+  /**
+   * @brief Returns True, if deduplication is configured
+   */
+  bool enabled() const { return 0 != this->window; }
+
+  /**
+   * @brief Check, if a payload was seen on this route within the window, and remember it if not
+   *
+   * @param route     Index of the route (socket), which received the packet
+   * @param received  Reception time of the packet
+   * @return          Returns True, if the packet is a duplicate and should be dropped
+   */
+  bool duplicate(std::size_t route, const char* payload, int payloadLen, Clock::time_point received);
+
+private:
+  const std::uint64_t                     window;  // milliseconds, 0: disabled
+  const std::size_t                       mask;    // number of slots - 1
+  std::vector<std::atomic<std::uint64_t>> slots;   // 0: never used
+};
+
+#endif /* _DEDUPLICATOR_H */
@@ -0,0 +1,84 @@
+/**
+ * @file      DeliveryTracker.h
+ * @brief     Measurement of the time until the MQTT library reports a message as delivered
+ *
+ * @copyright (c) consider it GmbH, 2020
+ */
+
+#ifndef _DELIVERYTRACKER_H
+#define _DELIVERYTRACKER_H
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+#include "Stats.h"
+
+/**
+ * @brief Remembers the hand over time of each message by its delivery token
+ *
+ * The slots are indexed by the token, so there must not be more messages in flight than
+ * slots. If the library reports the delivery before sent() was called (or a slot was reused),
+ * the message is counted, but not measured. All methods are lock-free.
+ */
+class DeliveryTracker {
+public:
+  using Clock = std::chrono::steady_clock;
+
+  /**
+   * @param maxInflight Maximum number of messages in flight, the slots are rounded up to a power of two
+   * @param stats       Statistics to record the deliveries to
+   */
+  DeliveryTracker(int maxInflight, WorkerStats& stats) : stats{stats} {
+    std::size_t slotCount = 1;
+    while (slotCount < 2 * static_cast<std::size_t>(maxInflight)) {
+      slotCount <<= 1U;
+    }
+    this->mask = slotCount - 1;
+    this->slots.reset(new Slot[slotCount]);  // NOLINT(cppcoreguidelines-avoid-c-arrays)
+  }
+
+  /**
+   * @brief The message with this token was handed over to the MQTT library at the given time
+   */
+  void sent(int token, Clock::time_point time) {
+    Slot& slot = this->slots[static_cast<std::size_t>(token) & this->mask];
+    slot.sent.store(time.time_since_epoch().count(), std::memory_order_relaxed);
+    slot.token.store(token, std::memory_order_release);
+  }
+
+  /**
+   * @brief The MQTT library reported the message with this token as delivered
+   */
+  void delivered(int token) {
+    this->stats.delivered.add();
+
+    Slot& slot = this->slots[static_cast<std::size_t>(token) & this->mask];
+    if (token != slot.token.load(std::memory_order_acquire)) {
+      return;
+    }
+    Clock::time_point sentTime{Clock::duration(slot.sent.load(std::memory_order_relaxed))};
+    slot.token.store(0, std::memory_order_relaxed);
+
+    this->stats.ackLatency.record(Clock::now() - sentTime);
+  }
+
+  /**
+   * @brief The MQTT library reported the message as lost
+   */
+  void failed() { this->stats.deliveryFailures.add(); }
+
+private:
+  struct Slot {
+    std::atomic<int>                  token{0};
+    std::atomic<Clock::duration::rep> sent{0};
+  };
+
+  WorkerStats&            stats;
+  std::size_t             mask{0};
+  std::unique_ptr<Slot[]> slots;  // NOLINT(cppcoreguidelines-avoid-c-arrays,modernize-avoid-c-arrays)
+};
+
+#endif /* _DELIVERYTRACKER_H */
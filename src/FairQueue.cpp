@@ -0,0 +1,119 @@
+/**
+ * @file      FairQueue.cpp
+ * @brief     Deficit round robin scheduling of the queued datagrams between their sources
+ *
+ * @copyright (c) consider it GmbH, 2020
+ */
+
+#include "FairQueue.h"
+
+#include "IpAddress.h"
+
+// static configuration values
+#define FLOW_BITS 10U  // 1024 queues
+
+FairQueue::FairQueue(const AppOptions& options, std::size_t link) :
+    link{link},
+    mask4{options.sourceMask},
+    mask6{options.sourceMask6},
+    capacity{static_cast<std::size_t>(options.queueCapacity)},
+    quantum{options.udpMaxDatagramSize} {
+  if (0 != options.fairQueuing) {
+    this->flows.resize(std::size_t{1} << FLOW_BITS);
+  }
+}
+
+Packet* FairQueue::push(Packet* packet) {
+  const IpAddress key  = IpAddress::of(packet->source).prefix(this->mask4, this->mask6);
+  const auto      id   = static_cast<std::uint32_t>(key.hash() >> (64U - FLOW_BITS));
+  Flow&           flow = this->flows[id];
+
+  packet->next[this->link] = nullptr;
+  if (nullptr == flow.tail) {
+    flow.head = packet;
+  } else {
+    flow.tail->next[this->link] = packet;
+  }
+  flow.tail = packet;
+  flow.length++;
+  this->count.store(this->size() + 1, std::memory_order_relaxed);
+  if (!flow.active) {
+    this->activate(id);
+  }
+
+  if (this->size() <= this->capacity) {
+    return nullptr;
+  }
+
+  // make room at the expense of the longest queue, an emptied flow leaves the round in pop()
+  Flow* longest{nullptr};
+  for (std::uint32_t active = this->firstActive; NONE != active; active = this->flows[active].nextActive) {
+    if (nullptr == longest || this->flows[active].length > longest->length) {
+      longest = &this->flows[active];
+    }
+  }
+  return this->dequeue(*longest);
+}
+
+Packet* FairQueue::pop() {
+  while (NONE != this->firstActive) {
+    Flow& flow = this->flows[this->firstActive];
+    if (nullptr == flow.head) {
+      flow.active       = false;
+      flow.deficit      = 0;
+      this->firstActive = flow.nextActive;
+      if (NONE == this->firstActive) {
+        this->lastActive = NONE;
+      }
+      continue;
+    }
+
+    if (flow.head->len <= flow.deficit) {
+      Packet* packet = this->dequeue(flow);
+      flow.deficit -= packet->len;
+      return packet;
+    }
+
+    // the flow used up its share of this round
+    flow.deficit += this->quantum;
+    this->rotate();
+  }
+  return nullptr;
+}
+
+void FairQueue::activate(std::uint32_t id) {
+  Flow& flow      = this->flows[id];
+  flow.active     = true;
+  flow.deficit    = this->quantum;
+  flow.nextActive = NONE;
+  if (NONE == this->lastActive) {
+    this->firstActive = id;
+  } else {
+    this->flows[this->lastActive].nextActive = id;
+  }
+  this->lastActive = id;
+}
+
+void FairQueue::rotate() {
+  if (this->firstActive == this->lastActive) {
+    return;
+  }
+  const std::uint32_t id = this->firstActive;
+
+  this->firstActive                        = this->flows[id].nextActive;
+  this->flows[id].nextActive               = NONE;
+  this->flows[this->lastActive].nextActive = id;
+  this->lastActive                         = id;
+}
+
+Packet* FairQueue::dequeue(Flow& flow) {
+  Packet* packet = flow.head;
+  flow.head      = packet->next[this->link];
+  if (nullptr == flow.head) {
+    flow.tail = nullptr;
+  }
+  packet->next[this->link] = nullptr;
+  flow.length--;
+  this->count.store(this->size() - 1, std::memory_order_relaxed);
+  return packet;
+}
@@ -0,0 +1,107 @@
+/**
+ * @file      FairQueue.h
+ * @brief     Deficit round robin scheduling of the queued datagrams between their sources
+ *
+ * @copyright (c) consider it GmbH, 2020
+ */
+
+#ifndef _FAIRQUEUE_H
+#define _FAIRQUEUE_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "AppOptions.h"
+#include "IpAddress.h"
+#include "Packet.h"
+
+/**
+ * @brief Per source queues of packets, which are served by deficit round robin
+ *
+ * The sources (address prefixes of SourcePrefixLength/ SourcePrefixLength6) are hashed to a
+ * fixed number of queues, so sources never allocate memory and rarely share a queue
+ * (stochastic fairness queuing). Each active
+ * queue may publish up to UdpMaxDatagramSize payload bytes per round, so a noisy source only
+ * delays its own datagrams. The packets are linked through Packet::next, every broker has its
+ * own link, so a packet can be in the fair queues of all lanes it was fanned out to.
+ *
+ * When more than QueueCapacity packets are queued in total, the oldest packet of the longest
+ * queue is dropped, which is the noisiest source in most cases.
+ *
+ * A fair queue is not thread-safe, it is meant to be used by the publisher thread only. Only
+ * size() may be read by other threads.
+ */
+class FairQueue {
+public:
+  /**
+   * @param options Application configuration
+   * @param link    Index of the broker, selects the link in Packet::next
+   */
+  FairQueue(const AppOptions& options, std::size_t link);
+
+  FairQueue(const FairQueue&) = delete;
+  FairQueue& operator=(const FairQueue&) = delete;
+  FairQueue(FairQueue&&)                 = delete;
+  FairQueue& operator=(FairQueue&&) = delete;
+  ~FairQueue()                      = default;
+
+  /**
+   * @brief Returns True, if fair queuing is configured
+   */
+  bool enabled() const { return !this->flows.empty(); }
+
+  /**
+   * @brief Returns True, if QueueCapacity packets are queued
+   */
+  bool full() const { return this->size() >= this->capacity; }
+
+  /**
+   * @brief Number of queued packets (any thread, e.g. the receiver to detect an overload)
+   */
+  std::size_t size() const { return this->count.load(std::memory_order_relaxed); }
+
+  /**
+   * @brief Append a packet to the queue of its source
+   *
+   * @return    Packet, which was dropped to make room and has to be released, or nullptr
+   */
+  Packet* push(Packet* packet);
+
+  /**
+   * @brief Take the next packet in round robin order
+   *
+   * @return    Returns nullptr, if no packet is queued
+   */
+  Packet* pop();
+
+private:
+  static constexpr std::uint32_t NONE = UINT32_MAX;
+
+  struct Flow {
+    Packet*       head{nullptr};
+    Packet*       tail{nullptr};
+    std::uint32_t length{0};
+    int           deficit{0};        // payload bytes, which may be published in this round
+    std::uint32_t nextActive{NONE};  // next flow in the round
+    bool          active{false};
+  };
+
+  const std::size_t link;      // in Packet::next
+  const IpAddress   mask4;     // of the IPv4 source addresses
+  const IpAddress   mask6;     // of the IPv6 source addresses
+  const std::size_t capacity;  // packets in all flows
+  const int         quantum;   // payload bytes per round
+
+  std::vector<Flow>        flows;
+  std::atomic<std::size_t> count{0};  // only written by the publisher thread
+  std::uint32_t            firstActive{NONE};
+  std::uint32_t            lastActive{NONE};
+
+  void    activate(std::uint32_t flow);
+  void    rotate();
+  Packet* dequeue(Flow& flow);
+};
+
+#endif /* _FAIRQUEUE_H */
@@ -0,0 +1,135 @@
+/**
+ * @file      Hash.h
+ * @brief     Fast non-cryptographic hash of payloads and consistent hashing
+ *
+ * @copyright (c) consider it GmbH, 2020
+ */
+
+#ifndef _HASH_H
+#define _HASH_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+/**
+ * @brief 64 bit xxHash (XXH64) of a buffer
+ *
+ * Processes 32 bytes per iteration in four independent lanes, which the compiler keeps in
+ * registers, so even short payloads take only a few nanoseconds. The words are read in host
+ * byte order, the hashes are only compared within this process.
+ */
+class Xxh64 {
+public:
+  static std::uint64_t hash(const void* data, std::size_t len, std::uint64_t seed = 0) {
+    const auto*       input = static_cast<const unsigned char*>(data);
+    const auto* const end   = input + len;
+    std::uint64_t     h{0};
+
+    if (len >= 32) {
+      std::uint64_t v1 = seed + PRIME1 + PRIME2;
+      std::uint64_t v2 = seed + PRIME2;
+      std::uint64_t v3 = seed;
+      std::uint64_t v4 = seed - PRIME1;
+      do {
+        v1 = round(v1, read64(input));
+        v2 = round(v2, read64(input + 8));
+        v3 = round(v3, read64(input + 16));
+        v4 = round(v4, read64(input + 24));
+        input += 32;
+      } while (input + 32 <= end);
+
+      h = rotl(v1, 1) + rotl(v2, 7) + rotl(v3, 12) + rotl(v4, 18);
+      h = mergeRound(h, v1);
+      h = mergeRound(h, v2);
+      h = mergeRound(h, v3);
+      h = mergeRound(h, v4);
+    } else {
+      h = seed + PRIME5;
+    }
+    h += static_cast<std::uint64_t>(len);
+
+    while (input + 8 <= end) {
+      h ^= round(0, read64(input));
+      h = rotl(h, 27) * PRIME1 + PRIME4;
+      input += 8;
+    }
+    if (input + 4 <= end) {
+      h ^= static_cast<std::uint64_t>(read32(input)) * PRIME1;
+      h = rotl(h, 23) * PRIME2 + PRIME3;
+      input += 4;
+    }
+    while (input < end) {
+      h ^= static_cast<std::uint64_t>(*input) * PRIME5;
+      h = rotl(h, 11) * PRIME1;
+      input++;
+    }
+
+    // avalanche
+    h ^= h >> 33U;
+    h *= PRIME2;
+    h ^= h >> 29U;
+    h *= PRIME3;
+    h ^= h >> 32U;
+    return h;
+  }
+
+private:
+  static constexpr std::uint64_t PRIME1 = 11400714785074694791ULL;
+  static constexpr std::uint64_t PRIME2 = 14029467366897019727ULL;
+  static constexpr std::uint64_t PRIME3 = 1609587929392839161ULL;
+  static constexpr std::uint64_t PRIME4 = 9650029242287828579ULL;
+  static constexpr std::uint64_t PRIME5 = 2870177450012600261ULL;
+
+  static std::uint64_t rotl(std::uint64_t value, unsigned bits) { return (value << bits) | (value >> (64U - bits)); }
+
+  static std::uint64_t read64(const unsigned char* input) {
+    std::uint64_t value{};
+    std::memcpy(&value, input, sizeof(value));
+    return value;
+  }
+
+  static std::uint32_t read32(const unsigned char* input) {
+    std::uint32_t value{};
+    std::memcpy(&value, input, sizeof(value));
+    return value;
+  }
+
+  static std::uint64_t round(std::uint64_t acc, std::uint64_t input) {
+    acc += input * PRIME2;
+    acc = rotl(acc, 31);
+    return acc * PRIME1;
+  }
+
+  static std::uint64_t mergeRound(std::uint64_t acc, std::uint64_t value) {
+    acc ^= round(0, value);
+    return acc * PRIME1 + PRIME4;
+  }
+};
+
+/**
+ * @brief Jump consistent hash (Lamping, Veach), maps a key to one of the buckets
+ *
+ * When the number of buckets grows from n to n+1, only 1/(n+1) of the keys move (to the new
+ * bucket), all others keep theirs. It needs no table and takes about ln(buckets) iterations.
+ * The key should be well mixed already, e.g. an Xxh64 hash.
+ */
+class JumpHash {
+public:
+  static int bucket(std::uint64_t key, int buckets) {
+    std::int64_t current{-1};
+    std::int64_t next{0};
+    while (next < buckets) {
+      current = next;
+      key     = key * MULTIPLIER + 1;
+      next    = static_cast<std::int64_t>(static_cast<double>(current + 1) *
+                                       (static_cast<double>(1LL << 31U) / static_cast<double>((key >> 33U) + 1)));
+    }
+    return static_cast<int>(current);
+  }
+
+private:
+  static constexpr std::uint64_t MULTIPLIER = 2862933555777941757ULL;  // 64 bit LCG
+};
+
+#endif /* _HASH_H */
@@ -0,0 +1,186 @@
+/**
+ * @file      IpAddress.h
+ * @brief     IPv4 and IPv6 addresses of the datagram sources and the configuration
+ *
+ * @copyright (c) consider it GmbH, 2020
+ */
+
+#ifndef _IPADDRESS_H
+#define _IPADDRESS_H
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+#include "Hash.h"
+
+/**
+ * @brief IPv6 address, IPv4 addresses are kept as IPv4-mapped IPv6 addresses (::ffff:a.b.c.d)
+ *
+ * A dual-stack socket reports its IPv4 senders like that anyway, so the sources of all sockets,
+ * the TopicRule conditions and the source prefixes are compared the same way, no matter which
+ * family they belong to.
+ */
+class IpAddress {
+public:
+  static constexpr std::size_t SIZE = 16;
+
+  IpAddress() = default;
+
+  /**
+   * @brief Address of a sender, as written by recvmsg (a sockaddr_in on IPv4-only sockets)
+   */
+  static IpAddress of(const struct sockaddr_in6& source) {
+    IpAddress address{};
+    if (AF_INET == source.sin6_family) {
+      struct sockaddr_in ipv4 {};
+      std::memcpy(&ipv4, &source, sizeof(ipv4));
+      address.mapV4(ipv4.sin_addr);
+    } else {
+      std::memcpy(address.bytes.data(), &source.sin6_addr, SIZE);
+    }
+    return address;
+  }
+
+  /**
+   * @brief Address from its 16 bytes in network byte order, like data() returns them
+   */
+  static IpAddress fromBytes(const std::uint8_t* data) {
+    IpAddress address{};
+    std::memcpy(address.bytes.data(), data, SIZE);
+    return address;
+  }
+
+  /**
+   * @brief Port of a sender, sockaddr_in and sockaddr_in6 have it at the same offset
+   */
+  static std::uint16_t portOf(const struct sockaddr_in6& source) { return ntohs(source.sin6_port); }
+
+  /**
+   * @brief Parse an IPv4 (dotted decimal) or an IPv6 address
+   *
+   * @return    Returns False, if the text is not a valid address
+   */
+  static bool parse(const std::string& text, IpAddress& address) {
+    struct in_addr ipv4 {};
+    if (1 == inet_pton(AF_INET, text.c_str(), &ipv4)) {
+      address.mapV4(ipv4);
+      return true;
+    }
+    return 1 == inet_pton(AF_INET6, text.c_str(), address.bytes.data());
+  }
+
+  /**
+   * @brief Mask of the leading bits of an address
+   *
+   * @param bits  Prefix length, 0-32 for IPv4 (of the mapped address) or 0-128 for IPv6
+   * @param ipv4  Count the prefix from the start of the IPv4 address
+   */
+  static IpAddress prefixMask(int bits, bool ipv4) {
+    IpAddress mask{};
+    auto      remaining = static_cast<unsigned>(bits + (ipv4 ? 96 : 0));
+    for (auto& byte : mask.bytes) {
+      byte = static_cast<std::uint8_t>(remaining >= 8 ? 0xFFU : ~(0xFFU >> remaining));
+      remaining -= remaining >= 8 ? 8 : remaining;
+    }
+    return mask;
+  }
+
+  /**
+   * @brief Returns True for IPv4 (mapped) addresses
+   */
+  bool isV4() const {
+    static const std::array<std::uint8_t, 12> MAPPED_PREFIX{0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0xFF, 0xFF};
+    return 0 == std::memcmp(this->bytes.data(), MAPPED_PREFIX.data(), MAPPED_PREFIX.size());
+  }
+
+  /**
+   * @brief Returns True for IPv4 (224.0.0.0/4) and IPv6 (ff00::/8) multicast groups
+   */
+  bool isMulticast() const { return this->isV4() ? 0xE0 == (this->bytes[12] & 0xF0U) : 0xFF == this->bytes[0]; }
+
+  /**
+   * @brief Returns True for 0.0.0.0 and ::
+   */
+  bool isUnspecified() const { return *this == IpAddress{} || *this == IpAddress::v4Any(); }
+
+  /**
+   * @brief Source prefix of an address, the IPv4 and IPv6 ones have their own masks (SourcePrefixLength)
+   */
+  IpAddress prefix(const IpAddress& mask4, const IpAddress& mask6) const {
+    return *this & (this->isV4() ? mask4 : mask6);
+  }
+
+  /**
+   * @brief Fill a sockaddr_in for IPv4 addresses or a sockaddr_in6 for IPv6 ones
+   *
+   * @return    Length of the socket address
+   */
+  socklen_t toSockaddr(struct sockaddr_storage& storage, std::uint16_t port) const {
+    storage = {};
+    if (this->isV4()) {
+      auto* addr       = reinterpret_cast<struct sockaddr_in*>(&storage);  // NOLINT
+      addr->sin_family = AF_INET;
+      addr->sin_port   = htons(port);
+      std::memcpy(&addr->sin_addr, this->bytes.data() + 12, sizeof(addr->sin_addr));
+      return sizeof(struct sockaddr_in);
+    }
+    auto* addr        = reinterpret_cast<struct sockaddr_in6*>(&storage);  // NOLINT
+    addr->sin6_family = AF_INET6;
+    addr->sin6_port   = htons(port);
+    std::memcpy(&addr->sin6_addr, this->bytes.data(), SIZE);
+    return sizeof(struct sockaddr_in6);
+  }
+
+  /**
+   * @brief IPv4 addresses in dotted decimal, IPv6 ones in their compressed form
+   */
+  std::string toString() const {
+    char text[INET6_ADDRSTRLEN];  // NOLINT(cppcoreguidelines-avoid-c-arrays,modernize-avoid-c-arrays)
+    if (this->isV4()) {
+      inet_ntop(AF_INET, this->bytes.data() + 12, text, sizeof(text));
+    } else {
+      inet_ntop(AF_INET6, this->bytes.data(), text, sizeof(text));
+    }
+    return text;
+  }
+
+  const std::uint8_t* data() const { return this->bytes.data(); }
+
+  std::uint64_t hash() const { return Xxh64::hash(this->bytes.data(), SIZE); }
+
+  IpAddress operator&(const IpAddress& mask) const {
+    IpAddress masked{};
+    for (std::size_t i = 0; i < SIZE; i++) {
+      masked.bytes[i] = static_cast<std::uint8_t>(this->bytes[i] & mask.bytes[i]);
+    }
+    return masked;
+  }
+
+  bool operator==(const IpAddress& other) const { return this->bytes == other.bytes; }
+  bool operator!=(const IpAddress& other) const { return this->bytes != other.bytes; }
+
+private:
+  std::array<std::uint8_t, SIZE> bytes{};
+
+  static IpAddress v4Any() {
+    IpAddress address{};
+    address.mapV4(in_addr{INADDR_ANY});
+    return address;
+  }
+
+  void mapV4(const struct in_addr& ipv4) {
+    this->bytes.fill(0);
+    this->bytes[10] = 0xFF;
+    this->bytes[11] = 0xFF;
+    std::memcpy(this->bytes.data() + 12, &ipv4, sizeof(ipv4));
+  }
+};
+
+#endif /* _IPADDRESS_H */
@@ -0,0 +1,313 @@
+/**
+ * @file      Log.cpp
+ * @brief     Asynchronous, rate limited logging of the diagnostics
+ *
+ * @copyright (c) consider it GmbH, 2020
+ */
+
+#include "Log.h"
+
+#include <chrono>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <iostream>
+#include <memory>
+#include <thread>
+#include <utility>
+
+#include "SpscRing.h"
+
+// static configuration values
+#define LOG_QUEUE_CAPACITY 4096                          // messages, a power of two
+#define LOG_POLL_INTERVAL std::chrono::milliseconds(10)  // of the writer thread, while the queue is empty
+#define LOG_RATE_WINDOW std::chrono::seconds(1)          // of LogRateLimit
+#define LOG_REPORT_INTERVAL std::chrono::seconds(1)      // of the suppressed and dropped messages
+
+namespace {
+
+struct LogRecord {
+  LogLevel     level{LogLevel::Info};
+  std::int64_t time{0};  // system clock, nanoseconds since the Unix epoch
+  std::string  message{};
+};
+
+/**
+ * @brief Bounded lock-free multi-producer/single-consumer queue of log records
+ *
+ * Each slot has a sequence number, which tells the producers, that it is free, and the consumer,
+ * that it was written (Vyukov's bounded queue). So a producer only claims the slot by a CAS on
+ * the head and never waits for another one.
+ */
+class LogQueue {
+public:
+  explicit LogQueue(std::size_t capacity) : mask{capacity - 1} {
+    this->slots.reset(new Slot[capacity]);  // NOLINT(cppcoreguidelines-avoid-c-arrays)
+    for (std::size_t i = 0; i < capacity; i++) {
+      this->slots[i].sequence.store(i, std::memory_order_relaxed);
+    }
+  }
+
+  /**
+   * @brief Append a record (any thread)
+   *
+   * @return    Returns False, if the queue is full
+   */
+  bool push(LogRecord& record) {
+    std::size_t head = this->head.load(std::memory_order_relaxed);
+    while (true) {
+      Slot&       slot     = this->slots[head & this->mask];
+      std::size_t sequence = slot.sequence.load(std::memory_order_acquire);
+      if (sequence == head) {
+        if (this->head.compare_exchange_weak(head, head + 1, std::memory_order_relaxed)) {
+          slot.record = std::move(record);
+          slot.sequence.store(head + 1, std::memory_order_release);
+          return true;
+        }
+      } else if (sequence < head) {
+        return false;  // the slot was not read since the last round
+      } else {
+        head = this->head.load(std::memory_order_relaxed);
+      }
+    }
+  }
+
+  /**
+   * @brief Remove the oldest record (writer thread only)
+   *
+   * @return    Returns False, if the queue is empty
+   */
+  bool pop(LogRecord& record) {
+    Slot& slot = this->slots[this->tail & this->mask];
+    if (slot.sequence.load(std::memory_order_acquire) != this->tail + 1) {
+      return false;
+    }
+    record = std::move(slot.record);
+    slot.sequence.store(this->tail + this->mask + 1, std::memory_order_release);
+    this->tail++;
+    return true;
+  }
+
+private:
+  struct Slot {
+    std::atomic<std::size_t> sequence{0};
+    LogRecord                record{};
+  };
+
+  const std::size_t       mask;
+  std::unique_ptr<Slot[]> slots;  // NOLINT(cppcoreguidelines-avoid-c-arrays,modernize-avoid-c-arrays)
+
+  char                     padSlots[CACHE_LINE_SIZE]{};  // NOLINT(modernize-avoid-c-arrays)
+  std::atomic<std::size_t> head{0};                      // next slot to claim by a producer
+  char                     padHead[CACHE_LINE_SIZE]{};   // NOLINT(modernize-avoid-c-arrays)
+  std::size_t              tail{0};                      // next slot to read
+};
+
+/**
+ * @brief Writer thread and its queue, created by Log::start() and never destroyed
+ *
+ * The threads may still log, while the static objects are destroyed at exit, so the state is
+ * intentionally leaked.
+ */
+struct LogState {
+  LogQueue                   queue{LOG_QUEUE_CAPACITY};
+  std::atomic<bool>          running{false};
+  std::atomic<std::uint64_t> dropped{0};  // because the queue was full
+  std::thread                writer{};
+};
+
+LogState*             state{nullptr};
+LogFormat             format{LOG_FORMAT};
+std::atomic<LogSite*> sites{nullptr};  // all log statements, which were executed once
+
+const char* levelPrefix(LogLevel level) {
+  switch (level) {
+  case LogLevel::Error:
+    return "[ERROR] ";
+  case LogLevel::Warn:
+    return "[WARN ] ";
+  case LogLevel::Info:
+    return "[INFO ] ";
+  default:
+    return "[DEBUG] ";
+  }
+}
+
+const char* levelName(LogLevel level) {
+  switch (level) {
+  case LogLevel::Error:
+    return "error";
+  case LogLevel::Warn:
+    return "warn";
+  case LogLevel::Info:
+    return "info";
+  default:
+    return "debug";
+  }
+}
+
+void appendJsonString(std::string& out, const std::string& text) {
+  out += '"';
+  for (char c : text) {
+    if ('"' == c || '\\' == c) {
+      out += '\\';
+      out += c;
+    } else if (static_cast<unsigned char>(c) < 0x20) {
+      char escaped[8];  // NOLINT(cppcoreguidelines-avoid-c-arrays,modernize-avoid-c-arrays)
+      std::snprintf(escaped, sizeof(escaped), "\\u%04x", static_cast<unsigned>(c));
+      out += escaped;
+    } else {
+      out += c;
+    }
+  }
+  out += '"';
+}
+
+/**
+ * @brief Format a record as one line, with the line break
+ */
+std::string formatRecord(const LogRecord& record) {
+  std::string line{};
+  if (LogFormat::Text == format) {
+    line = levelPrefix(record.level);
+    line += record.message;
+  } else {
+    // RFC 3339 time in UTC with microseconds
+    std::time_t seconds = static_cast<std::time_t>(record.time / 1000000000);
+    struct tm   utc {};
+    gmtime_r(&seconds, &utc);
+    char time[40];  // NOLINT(cppcoreguidelines-avoid-c-arrays,modernize-avoid-c-arrays)
+    std::size_t len = std::strftime(time, sizeof(time), "%Y-%m-%dT%H:%M:%S", &utc);
+    std::snprintf(time + len, sizeof(time) - len, ".%06dZ", static_cast<int>(record.time % 1000000000 / 1000));
+
+    line = "{\"time\":\"";
+    line += time;
+    line += "\",\"level\":\"";
+    line += levelName(record.level);
+    line += "\",\"message\":";
+    appendJsonString(line, record.message);
+    line += '}';
+  }
+  line += '\n';
+  return line;
+}
+
+void writeRecord(const LogRecord& record) {
+  std::ostream& out = LogLevel::Error == record.level || LogLevel::Warn == record.level ? std::cerr : std::cout;
+  out << formatRecord(record);
+}
+
+std::int64_t systemNanoseconds() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch())
+      .count();
+}
+
+/**
+ * @brief Log the counts of the suppressed and dropped messages (writer thread)
+ */
+void reportSuppressed() {
+  for (LogSite* site = sites.load(std::memory_order_acquire); nullptr != site; site = site->next) {
+    std::uint64_t suppressed = site->takeSuppressed();
+    if (0 != suppressed) {
+      const char* file = std::strrchr(site->file, '/');
+      writeRecord({site->level, systemNanoseconds(),
+                   "Suppressed " + std::to_string(suppressed) + " similar message(s) of " +
+                       (nullptr != file ? file + 1 : site->file) + ":" + std::to_string(site->line)});
+    }
+  }
+
+  std::uint64_t dropped = nullptr != state ? state->dropped.exchange(0, std::memory_order_relaxed) : 0;
+  if (0 != dropped) {
+    writeRecord({LogLevel::Warn, systemNanoseconds(), "Log queue is full, dropped " + std::to_string(dropped) +
+                                                          " message(s)"});
+  }
+}
+
+void writerLoop() {
+  auto      nextReport = std::chrono::steady_clock::now() + LOG_REPORT_INTERVAL;
+  LogRecord record{};
+  bool      running = true;
+  while (running) {
+    // the last round writes what was queued before stop()
+    running   = state->running.load();
+    bool idle = true;
+    while (state->queue.pop(record)) {
+      writeRecord(record);
+      idle = false;
+    }
+
+    auto now = std::chrono::steady_clock::now();
+    if (now >= nextReport || !running) {
+      reportSuppressed();
+      nextReport = now + LOG_REPORT_INTERVAL;
+    }
+    std::cout.flush();
+    std::cerr.flush();
+    if (idle && running) {
+      std::this_thread::sleep_for(LOG_POLL_INTERVAL);
+    }
+  }
+}
+
+}  // namespace
+
+std::atomic<int> Log::limit{LOG_RATE_LIMIT};
+
+LogSite::LogSite(LogLevel level, const char* file, int line) : level{level}, file{file}, line{line} {
+  this->next = sites.load(std::memory_order_relaxed);
+  while (!sites.compare_exchange_weak(this->next, this, std::memory_order_release, std::memory_order_relaxed)) {
+  }
+}
+
+bool LogSite::admit() {
+  const int limit = Log::rateLimit();
+  if (0 == limit) {
+    return true;
+  }
+
+  // the first statement after the window expired starts the next one, concurrent ones may count to either
+  const std::int64_t now   = std::chrono::steady_clock::now().time_since_epoch().count();
+  std::int64_t       start = this->windowStart.load(std::memory_order_relaxed);
+  if (now - start >= std::chrono::duration_cast<std::chrono::steady_clock::duration>(LOG_RATE_WINDOW).count() &&
+      this->windowStart.compare_exchange_strong(start, now, std::memory_order_relaxed)) {
+    this->admitted.store(0, std::memory_order_relaxed);
+  }
+  if (this->admitted.fetch_add(1, std::memory_order_relaxed) < static_cast<std::uint64_t>(limit)) {
+    return true;
+  }
+  this->suppressed.fetch_add(1, std::memory_order_relaxed);
+  return false;
+}
+
+void Log::start(const AppOptions& options) {
+  format = options.logFormat;
+  limit.store(options.logRateLimit, std::memory_order_relaxed);
+  if (nullptr != state) {
+    return;
+  }
+
+  // the queued messages are written, even if the gateway exits from another thread
+  state = new LogState();
+  state->running.store(true);
+  state->writer = std::thread(writerLoop);
+  std::atexit(Log::stop);
+}
+
+void Log::stop() {
+  if (nullptr != state && state->running.exchange(false)) {
+    state->writer.join();
+  }
+}
+
+void Log::write(LogLevel level, std::string message) {
+  LogRecord record{level, systemNanoseconds(), std::move(message)};
+  if (nullptr == state || !state->running.load(std::memory_order_relaxed)) {
+    writeRecord(record);
+    return;
+  }
+  if (!state->queue.push(record)) {
+    state->dropped.fetch_add(1, std::memory_order_relaxed);
+  }
+}
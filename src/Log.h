@@ -0,0 +1,120 @@
+/**
+ * @file      Log.h
+ * @brief     Asynchronous, rate limited logging of the diagnostics
+ *
+ * @copyright (c) consider it GmbH, 2020
+ */
+
+#ifndef _LOG_H
+#define _LOG_H
+
+#include <atomic>
+#include <cstdint>
+#include <sstream>
+#include <string>
+
+#include "AppOptions.h"
+
+/**
+ * @brief Severity of a log message, errors and warnings go to stderr, the others to stdout
+ */
+enum class LogLevel {
+  Error,
+  Warn,
+  Info,
+  Debug,
+};
+
+/**
+ * @brief Rate limit of one log statement (LOG_* macro), shared by all threads
+ *
+ * Each statement may log LogRateLimit messages per second, the others are only counted. The
+ * writer thread reports the count once per second as "Suppressed N similar message(s)", so a
+ * storm of failures costs a clock read and two atomic increments per message.
+ */
+class LogSite {
+public:
+  LogSite(LogLevel level, const char* file, int line);
+
+  LogSite(const LogSite&) = delete;
+  LogSite& operator=(const LogSite&) = delete;
+  LogSite(LogSite&&)                 = delete;
+  LogSite& operator=(LogSite&&) = delete;
+  ~LogSite()                    = default;
+
+  /**
+   * @brief Returns True, if the message may be logged, otherwise it is counted as suppressed
+   */
+  bool admit();
+
+  /**
+   * @brief Take the count of the suppressed messages since the last call (writer thread)
+   */
+  std::uint64_t takeSuppressed() { return this->suppressed.exchange(0, std::memory_order_relaxed); }
+
+  const LogLevel    level;
+  const char* const file;
+  const int         line;
+  LogSite*          next{nullptr};  // all sites are linked, for the suppression reports
+
+private:
+  std::atomic<std::int64_t>  windowStart{0};  // steady clock, nanoseconds
+  std::atomic<std::uint64_t> admitted{0};     // messages logged in the current window
+  std::atomic<std::uint64_t> suppressed{0};
+};
+
+/**
+ * @brief Log of the gateway, written by a background thread
+ *
+ * The threads only format their message and append it to a bounded lock-free queue, a background
+ * thread writes the lines to stdout/ stderr. If the queue is full, the message is dropped and
+ * counted, so a slow journald never blocks the receiver or publisher threads. Before start() and
+ * after the exit of the process, the messages are written directly.
+ */
+class Log {
+public:
+  /**
+   * @brief Apply LogFormat and LogRateLimit and start the writer thread
+   */
+  static void start(const AppOptions& options);
+
+  /**
+   * @brief Stop the writer thread, after it wrote all queued messages (called at exit)
+   */
+  static void stop();
+
+  /**
+   * @brief Queue a message (use the LOG_* macros, which apply the rate limit first)
+   */
+  static void write(LogLevel level, std::string message);
+
+  /**
+   * @brief Maximum messages per second and log statement, 0 is unlimited
+   */
+  static int rateLimit() { return limit.load(std::memory_order_relaxed); }
+
+private:
+  static std::atomic<int> limit;
+};
+
+/**
+ * @brief Log a message, which is composed with operator<<, e.g. LOG_WARN("Dropped " << count << " datagram(s)")
+ *
+ * The message is only formatted, if the rate limit of the statement admits it.
+ */
+#define LOG_AT(level, message)                                                                                         \
+  do {                                                                                                                 \
+    static LogSite logSite((level), __FILE__, __LINE__);                                                               \
+    if (logSite.admit()) {                                                                                             \
+      std::ostringstream logStream;                                                                                    \
+      logStream << message; /* NOLINT(bugprone-macro-parentheses) */                                                   \
+      Log::write((level), logStream.str());                                                                            \
+    }                                                                                                                  \
+  } while (false)
+
+#define LOG_ERROR(message) LOG_AT(LogLevel::Error, message)
+#define LOG_WARN(message) LOG_AT(LogLevel::Warn, message)
+#define LOG_INFO(message) LOG_AT(LogLevel::Info, message)
+#define LOG_DEBUG(message) LOG_AT(LogLevel::Debug, message)
+
+#endif /* _LOG_H */
@@ -0,0 +1,331 @@
+/**
+ * @file      MqttAsyncPublisher.cpp
+ * @brief     MQTT client backend on top of the asynchronous Paho client library (MQTTAsync)
+ *
+ * All network I/O is done by the threads of the MQTT library. Publishing only queues the
+ * message in the library and never blocks, completions are reported by callbacks.
+ *
+ * @copyright (c) consider it GmbH, 2020
+ */
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+
+#include <MQTTAsync.h>
+
+#include "DeliveryTracker.h"
+#include "Log.h"
+#include "MqttPublisher.h"
+
+// static configuration values
+#define DISCONNECT_GRACE std::chrono::milliseconds(100)  // beyond the timeout of the library
+
+namespace {
+
+class MqttAsyncPublisher : public MqttPublisher {
+public:
+  MqttAsyncPublisher(const AppOptions& options, const std::string& clientID, WorkerStats& stats) :
+      MqttPublisher(options),
+      options{options},
+      v5{MQTTVERSION_5 == options.mqttVersion},
+      deliveryTracker{options.mqttSendQueueSize, stats} {
+    MQTTAsync_createOptions createOpts = MQTTAsync_createOptions_initializer;
+    createOpts.MQTTVersion             = options.mqttVersion;
+
+    MQTTAsync_createWithOptions(&this->client, options.mqttUrl.c_str(), clientID.c_str(),
+                                MQTTCLIENT_PERSISTENCE_NONE, nullptr, &createOpts);
+    MQTTAsync_setCallbacks(this->client, this, onConnectionLost, onMessageArrived, nullptr);
+  }
+
+  MqttAsyncPublisher(const MqttAsyncPublisher&) = delete;
+  MqttAsyncPublisher& operator=(const MqttAsyncPublisher&) = delete;
+  MqttAsyncPublisher(MqttAsyncPublisher&&)                 = delete;
+  MqttAsyncPublisher& operator=(MqttAsyncPublisher&&) = delete;
+
+  ~MqttAsyncPublisher() override {
+    this->stopReconnecting();
+    MQTTAsync_destroy(&this->client);
+  }
+
+  bool connect() override {
+    MQTTAsync_connectOptions mqttConnOpts  = MQTTAsync_connectOptions_initializer;
+    MQTTAsync_connectOptions mqttConnOpts5 = MQTTAsync_connectOptions_initializer5;
+    MQTTAsync_SSLOptions     mqttSslOpts   = MQTTAsync_SSLOptions_initializer;
+
+    // MQTT v5 uses clean start instead of clean session and its own callback signatures
+    if (this->v5) {
+      mqttConnOpts            = mqttConnOpts5;
+      mqttConnOpts.onSuccess5 = onConnectSuccess5;
+      mqttConnOpts.onFailure5 = onConnectFailure5;
+    } else {
+      mqttConnOpts.cleansession = 1;
+      mqttConnOpts.onSuccess    = onConnectSuccess;
+      mqttConnOpts.onFailure    = onConnectFailure;
+    }
+
+    mqttConnOpts.keepAliveInterval = options.mqttKeepAliveInterval;
+    mqttConnOpts.connectTimeout    = options.mqttConnectionTimeout;
+    mqttConnOpts.retryInterval     = options.mqttRetryInterval;
+    if (!options.mqttUsername.empty()) {
+      mqttConnOpts.username = options.mqttUsername.c_str();
+      mqttConnOpts.password = options.mqttPassword.c_str();
+    }
+    mqttConnOpts.MQTTVersion = options.mqttVersion;
+    mqttConnOpts.maxInflight = options.mqttMaxInflight;
+    mqttConnOpts.context     = this;
+
+    mqttSslOpts.enableServerCertAuth = options.mqttSslEnableServerCertAuth;
+    mqttSslOpts.sslVersion           = options.mqttSslVersion;
+    mqttSslOpts.verify               = options.mqttSslVerify;
+    if (!options.mqttSslTrustStore.empty()) {
+      mqttSslOpts.trustStore = options.mqttSslTrustStore.c_str();
+    }
+    if (!options.mqttSslKeyStore.empty()) {
+      mqttSslOpts.keyStore = options.mqttSslKeyStore.c_str();
+    }
+    if (!options.mqttSslPrivateKey.empty()) {
+      mqttSslOpts.privateKey = options.mqttSslPrivateKey.c_str();
+    }
+    if (!options.mqttSslPrivateKeyPasswd.empty()) {
+      mqttSslOpts.privateKeyPassword = options.mqttSslPrivateKeyPasswd.c_str();
+    }
+
+    mqttConnOpts.ssl = &mqttSslOpts;
+
+    {
+      std::lock_guard<std::mutex> lock(this->connectMutex);
+      this->connectFinished = false;
+    }
+
+    int mqttRC = MQTTAsync_connect(this->client, &mqttConnOpts);
+    if (MQTTASYNC_SUCCESS != mqttRC) {
+      LOG_ERROR("Failed to connect to MQTT broker, error " << mqttRC << ": " << MQTTAsync_strerror(mqttRC));
+      return false;
+    }
+
+    // the connect options must stay valid until the library has called one of the callbacks
+    std::unique_lock<std::mutex> lock(this->connectMutex);
+    this->connectDone.wait(lock, [this] { return this->connectFinished; });
+    if (MQTTASYNC_SUCCESS != this->connectRC) {
+      LOG_ERROR("Failed to connect to MQTT broker, error " << this->connectRC << ": " << this->connectError);
+      return false;
+    }
+
+    this->connectionEstablished(this->connectTopicAliases);
+    return true;
+  }
+
+  bool publish(const std::string& topic, const void* payload, int payloadLen, int qos, std::int64_t arrival,
+               Compression encoding) override {
+    // bound the number of messages queued in the library, instead of blocking the caller
+    if (this->queued.fetch_add(1) >= this->options.mqttSendQueueSize) {
+      this->queued--;
+      LOG_ERROR("Failed to publish MQTT message, send queue is full");
+      return false;
+    }
+
+    MQTTAsync_message         pubmsg   = MQTTAsync_message_initializer;
+    MQTTAsync_responseOptions response = MQTTAsync_responseOptions_initializer;
+
+    pubmsg.payload    = const_cast<void*>(payload);  // NOLINT(cppcoreguidelines-pro-type-const-cast)
+    pubmsg.payloadlen = payloadLen;
+    pubmsg.qos        = qos;
+    pubmsg.retained   = 0;
+
+    if (this->v5) {
+      response.onSuccess5 = onSendSuccess5;
+      response.onFailure5 = onSendFailure5;
+    } else {
+      response.onSuccess = onSendSuccess;
+      response.onFailure = onSendFailure;
+    }
+    response.context = this;
+
+    const char* topicName{nullptr};
+    pubmsg.properties = this->prepareMessage(topic, arrival, encoding, topicName);
+
+    auto sent   = DeliveryTracker::Clock::now();
+    int  mqttRC = MQTTAsync_sendMessage(this->client, topicName, &pubmsg, &response);
+    if (MQTTASYNC_SUCCESS != mqttRC) {
+      this->queued--;
+      LOG_ERROR("Failed to publish MQTT message, error " << mqttRC);
+      this->messageFailed(topic);
+      return false;
+    }
+    this->deliveryTracker.sent(response.token, sent);
+
+    return true;
+  }
+
+  void disconnect(int timeoutMs) override {
+    this->stopReconnecting();
+    if (!this->connected()) {
+      return;
+    }
+
+    // the library sends the queued messages before the disconnect request
+    MQTTAsync_disconnectOptions disconnectOpts = MQTTAsync_disconnectOptions_initializer;
+    disconnectOpts.timeout                     = timeoutMs;
+    disconnectOpts.context                     = this;
+    if (this->v5) {
+      disconnectOpts.onSuccess5 = onDisconnected5;
+      disconnectOpts.onFailure5 = onDisconnectFailure5;
+    } else {
+      disconnectOpts.onSuccess = onDisconnected;
+      disconnectOpts.onFailure = onDisconnectFailure;
+    }
+
+    {
+      std::lock_guard<std::mutex> lock(this->connectMutex);
+      this->disconnectFinished = false;
+    }
+    if (MQTTASYNC_SUCCESS == MQTTAsync_disconnect(this->client, &disconnectOpts)) {
+      std::unique_lock<std::mutex> lock(this->connectMutex);
+      this->connectDone.wait_for(lock, std::chrono::milliseconds(timeoutMs) + DISCONNECT_GRACE,
+                                 [this] { return this->disconnectFinished; });
+    }
+    this->connectionLost();
+  }
+
+private:
+  const AppOptions& options;
+  const bool        v5;
+  MQTTAsync         client{};
+  std::atomic<int>  queued{0};  // messages handed over to the library, which are not completed yet
+  DeliveryTracker   deliveryTracker;
+
+  std::mutex              connectMutex;
+  std::condition_variable connectDone;
+  bool                    connectFinished{false};
+  int                     connectRC{MQTTASYNC_SUCCESS};
+  std::string             connectError{};
+  int                     connectTopicAliases{0};  // Topic Alias Maximum of the broker
+  bool                    disconnectFinished{false};
+
+  void finishConnect(int rc, const char* message, int topicAliasMaximum = 0) {
+    {
+      std::lock_guard<std::mutex> lock(this->connectMutex);
+      this->connectFinished     = true;
+      this->connectRC           = rc;
+      this->connectError        = (message != nullptr) ? message : MQTTAsync_strerror(rc);
+      this->connectTopicAliases = topicAliasMaximum;
+    }
+    this->connectDone.notify_all();
+  }
+
+  /**
+   * @brief MQTT library callback: connection to the broker was established
+   */
+  static void onConnectSuccess(void* context, MQTTAsync_successData* /*response*/) {
+    static_cast<MqttAsyncPublisher*>(context)->finishConnect(MQTTASYNC_SUCCESS, nullptr);
+  }
+
+  /**
+   * @brief MQTT library callback: connection to the broker could not be established
+   */
+  static void onConnectFailure(void* context, MQTTAsync_failureData* response) {
+    int rc = (response != nullptr && response->code != MQTTASYNC_SUCCESS) ? response->code : MQTTASYNC_FAILURE;
+    static_cast<MqttAsyncPublisher*>(context)->finishConnect(rc,
+                                                             (response != nullptr) ? response->message : nullptr);
+  }
+
+  static void onConnectSuccess5(void* context, MQTTAsync_successData5* response) {
+    int topicAliasMaximum{0};
+    if (response != nullptr &&
+        0 != MQTTProperties_hasProperty(&response->properties, MQTTPROPERTY_CODE_TOPIC_ALIAS_MAXIMUM)) {
+      topicAliasMaximum = MQTTProperties_getNumericValue(&response->properties, MQTTPROPERTY_CODE_TOPIC_ALIAS_MAXIMUM);
+    }
+    static_cast<MqttAsyncPublisher*>(context)->finishConnect(MQTTASYNC_SUCCESS, nullptr, topicAliasMaximum);
+  }
+
+  static void onConnectFailure5(void* context, MQTTAsync_failureData5* response) {
+    int rc = (response != nullptr && response->code != MQTTASYNC_SUCCESS) ? response->code : MQTTASYNC_FAILURE;
+    static_cast<MqttAsyncPublisher*>(context)->finishConnect(rc,
+                                                             (response != nullptr) ? response->message : nullptr);
+  }
+
+  void finishDisconnect() {
+    {
+      std::lock_guard<std::mutex> lock(this->connectMutex);
+      this->disconnectFinished = true;
+    }
+    this->connectDone.notify_all();
+  }
+
+  /**
+   * @brief MQTT library callback: the disconnect request was sent or has failed, the gateway exits either way
+   */
+  static void onDisconnected(void* context, MQTTAsync_successData* /*response*/) {
+    static_cast<MqttAsyncPublisher*>(context)->finishDisconnect();
+  }
+
+  static void onDisconnectFailure(void* context, MQTTAsync_failureData* /*response*/) {
+    static_cast<MqttAsyncPublisher*>(context)->finishDisconnect();
+  }
+
+  static void onDisconnected5(void* context, MQTTAsync_successData5* /*response*/) {
+    static_cast<MqttAsyncPublisher*>(context)->finishDisconnect();
+  }
+
+  static void onDisconnectFailure5(void* context, MQTTAsync_failureData5* /*response*/) {
+    static_cast<MqttAsyncPublisher*>(context)->finishDisconnect();
+  }
+
+  /**
+   * @brief MQTT library callback: message was sent (QoS 0) or acknowledged by the broker (QoS>0)
+   */
+  static void onSendSuccess(void* context, MQTTAsync_successData* response) {
+    auto* self = static_cast<MqttAsyncPublisher*>(context);
+    self->queued--;
+    self->deliveryTracker.delivered((response != nullptr) ? response->token : 0);
+  }
+
+  /**
+   * @brief MQTT library callback: message could not be delivered
+   */
+  static void onSendFailure(void* context, MQTTAsync_failureData* response) {
+    auto* self = static_cast<MqttAsyncPublisher*>(context);
+    self->queued--;
+    self->deliveryTracker.failed();
+    LOG_ERROR("Failed to publish MQTT message, error " << ((response != nullptr) ? response->code : 0));
+  }
+
+  static void onSendSuccess5(void* context, MQTTAsync_successData5* response) {
+    auto* self = static_cast<MqttAsyncPublisher*>(context);
+    self->queued--;
+    self->deliveryTracker.delivered((response != nullptr) ? response->token : 0);
+  }
+
+  static void onSendFailure5(void* context, MQTTAsync_failureData5* response) {
+    auto* self = static_cast<MqttAsyncPublisher*>(context);
+    self->queued--;
+    self->deliveryTracker.failed();
+    LOG_ERROR("Failed to publish MQTT message, error " << ((response != nullptr) ? response->code : 0));
+  }
+
+  /**
+   * @brief MQTT library callback: connection to the broker was lost
+   */
+  static void onConnectionLost(void* context, char* cause) {
+    LOG_ERROR("Connection to MQTT broker lost (" << (cause != nullptr ? cause : "unknown cause") << ")");
+    static_cast<MqttAsyncPublisher*>(context)->connectionLost();
+  }
+
+  /**
+   * @brief MQTT library callback: message arrived (not used, the gateway does not subscribe)
+   */
+  static int onMessageArrived(void* /*context*/, char* topicName, int /*topicLen*/, MQTTAsync_message* message) {
+    MQTTAsync_freeMessage(&message);
+    MQTTAsync_free(topicName);
+    return 1;
+  }
+};
+
+}  // namespace
+
+std::unique_ptr<MqttPublisher> createMqttPublisher(const AppOptions& options, const std::string& clientID,
+                                                   WorkerStats& stats) {
+  return std::unique_ptr<MqttPublisher>(new MqttAsyncPublisher(options, clientID, stats));
+}
@@ -0,0 +1,319 @@
+/**
+ * @file      MqttClientPublisher.cpp
+ * @brief     MQTT client backend on top of the synchronous Paho client library (MQTTClient)
+ *
+ * @copyright (c) consider it GmbH, 2020
+ */
+
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+
+#include <MQTTClient.h>
+
+#include "DeliveryTracker.h"
+#include "Log.h"
+#include "MqttPublisher.h"
+
+namespace {
+
+/**
+ * @brief Human readable description of the MQTTClient_connect return code
+ */
+const char* connectErrorText(int rc) {
+  switch (rc) {
+  case -1:  // NOLINT(cppcoreguidelines-avoid-magic-numbers,readability-magic-numbers
+    return "MQTTCLIENT_FAILURE";
+  case -3:  // NOLINT(cppcoreguidelines-avoid-magic-numbers,readability-magic-numbers
+    return "MQTTCLIENT_DISCONNECTED";
+  case -4:  // NOLINT(cppcoreguidelines-avoid-magic-numbers,readability-magic-numbers
+    return "MQTTCLIENT_MAX_MESSAGES_INFLIGHT";
+  case -5:  // NOLINT(cppcoreguidelines-avoid-magic-numbers,readability-magic-numbers
+    return "MQTTCLIENT_BAD_UTF8_STRING";
+  case -6:  // NOLINT(cppcoreguidelines-avoid-magic-numbers,readability-magic-numbers
+    return "MQTTCLIENT_NULL_PARAMETER";
+  case -7:  // NOLINT(cppcoreguidelines-avoid-magic-numbers,readability-magic-numbers
+    return "MQTTCLIENT_TOPICNAME_TRUNCATED";
+  case -8:  // NOLINT(cppcoreguidelines-avoid-magic-numbers,readability-magic-numbers
+    return "MQTTCLIENT_BAD_STRUCTURE";
+  case -10:  // NOLINT(cppcoreguidelines-avoid-magic-numbers,readability-magic-numbers
+    return "MQTTCLIENT_SSL_NOT_SUPPORTED";
+  case -11:  // NOLINT(cppcoreguidelines-avoid-magic-numbers,readability-magic-numbers
+    return "MQTTCLIENT_BAD_MQTT_VERSION";
+  case -14:  // NOLINT(cppcoreguidelines-avoid-magic-numbers,readability-magic-numbers
+    return "MQTTCLIENT_BAD_PROTOCOL";
+  case -15:  // NOLINT(cppcoreguidelines-avoid-magic-numbers,readability-magic-numbers
+    return "MQTTCLIENT_BAD_MQTT_OPTION";
+  case -16:  // NOLINT(cppcoreguidelines-avoid-magic-numbers,readability-magic-numbers
+    return "MQTTCLIENT_WRONG_MQTT_VERSION";
+
+  case 1:  // NOLINT(cppcoreguidelines-avoid-magic-numbers,readability-magic-numbers
+    return "Unacceptable protocol version";
+  case 2:  // NOLINT(cppcoreguidelines-avoid-magic-numbers,readability-magic-numbers
+    return "Identifier rejected";
+  case 3:  // NOLINT(cppcoreguidelines-avoid-magic-numbers,readability-magic-numbers
+    return "Server unavailabl";
+  case 4:  // NOLINT(cppcoreguidelines-avoid-magic-numbers,readability-magic-numbers
+    return "Bad user name or password";
+  case 5:  // NOLINT(cppcoreguidelines-avoid-magic-numbers,readability-magic-numbers)
+    return "Not authorized";
+  default:
+    return "Unknown error code";
+  }
+}
+
+/**
+ * @brief Window of QoS>0 messages, which were published but not yet acknowledged by the broker
+ *
+ * The MQTT library calls the delivery complete callback from its own thread, so publishing
+ * never has to wait for the broker round trip unless the window is full.
+ * Messages with QoS 0 are never acknowledged and therefore not tracked.
+ */
+class InflightWindow {
+public:
+  explicit InflightWindow(int maxInflight) : maxInflight{maxInflight} {}
+
+  /**
+   * @brief Reserve a slot in the window, wait for a free one if necessary
+   *
+   * @return    Returns False, if no slot got free within the timeout
+   */
+  bool acquire(int timeoutMs) {
+    std::unique_lock<std::mutex> lock(this->mutex);
+    if (!this->freed.wait_for(lock, std::chrono::milliseconds(timeoutMs),
+                              [this] { return this->inflight < this->maxInflight; })) {
+      return false;
+    }
+
+    this->inflight++;
+    return true;
+  }
+
+  /**
+   * @brief Release a slot, when the message was acknowledged or could not be published at all
+   */
+  void release() {
+    {
+      std::lock_guard<std::mutex> lock(this->mutex);
+      if (this->inflight > 0) {
+        this->inflight--;
+      }
+    }
+    this->freed.notify_one();
+  }
+
+  /**
+   * @brief Release all slots, because the outstanding messages will never be acknowledged
+   *
+   * @return    Number of messages, that were still in flight
+   */
+  int reset() {
+    int lost{};
+    {
+      std::lock_guard<std::mutex> lock(this->mutex);
+      lost           = this->inflight;
+      this->inflight = 0;
+    }
+    this->freed.notify_all();
+    return lost;
+  }
+
+private:
+  const int               maxInflight;
+  int                     inflight{0};
+  std::mutex              mutex;
+  std::condition_variable freed;
+};
+
+class MqttClientPublisher : public MqttPublisher {
+public:
+  MqttClientPublisher(const AppOptions& options, const std::string& clientID, WorkerStats& stats) :
+      MqttPublisher(options),
+      options{options},
+      stats{stats},
+      inflightWindow{options.mqttMaxInflight},
+      deliveryTracker{options.mqttMaxInflight, stats} {
+    // MQTT v5 has to be selected when creating the client already
+    MQTTClient_createOptions createOpts = MQTTClient_createOptions_initializer;
+    createOpts.MQTTVersion              = options.mqttVersion;
+    MQTTClient_createWithOptions(&this->client, options.mqttUrl.c_str(), clientID.c_str(),
+                                 MQTTCLIENT_PERSISTENCE_NONE, nullptr, &createOpts);
+
+    // allow multiple messages in flight, completions are reported by the callbacks
+    MQTTClient_setCallbacks(this->client, this, onConnectionLost, onMessageArrived, onDeliveryComplete);
+  }
+
+  MqttClientPublisher(const MqttClientPublisher&) = delete;
+  MqttClientPublisher& operator=(const MqttClientPublisher&) = delete;
+  MqttClientPublisher(MqttClientPublisher&&)                 = delete;
+  MqttClientPublisher& operator=(MqttClientPublisher&&) = delete;
+
+  ~MqttClientPublisher() override {
+    this->stopReconnecting();
+    MQTTClient_destroy(&this->client);
+  }
+
+  bool connect() override {
+    MQTTClient_connectOptions mqttConnOpts  = MQTTClient_connectOptions_initializer;
+    MQTTClient_connectOptions mqttConnOpts5 = MQTTClient_connectOptions_initializer5;
+    MQTTClient_SSLOptions     mqttSslOpts   = MQTTClient_SSLOptions_initializer;
+
+    // MQTT v5 uses clean start instead of clean session
+    const bool v5 = MQTTVERSION_5 == options.mqttVersion;
+    if (v5) {
+      mqttConnOpts = mqttConnOpts5;
+    } else {
+      mqttConnOpts.cleansession = 1;
+    }
+
+    mqttConnOpts.keepAliveInterval = options.mqttKeepAliveInterval;
+    mqttConnOpts.connectTimeout    = options.mqttConnectionTimeout;
+    mqttConnOpts.retryInterval     = options.mqttRetryInterval;
+    if (!options.mqttUsername.empty()) {
+      mqttConnOpts.username = options.mqttUsername.c_str();
+      mqttConnOpts.password = options.mqttPassword.c_str();
+    }
+    mqttConnOpts.MQTTVersion = options.mqttVersion;
+
+    mqttConnOpts.reliable            = 0;
+    mqttConnOpts.maxInflightMessages = options.mqttMaxInflight;
+
+    mqttSslOpts.enableServerCertAuth = options.mqttSslEnableServerCertAuth;
+    mqttSslOpts.sslVersion           = options.mqttSslVersion;
+    mqttSslOpts.verify               = options.mqttSslVerify;
+    if (!options.mqttSslTrustStore.empty()) {
+      mqttSslOpts.trustStore = options.mqttSslTrustStore.c_str();
+    }
+    if (!options.mqttSslKeyStore.empty()) {
+      mqttSslOpts.keyStore = options.mqttSslKeyStore.c_str();
+    }
+    if (!options.mqttSslPrivateKey.empty()) {
+      mqttSslOpts.privateKey = options.mqttSslPrivateKey.c_str();
+    }
+    if (!options.mqttSslPrivateKeyPasswd.empty()) {
+      mqttSslOpts.privateKeyPassword = options.mqttSslPrivateKeyPasswd.c_str();
+    }
+
+    mqttConnOpts.ssl = &mqttSslOpts;
+
+    int mqttRC{MQTTCLIENT_SUCCESS};
+    int topicAliasMaximum{0};
+    if (v5) {
+      MQTTResponse response = MQTTClient_connect5(this->client, &mqttConnOpts, nullptr, nullptr);
+      mqttRC                = response.reasonCode;
+      if (nullptr != response.properties &&
+          0 != MQTTProperties_hasProperty(response.properties, MQTTPROPERTY_CODE_TOPIC_ALIAS_MAXIMUM)) {
+        topicAliasMaximum =
+            MQTTProperties_getNumericValue(response.properties, MQTTPROPERTY_CODE_TOPIC_ALIAS_MAXIMUM);
+      }
+      MQTTResponse_free(response);
+    } else {
+      mqttRC = MQTTClient_connect(this->client, &mqttConnOpts);
+    }
+    if (MQTTCLIENT_SUCCESS != mqttRC) {
+      LOG_ERROR("Failed to connect to MQTT broker, error " << mqttRC << ": " << connectErrorText(mqttRC));
+      return false;
+    }
+
+    this->connectionEstablished(topicAliasMaximum);
+    return true;
+  }
+
+  bool publish(const std::string& topic, const void* payload, int payloadLen, int qos, std::int64_t arrival,
+               Compression encoding) override {
+    MQTTClient_message pubmsg = MQTTClient_message_initializer;
+
+    pubmsg.payload    = const_cast<void*>(payload);  // NOLINT(cppcoreguidelines-pro-type-const-cast)
+    pubmsg.payloadlen = payloadLen;
+    pubmsg.qos        = qos;
+    pubmsg.retained   = 0;
+
+    bool tracked = qos > 0;
+    if (tracked && !this->inflightWindow.acquire(this->options.mqttConnectionTimeout)) {
+      LOG_ERROR("Failed to publish MQTT message, no acknowledgement within timeout");
+      return false;
+    }
+
+    const char* topicName{nullptr};
+    pubmsg.properties = this->prepareMessage(topic, arrival, encoding, topicName);
+
+    MQTTClient_deliveryToken token{0};
+    int                      mqttRC{MQTTCLIENT_SUCCESS};
+    if (MQTTVERSION_5 == this->options.mqttVersion) {
+      MQTTResponse response = MQTTClient_publishMessage5(this->client, topicName, &pubmsg, &token);
+      mqttRC                = response.reasonCode;
+      MQTTResponse_free(response);
+    } else {
+      mqttRC = MQTTClient_publishMessage(this->client, topicName, &pubmsg, &token);
+    }
+    if (MQTTCLIENT_SUCCESS != mqttRC) {
+      LOG_ERROR("Failed to publish MQTT message, error " << mqttRC);
+      this->messageFailed(topic);
+      if (tracked) {
+        this->inflightWindow.release();
+      }
+      return false;
+    }
+
+    // QoS 0 messages are complete, when they were written to the socket
+    if (tracked) {
+      this->deliveryTracker.sent(token, DeliveryTracker::Clock::now());
+    } else {
+      this->stats.delivered.add();
+    }
+
+    return true;
+  }
+
+  void disconnect(int timeoutMs) override {
+    this->stopReconnecting();
+    if (this->connected()) {
+      MQTTClient_disconnect(this->client, timeoutMs);
+      this->connectionLost();
+    }
+  }
+
+private:
+  const AppOptions& options;
+  WorkerStats&      stats;
+  MQTTClient        client{};
+  InflightWindow    inflightWindow;
+  DeliveryTracker   deliveryTracker;
+
+  /**
+   * @brief MQTT library callback: QoS>0 message was acknowledged by the broker
+   */
+  static void onDeliveryComplete(void* context, MQTTClient_deliveryToken token) {
+    auto* self = static_cast<MqttClientPublisher*>(context);
+    self->deliveryTracker.delivered(token);
+    self->inflightWindow.release();
+  }
+
+  /**
+   * @brief MQTT library callback: connection to the broker was lost
+   */
+  static void onConnectionLost(void* context, char* cause) {
+    auto* self = static_cast<MqttClientPublisher*>(context);
+    int   lost = self->inflightWindow.reset();
+    self->stats.deliveryFailures.add(static_cast<std::uint64_t>(lost));
+    self->connectionLost();
+    LOG_ERROR("Connection to MQTT broker lost (" << (cause != nullptr ? cause : "unknown cause") << "), "
+              << lost << " message(s) were not acknowledged");
+  }
+
+  /**
+   * @brief MQTT library callback: message arrived (not used, the gateway does not subscribe)
+   */
+  static int onMessageArrived(void* /*context*/, char* topicName, int /*topicLen*/, MQTTClient_message* message) {
+    MQTTClient_freeMessage(&message);
+    MQTTClient_free(topicName);
+    return 1;
+  }
+};
+
+}  // namespace
+
+std::unique_ptr<MqttPublisher> createMqttPublisher(const AppOptions& options, const std::string& clientID,
+                                                   WorkerStats& stats) {
+  return std::unique_ptr<MqttPublisher>(new MqttClientPublisher(options, clientID, stats));
+}
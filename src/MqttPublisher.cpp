@@ -0,0 +1,337 @@
+/**
+ * @file      MqttPublisher.cpp
+ * @brief     Reconnect handling shared by the MQTT client backends
+ *
+ * @copyright (c) consider it GmbH, 2020
+ */
+
+#include "MqttPublisher.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <dirent.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+
+#include "Log.h"
+
+// static configuration values
+#define ENCODING_PROPERTY "content-encoding"  // user property with the compression of the payload
+#define ENCODING_LZ4 "lz4"
+#define ENCODING_ZSTD "zstd"
+#define FD_DIRECTORY "/proc/self/fd"
+
+namespace {
+
+// the properties are filled in place instead of with MQTTProperties_add, which allocates, so their
+// encoded length has to be summed up here: identifier byte, then the value (strings with a 2 byte length)
+void addTopicAlias(MQTTProperties& properties, std::uint16_t alias) {
+  MQTTProperty& property  = properties.array[properties.count++];
+  property                = MQTTProperty{};
+  property.identifier     = MQTTPROPERTY_CODE_TOPIC_ALIAS;
+  property.value.integer2 = alias;
+  properties.length += 1 + 2;
+}
+
+void addUserProperty(MQTTProperties& properties, const char* name, const char* value, int valueLen) {
+  // the MQTT library copies name and value, if it keeps the message
+  MQTTProperty& property    = properties.array[properties.count++];
+  property                  = MQTTProperty{};
+  property.identifier       = MQTTPROPERTY_CODE_USER_PROPERTY;
+  property.value.data.data  = const_cast<char*>(name);  // NOLINT(cppcoreguidelines-pro-type-const-cast)
+  property.value.data.len   = static_cast<int>(std::strlen(name));
+  property.value.value.data = const_cast<char*>(value);  // NOLINT(cppcoreguidelines-pro-type-const-cast)
+  property.value.value.len  = valueLen;
+  properties.length += 1 + 2 + property.value.data.len + 2 + valueLen;
+}
+
+/**
+ * @brief Address (IPv4 mapped to IPv6) and port of a TCP endpoint
+ *
+ * @return    Returns False, if it is no IP address
+ */
+bool endpointOf(const struct sockaddr_storage& address, MqttPublisher::Endpoint& endpoint) {
+  endpoint = MqttPublisher::Endpoint{};
+  if (AF_INET == address.ss_family) {
+    struct sockaddr_in ipv4 {};
+    std::memcpy(&ipv4, &address, sizeof(ipv4));
+    endpoint.address[10] = 0xFF;
+    endpoint.address[11] = 0xFF;
+    std::memcpy(&endpoint.address[12], &ipv4.sin_addr, sizeof(ipv4.sin_addr));
+    endpoint.port = ntohs(ipv4.sin_port);
+    return true;
+  }
+  if (AF_INET6 == address.ss_family) {
+    struct sockaddr_in6 ipv6 {};
+    std::memcpy(&ipv6, &address, sizeof(ipv6));
+    std::memcpy(endpoint.address.data(), &ipv6.sin6_addr, endpoint.address.size());
+    endpoint.port = ntohs(ipv6.sin6_port);
+    return true;
+  }
+  return false;
+}
+
+/**
+ * @brief Host and port of the broker, from an URL like "ssl://host:8883", "ws://[::1]/mqtt" or "host:1883"
+ */
+void brokerHostPort(const std::string& url, std::string& host, std::string& port) {
+  std::size_t scheme = url.find("://");
+  std::string name   = std::string::npos != scheme ? url.substr(0, scheme) : "tcp";
+  std::string rest   = std::string::npos != scheme ? url.substr(scheme + 3) : url;
+  rest               = rest.substr(0, rest.find('/'));
+
+  std::size_t colon = rest.rfind(':');
+  if (!rest.empty() && '[' == rest.front()) {
+    std::size_t bracket = rest.find(']');
+    host                = rest.substr(1, bracket - 1);
+    colon               = rest.find(':', bracket);
+  } else {
+    host = rest.substr(0, colon);
+  }
+  if (std::string::npos != colon) {
+    port = rest.substr(colon + 1);
+  } else if ("ssl" == name || "mqtts" == name) {
+    port = "8883";
+  } else if ("ws" == name) {
+    port = "80";
+  } else if ("wss" == name) {
+    port = "443";
+  } else {
+    port = "1883";
+  }
+}
+
+/**
+ * @brief Disable Nagle's algorithm on the TCP connections of the process to one of the endpoints
+ *
+ * The Paho libraries neither set TCP_NODELAY nor expose their socket, so the sockets are found
+ * by their peer. Connections to other brokers keep their setting, connections of a pool to the
+ * same broker share their options anyway.
+ *
+ * @return    Returns the number of sockets updated
+ */
+int setTcpNoDelay(const std::vector<MqttPublisher::Endpoint>& brokers) {
+  DIR* dir = opendir(FD_DIRECTORY);
+  if (nullptr == dir) {
+    LOG_WARN("Could not list " FD_DIRECTORY ": " << std::strerror(errno));
+    return 0;
+  }
+
+  int updated{0};
+  for (struct dirent* entry = readdir(dir); nullptr != entry; entry = readdir(dir)) {
+    char* end{nullptr};
+    int   fd = static_cast<int>(std::strtol(entry->d_name, &end, 10));
+    if (end == entry->d_name || fd == dirfd(dir)) {
+      continue;
+    }
+
+    // only connected sockets have a peer
+    int                     type{0};
+    socklen_t               len = sizeof(type);
+    struct sockaddr_storage peer {};
+    socklen_t               peerLen = sizeof(peer);
+    MqttPublisher::Endpoint endpoint{};
+    if (0 > getsockopt(fd, SOL_SOCKET, SO_TYPE, &type, &len) || SOCK_STREAM != type ||
+        0 > getpeername(fd, reinterpret_cast<struct sockaddr*>(&peer), &peerLen) ||  // NOLINT
+        !endpointOf(peer, endpoint) || brokers.end() == std::find(brokers.begin(), brokers.end(), endpoint)) {
+      continue;
+    }
+
+    int enable = 1;
+    if (0 == setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &enable, sizeof(enable))) {
+      updated++;
+    }
+  }
+  closedir(dir);
+  return updated;
+}
+
+}  // namespace
+
+MqttPublisher::MqttPublisher(const AppOptions& options) : baseOptions{options} {}
+
+MqttPublisher::~MqttPublisher() { this->stopReconnecting(); }
+
+void MqttPublisher::startReconnecting() {
+  if (!this->reconnectThread.joinable()) {
+    this->reconnectThread = std::thread(&MqttPublisher::reconnectLoop, this);
+  }
+}
+
+void MqttPublisher::connectionEstablished(int topicAliasMaximum) {
+  // the socket of the library is new after every (re)connect, the reconnect thread looks it up
+  if (0 != this->baseOptions.mqttTcpNoDelay) {
+    {
+      std::lock_guard<std::mutex> lock(this->reconnectMutex);
+      this->tcpNoDelayPending = true;
+    }
+    this->reconnectSignal.notify_all();
+  }
+
+  // the publisher thread assigns the aliases again, when it sees the new connection
+  this->brokerTopicAliases.store(std::max(topicAliasMaximum, 0), std::memory_order_relaxed);
+  this->connections.fetch_add(1, std::memory_order_release);
+  if (this->baseOptions.verbosity >= 1 && MQTTVERSION_5 == this->baseOptions.mqttVersion) {
+    LOG_INFO("MQTT broker accepts " << std::max(topicAliasMaximum, 0) << " topic alias(es)");
+  }
+
+  this->isConnected.store(true, std::memory_order_release);
+}
+
+void MqttPublisher::connectionLost() {
+  {
+    std::lock_guard<std::mutex> lock(this->reconnectMutex);
+    this->isConnected.store(false, std::memory_order_release);
+  }
+  this->reconnectSignal.notify_all();
+}
+
+void MqttPublisher::stopReconnecting() {
+  {
+    std::lock_guard<std::mutex> lock(this->reconnectMutex);
+    this->reconnectStopping = true;
+  }
+  this->reconnectSignal.notify_all();
+
+  if (this->reconnectThread.joinable()) {
+    this->reconnectThread.join();
+  }
+}
+
+void MqttPublisher::reconnectLoop() {
+  std::minstd_rand                 random{std::random_device{}()};
+  std::uniform_real_distribution<> jitter(0.8, 1.2);  // so the workers do not reconnect in lockstep
+  const std::chrono::milliseconds  minDelay(this->baseOptions.mqttReconnectMinDelay);
+  const std::chrono::milliseconds  maxDelay(this->baseOptions.mqttReconnectMaxDelay);
+  std::unique_lock<std::mutex>     lock(this->reconnectMutex);
+
+  while (!this->reconnectStopping) {
+    this->reconnectSignal.wait(
+        lock, [this] { return this->reconnectStopping || !this->connected() || this->tcpNoDelayPending; });
+    if (this->tcpNoDelayPending) {
+      this->tcpNoDelayPending = false;
+      lock.unlock();
+      this->applyTcpNoDelay();
+      lock.lock();
+      continue;
+    }
+
+    auto delay = minDelay;
+    while (!this->reconnectStopping && !this->connected()) {
+      auto wait = std::chrono::milliseconds(static_cast<std::chrono::milliseconds::rep>(
+          static_cast<double>(delay.count()) * jitter(random)));
+      if (this->baseOptions.verbosity >= 1) {
+        LOG_INFO("Reconnecting to MQTT broker in " << wait.count() << " ms");
+      }
+      if (this->reconnectSignal.wait_for(lock, wait, [this] { return this->reconnectStopping; })) {
+        break;
+      }
+
+      // connecting blocks, but the connection lost callback must not wait for it
+      lock.unlock();
+      bool success = this->connect();
+      lock.lock();
+
+      if (success) {
+        LOG_INFO("Reconnected to MQTT broker");
+      } else {
+        delay = std::min(delay * 2, maxDelay);
+      }
+    }
+  }
+}
+
+void MqttPublisher::applyTcpNoDelay() {
+  // resolving blocks, so it is done once, unless it failed
+  if (this->brokerEndpoints.empty()) {
+    std::string host{};
+    std::string port{};
+    brokerHostPort(this->baseOptions.mqttUrl, host, port);
+
+    struct addrinfo  hints {};
+    struct addrinfo* result{nullptr};
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags    = AI_NUMERICSERV;
+    int rc            = getaddrinfo(host.c_str(), port.c_str(), &hints, &result);
+    if (0 != rc) {
+      LOG_WARN("Could not resolve the MQTT broker " << host << " to set TCP_NODELAY: " << gai_strerror(rc));
+      return;
+    }
+    for (struct addrinfo* info = result; nullptr != info; info = info->ai_next) {
+      struct sockaddr_storage address {};
+      Endpoint                endpoint{};
+      std::memcpy(&address, info->ai_addr, std::min<std::size_t>(info->ai_addrlen, sizeof(address)));
+      if (endpointOf(address, endpoint)) {
+        this->brokerEndpoints.push_back(endpoint);
+      }
+    }
+    freeaddrinfo(result);
+  }
+
+  if (0 == setTcpNoDelay(this->brokerEndpoints)) {
+    LOG_WARN("Could not find the TCP connection to the MQTT broker to set TCP_NODELAY");
+  }
+}
+
+MQTTProperties MqttPublisher::prepareMessage(const std::string& topic, std::int64_t arrival, Compression encoding,
+                                             const char*& topicName) {
+  MQTTProperties properties = MQTTProperties_initializer;
+  topicName                 = topic.c_str();
+  if (MQTTVERSION_5 != this->baseOptions.mqttVersion) {
+    return properties;
+  }
+  properties.array     = this->propertyBuffer.data();
+  properties.max_count = static_cast<int>(this->propertyBuffer.size());
+
+  // aliases of the previous connection are unknown to the broker
+  const std::uint64_t connection = this->connections.load(std::memory_order_acquire);
+  if (connection != this->aliasConnection) {
+    this->topicAliases.clear();
+    this->aliasConnection = connection;
+    this->aliasLimit =
+        std::min(this->baseOptions.mqttTopicAliases, this->brokerTopicAliases.load(std::memory_order_relaxed));
+  }
+
+  auto alias = this->topicAliases.find(topic);
+  if (this->topicAliases.end() == alias && static_cast<int>(this->topicAliases.size()) < this->aliasLimit) {
+    TopicAlias next{static_cast<std::uint16_t>(this->topicAliases.size() + 1), false};
+    alias = this->topicAliases.emplace(topic, next).first;
+  }
+  if (this->topicAliases.end() != alias) {
+    // the first message sets the alias, the following ones leave out the topic
+    if (alias->second.announced) {
+      topicName = "";
+    }
+    alias->second.announced = true;
+    addTopicAlias(properties, alias->second.alias);
+  }
+
+  if (!this->baseOptions.latencyProbeProperty.empty() && 0 != arrival) {
+    int length = std::snprintf(this->arrivalValue.data(), this->arrivalValue.size(), "%lld",
+                               static_cast<long long>(arrival));  // NOLINT(google-runtime-int)
+    addUserProperty(properties, this->baseOptions.latencyProbeProperty.c_str(), this->arrivalValue.data(), length);
+  }
+
+  if (Compression::None != encoding) {
+    const char* value = (Compression::Lz4 == encoding) ? ENCODING_LZ4 : ENCODING_ZSTD;
+    addUserProperty(properties, ENCODING_PROPERTY, value, static_cast<int>(std::strlen(value)));
+  }
+  return properties;
+}
+
+void MqttPublisher::messageFailed(const std::string& topic) {
+  auto alias = this->topicAliases.find(topic);
+  if (this->topicAliases.end() != alias) {
+    alias->second.announced = false;
+  }
+}
@@ -0,0 +1,191 @@
+/**
+ * @file      MqttPublisher.h
+ * @brief     Interface of the MQTT client backends
+ *
+ * Two backends are available, one on top of the synchronous Paho client (MQTTClient) and one
+ * on top of the asynchronous Paho client (MQTTAsync). The backend is selected at compile time
+ * with the CMake option UDPMQTTGW_MQTT_ASYNC.
+ *
+ * @copyright (c) consider it GmbH, 2020
+ */
+
+#ifndef _MQTTPUBLISHER_H
+#define _MQTTPUBLISHER_H
+
+#include <array>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include <MQTTProperties.h>
+
+#include "AppOptions.h"
+#include "Stats.h"
+
+/**
+ * @brief MQTT connection of one worker, which reconnects automatically
+ *
+ * When a backend reports a lost connection, a background thread reconnects with exponential
+ * backoff (MqttReconnectMinDelay up to MqttReconnectMaxDelay). In the meantime, connected()
+ * returns False, so the caller can buffer its messages instead of failing them one by one.
+ *
+ * With MQTT v5, every topic gets a topic alias the first time it is published, as far as the
+ * broker allows (Topic Alias Maximum in CONNACK, up to MqttTopicAliases). Later messages only
+ * carry the 2 byte alias instead of the topic. The aliases are only valid for one connection and
+ * are assigned again after reconnecting.
+ */
+class MqttPublisher {
+public:
+  /**
+   * @brief Address (IPv4 mapped to IPv6) and port of the broker, to find its TCP connections
+   */
+  struct Endpoint {
+    std::array<std::uint8_t, 16> address{};
+    std::uint16_t                port{0};
+
+    bool operator==(const Endpoint& other) const { return this->address == other.address && this->port == other.port; }
+  };
+
+  explicit MqttPublisher(const AppOptions& options);
+  MqttPublisher(const MqttPublisher&) = delete;
+  MqttPublisher& operator=(const MqttPublisher&) = delete;
+  MqttPublisher(MqttPublisher&&)                 = delete;
+  MqttPublisher& operator=(MqttPublisher&&) = delete;
+  virtual ~MqttPublisher();
+
+  /**
+   * @brief Connect to the MQTT broker, blocks until the connection is established or has failed
+   *
+   * Backends have to call connectionEstablished() on success.
+   *
+   * @return    Returns False, if the connection could not be established
+   */
+  virtual bool connect() = 0;
+
+  /**
+   * @brief Hand a message over to the MQTT library, without waiting for the acknowledgement
+   *
+   * The MQTT library takes a copy of the payload, so the buffer can be reused after returning.
+   * MQTTClient writes QoS 0 messages to the socket right from the buffer and only copies QoS>0
+   * messages for their retransmission, MQTTAsync copies every message into its command queue.
+   * Neither takes over a foreign buffer, so keeping the packet until the delivery callback would
+   * only tie up the pool without saving a copy.
+   * Failures are reported by the backend itself. Deliveries and failures after the hand over
+   * are counted in the worker statistics by the backend.
+   *
+   * @param arrival   Kernel arrival time of the (first) datagram in ns since the Unix epoch, 0 if unknown
+   * @param encoding  Compression of the payload, marked as MQTT v5 user property
+   * @return          Returns False, if the message could not be published
+   */
+  virtual bool publish(const std::string& topic, const void* payload, int payloadLen, int qos, std::int64_t arrival,
+                       Compression encoding) = 0;
+
+  /**
+   * @brief Returns True, if the connection to the broker is established
+   */
+  bool connected() const { return this->isConnected.load(std::memory_order_acquire); }
+
+  /**
+   * @brief Start the background thread, which reconnects after the connection was lost
+   */
+  void startReconnecting();
+
+  /**
+   * @brief Stop reconnecting and disconnect from the broker, for the shutdown
+   *
+   * The messages handed over before get up to the timeout to be sent and acknowledged.
+   * Backends have to call stopReconnecting() first.
+   */
+  virtual void disconnect(int timeoutMs) = 0;
+
+protected:
+  /**
+   * @brief To be called by the backend, when the connection was established
+   *
+   * @param topicAliasMaximum   Topic Alias Maximum of the broker (MQTT v5 CONNACK), 0 if it does not accept aliases
+   */
+  void connectionEstablished(int topicAliasMaximum = 0);
+
+  /**
+   * @brief To be called by the backend (from any thread), when the connection was lost
+   */
+  void connectionLost();
+
+  /**
+   * @brief Stop the reconnect thread, the backend destructor has to call this first
+   */
+  void stopReconnecting();
+
+  /**
+   * @brief Prepare the topic name and the MQTT v5 properties of a message (publisher thread only)
+   *
+   * The properties are the topic alias and the user properties: the arrival time
+   * (LatencyProbeProperty), if configured and known, and the compression of the payload
+   * (content-encoding), if it is compressed.
+   *
+   * They are written into a buffer of the publisher, which is reused for every message, so none
+   * of this is allocated per message. The properties stay valid until the next call, the MQTT
+   * library copies what it keeps.
+   *
+   * @param topicName   Set to the topic name to publish with, empty if the broker knows the alias already
+   * @return            Properties of the message, empty for MQTT versions before 5
+   */
+  MQTTProperties prepareMessage(const std::string& topic, std::int64_t arrival, Compression encoding,
+                                const char*& topicName);
+
+  /**
+   * @brief To be called by the backend, when a prepared message could not be handed over
+   *
+   * The broker did not learn the alias of the topic then, so the next message carries the topic again.
+   */
+  void messageFailed(const std::string& topic);
+
+private:
+  struct TopicAlias {
+    std::uint16_t alias;
+    bool          announced;  // a message with topic and alias was handed over on this connection
+  };
+
+  const AppOptions&          baseOptions;
+  std::atomic<bool>          isConnected{false};
+  std::thread                reconnectThread;
+  std::mutex                 reconnectMutex;
+  std::condition_variable    reconnectSignal;
+  bool                       reconnectStopping{false};
+  bool                       tcpNoDelayPending{false};  // set TCP_NODELAY on the new connection (reconnectMutex)
+  std::vector<Endpoint>      brokerEndpoints{};         // resolved once, for TCP_NODELAY (reconnect thread only)
+  std::atomic<int>           brokerTopicAliases{0};     // Topic Alias Maximum of the current connection
+  std::atomic<std::uint64_t> connections{0};            // established connections so far
+
+  // publisher thread only
+  std::array<char, 24>                        arrivalValue{};      // value of the arrival property
+  std::array<MQTTProperty, 3>                 propertyBuffer{};    // topic alias, arrival, encoding
+  std::unordered_map<std::string, TopicAlias> topicAliases{};
+  std::uint64_t                               aliasConnection{0};  // connection the aliases belong to
+  int                                         aliasLimit{0};
+
+  void reconnectLoop();
+
+  /**
+   * @brief Set TCP_NODELAY on the connections to the broker (reconnect thread only)
+   */
+  void applyTcpNoDelay();
+};
+
+/**
+ * @brief Create the MQTT client backend selected at compile time
+ *
+ * @param options   Application configuration
+ * @param clientID  MQTT client ID of this connection
+ * @param stats     Statistics of the worker using this connection
+ */
+std::unique_ptr<MqttPublisher> createMqttPublisher(const AppOptions& options, const std::string& clientID,
+                                                   WorkerStats& stats);
+
+#endif /* _MQTTPUBLISHER_H */
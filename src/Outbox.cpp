@@ -0,0 +1,89 @@
+/**
+ * @file      Outbox.cpp
+ * @brief     Publishing of MQTT messages, which buffers them while the broker is unreachable
+ *
+ * @copyright (c) consider it GmbH, 2020
+ */
+
+#include "Outbox.h"
+
+#include <algorithm>
+
+#include "Log.h"
+
+// static configuration values
+#define REPLAY_BURST_FRACTION 0.1  // seconds of the replay rate, which can be published at once
+
+Outbox::Outbox(const AppOptions& options, int worker, MqttPublisher& publisher, WorkerStats& stats) :
+    options{options},
+    publisher{publisher},
+    stats{stats},
+    spill{options, worker, stats},
+    compressor{options},
+    replayRate{static_cast<double>(options.spillReplayRate)},
+    replayBurst{static_cast<double>(options.spillReplayRate) * REPLAY_BURST_FRACTION + 1} {}
+
+bool Outbox::send(const std::string& topic, const char* payload, int payloadLen, Compression compression,
+                  Clock::time_point received, std::int64_t arrival, int qos) {
+  Compression encoding{Compression::None};
+  const char* compressed{nullptr};
+  int         compressedLen{0};
+  if (Compression::None != compression &&
+      this->compressor.compress(compression, payload, payloadLen, compressed, compressedLen) &&
+      (compressedLen < payloadLen || MQTTVERSION_5 != this->options.mqttVersion)) {
+    this->stats.compressedInput.add(static_cast<std::uint64_t>(payloadLen));
+    this->stats.compressedOutput.add(static_cast<std::uint64_t>(compressedLen));
+    encoding   = compression;
+    payload    = compressed;
+    payloadLen = compressedLen;
+  }
+
+  if (this->publisher.connected()) {
+    if (this->publisher.publish(topic, payload, payloadLen, qos, arrival, encoding)) {
+      this->stats.published.add();
+      this->stats.queueLatency.record(Clock::now() - received);
+      return true;
+    }
+
+    // a full send queue is back pressure and dropped as before, only outages are buffered
+    if (this->publisher.connected()) {
+      this->stats.publishFailures.add();
+      return false;
+    }
+  }
+
+  this->spill.push(topic, payload, payloadLen, arrival, encoding, qos);
+  return false;
+}
+
+void Outbox::replay(Clock::time_point now) {
+  if (this->spill.empty() || !this->publisher.connected()) {
+    this->lastReplay = now;
+    return;
+  }
+
+  std::chrono::duration<double> elapsed = now - this->lastReplay;
+  this->replayTokens = std::min(this->replayBurst, this->replayTokens + elapsed.count() * this->replayRate);
+  this->lastReplay   = now;
+
+  const char*  payload{nullptr};
+  int          payloadLen{0};
+  std::int64_t arrival{0};
+  Compression  encoding{Compression::None};
+  int          qos{0};
+  while (this->replayTokens >= 1 &&
+         this->spill.front(this->replayTopic, payload, payloadLen, arrival, encoding, qos)) {
+    // a failed message stays in front, it is retried with the next replay
+    if (!this->publisher.publish(this->replayTopic, payload, payloadLen, qos, arrival, encoding)) {
+      break;
+    }
+    this->spill.pop();
+    this->replayTokens -= 1;
+    this->stats.published.add();
+    this->stats.replayed.add();
+  }
+
+  if (this->spill.empty() && this->options.verbosity >= 1) {
+    LOG_INFO("Replayed all buffered messages");
+  }
+}
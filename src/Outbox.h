@@ -0,0 +1,91 @@
+/**
+ * @file      Outbox.h
+ * @brief     Publishing of MQTT messages, which buffers them while the broker is unreachable
+ *
+ * @copyright (c) consider it GmbH, 2020
+ */
+
+#ifndef _OUTBOX_H
+#define _OUTBOX_H
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+#include "AppOptions.h"
+#include "Compressor.h"
+#include "MqttPublisher.h"
+#include "SpillQueue.h"
+#include "Stats.h"
+
+/**
+ * @brief Publishes messages directly while connected, and spills them while the connection is down
+ *
+ * After reconnecting, the buffered messages are replayed with at most SpillReplayRate messages
+ * per second, so the broker is not flooded. New messages are published directly in the meantime,
+ * so they can overtake the buffered ones.
+ *
+ * Payloads of compressed routes are compressed before they are published or buffered. With
+ * MQTT v5, payloads which do not get smaller are published uncompressed, the others are marked
+ * with the user property content-encoding. Without v5, the consumers rely on the configuration,
+ * so these payloads are always compressed.
+ *
+ * An outbox is not thread-safe, it is meant to be used by the publisher thread only.
+ */
+class Outbox {
+public:
+  using Clock = std::chrono::steady_clock;
+
+  /**
+   * @param options   Application configuration
+   * @param worker    Number of the worker, to name its spill files
+   * @param publisher MQTT connection to publish to
+   * @param stats     Statistics of this worker
+   */
+  Outbox(const AppOptions& options, int worker, MqttPublisher& publisher, WorkerStats& stats);
+
+  Outbox(const Outbox&) = delete;
+  Outbox& operator=(const Outbox&) = delete;
+  Outbox(Outbox&&)                 = delete;
+  Outbox& operator=(Outbox&&) = delete;
+  ~Outbox()                   = default;
+
+  /**
+   * @brief Publish a message or buffer it, if the connection to the broker is down
+   *
+   * @param compression  Compression of the route of the (first) datagram
+   * @param received     Reception time of the (first) datagram of the message
+   * @param arrival      Kernel arrival time of the (first) datagram, see MqttPublisher::publish()
+   * @param qos          QoS level to publish with, also when the message is replayed
+   * @return             Returns True, if the message was handed over to the MQTT library
+   */
+  bool send(const std::string& topic, const char* payload, int payloadLen, Compression compression,
+            Clock::time_point received, std::int64_t arrival, int qos);
+
+  /**
+   * @brief Publish buffered messages, as far as the connection and the replay rate allow
+   */
+  void replay(Clock::time_point now);
+
+  /**
+   * @brief Returns True, if messages are waiting for the replay
+   */
+  bool backlog() const { return !this->spill.empty(); }
+
+private:
+  const AppOptions& options;
+  MqttPublisher&    publisher;
+  WorkerStats&      stats;
+  SpillQueue        spill;
+  Compressor        compressor;
+
+  // token bucket of the replay rate
+  const double      replayRate;   // messages per second
+  const double      replayBurst;  // messages
+  double            replayTokens{0};
+  Clock::time_point lastReplay{};
+
+  std::string replayTopic;  // buffer of the topic of the replayed message
+};
+
+#endif /* _OUTBOX_H */
@@ -0,0 +1,150 @@
+/**
+ * @file      Packet.h
+ * @brief     Received UDP datagram and the pool of preallocated packet buffers
+ *
+ * @copyright (c) consider it GmbH, 2020
+ */
+
+#ifndef _PACKET_H
+#define _PACKET_H
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <netinet/in.h>
+
+#include "AppOptions.h"
+
+/**
+ * @brief One received UDP datagram, the payload buffer is owned by the PacketPool
+ *
+ * recvmmsg writes the datagram directly into the buffer and it is handed to the MQTT library
+ * from there, the gateway itself never copies an uncoalesced payload. The packet goes back to
+ * the pool right after publishing, see MqttPublisher::publish() for why it is not kept until
+ * the delivery is complete.
+ *
+ * With fan-out to several brokers, one packet is queued to a lane of every broker. It is not
+ * modified then, only counted, and goes back to the pool, when the last lane released it.
+ */
+struct Packet {
+  char*               data{nullptr};   // start of the buffer, capacity is PacketPool::bufferSize()
+  int                 len{0};          // length of the payload
+  struct sockaddr_in6 source {};       // sender of the datagram (a sockaddr_in on IPv4 sockets), see IpAddress
+  const std::string*  topic{nullptr};  // MQTT topic to publish to
+  std::string         topicBuffer{};   // storage for topics, which are not cached by the TopicRouter
+
+  std::chrono::steady_clock::time_point received{};  // when the datagram was fetched from the socket
+  std::int64_t                          arrival{0};  // kernel arrival, ns since the Unix epoch (LatencyProbe only)
+
+  std::uint32_t index{0};                          // position in the pool
+  std::uint32_t route{0};                          // index of the route (socket), which received the datagram
+  Compression   compression{Compression::None};    // of the route, when the datagram was received
+  std::int8_t   qos{-1};                           // of the route, -1: MqttQosLevel of the broker
+  RoutePriority priority{RoutePriority::Normal};   // of the route
+
+  std::atomic<std::uint32_t> references{1};  // lanes, which still have to release the packet
+
+  // links in a queue of the FairQueue of each broker (publisher thread of the lane only)
+  std::array<Packet*, MQTT_TARGETS_LIMIT> next{};
+};
+
+/**
+ * @brief Fixed number of packets with their payload buffers, allocated once at startup
+ *
+ * The free packets are kept on a lock-free stack, so packets can be acquired and released
+ * from any thread without taking a lock or allocating memory.
+ *
+ * The buffers can have a headroom in front of Packet::data, where the io_uring receiver lets the
+ * kernel put its header of the datagram.
+ */
+class PacketPool {
+public:
+  PacketPool(std::size_t count, std::size_t bufferSize, std::size_t headroom = 0) :
+      bufSize{bufferSize},
+      storage(count * (headroom + bufferSize)),
+      packets(count),
+      next{new std::atomic<std::uint32_t>[count]} {  // NOLINT(cppcoreguidelines-avoid-c-arrays)
+    for (std::size_t i = 0; i < count; i++) {
+      this->packets[i].data  = this->storage.data() + i * (headroom + bufferSize) + headroom;
+      this->packets[i].index = static_cast<std::uint32_t>(i);
+      this->next[i].store(static_cast<std::uint32_t>(i + 2 <= count ? i + 2 : 0));  // link all packets
+    }
+    this->head.store(count > 0 ? 1 : 0);
+  }
+
+  PacketPool(const PacketPool&) = delete;
+  PacketPool& operator=(const PacketPool&) = delete;
+  PacketPool(PacketPool&&)                 = delete;
+  PacketPool& operator=(PacketPool&&) = delete;
+  ~PacketPool()                       = default;
+
+  /**
+   * @brief Take a free packet from the pool
+   *
+   * @return    Returns nullptr, if all packets are in use
+   */
+  Packet* acquire() {
+    std::uint64_t oldHead = this->head.load(std::memory_order_acquire);
+    while (true) {
+      std::uint32_t link = linkOf(oldHead);
+      if (0 == link) {
+        return nullptr;
+      }
+
+      std::uint64_t newHead = makeHead(oldHead, this->next[link - 1].load(std::memory_order_relaxed));
+      if (this->head.compare_exchange_weak(oldHead, newHead, std::memory_order_acq_rel, std::memory_order_acquire)) {
+        Packet* packet = &this->packets[link - 1];
+        packet->len    = 0;
+        packet->references.store(1, std::memory_order_relaxed);
+        return packet;
+      }
+    }
+  }
+
+  /**
+   * @brief Give a packet back to the pool, if this was the last reference to it
+   */
+  void release(Packet* packet) {
+    if (1 != packet->references.load(std::memory_order_acquire) &&
+        1 != packet->references.fetch_sub(1, std::memory_order_acq_rel)) {
+      return;
+    }
+
+    std::uint64_t oldHead = this->head.load(std::memory_order_relaxed);
+    while (true) {
+      this->next[packet->index].store(linkOf(oldHead), std::memory_order_relaxed);
+
+      std::uint64_t newHead = makeHead(oldHead, packet->index + 1);
+      if (this->head.compare_exchange_weak(oldHead, newHead, std::memory_order_release, std::memory_order_relaxed)) {
+        return;
+      }
+    }
+  }
+
+  std::size_t bufferSize() const { return this->bufSize; }
+  std::size_t size() const { return this->packets.size(); }
+
+private:
+  const std::size_t   bufSize;
+  std::vector<char>   storage;
+  std::vector<Packet> packets;
+
+  // links are the packet index + 1, so 0 marks the end of the stack
+  std::unique_ptr<std::atomic<std::uint32_t>[]> next;  // NOLINT(cppcoreguidelines-avoid-c-arrays,modernize-avoid-c-arrays)
+
+  // upper 32 bit: modification counter against the ABA problem, lower 32 bit: link to the first free packet
+  std::atomic<std::uint64_t> head{0};
+
+  static std::uint32_t linkOf(std::uint64_t head) { return static_cast<std::uint32_t>(head); }
+  static std::uint64_t makeHead(std::uint64_t oldHead, std::uint32_t link) {
+    return (((oldHead >> 32U) + 1) << 32U) | link;
+  }
+};
+
+#endif /* _PACKET_H */
@@ -0,0 +1,78 @@
+/**
+ * @file      PayloadFilter.cpp
+ * @brief     Validation of the received datagrams, before they are published
+ *
+ * @copyright (c) consider it GmbH, 2020
+ */
+
+#include "PayloadFilter.h"
+
+#include <cstdint>
+#include <cstring>
+#include <limits>
+
+#include <arpa/inet.h>
+
+#include "Checksum.h"
+
+// static configuration values
+#define CHECKSUM_SIZE 4  // bytes of the trailer
+
+PayloadFilter::PayloadFilter(const AppOptions& options) :
+    filters(options.payloadFilters.size()),
+    routes(options.routes.size()) {
+  for (std::size_t i = 0; i < this->filters.size(); i++) {
+    const auto& filterOpts = options.payloadFilters[i];
+    auto&       filter     = this->filters[i];
+
+    filter.minLength   = static_cast<std::size_t>(filterOpts.minLength);
+    filter.maxLength   = 0 != filterOpts.maxLength ? static_cast<std::size_t>(filterOpts.maxLength)
+                                                   : std::numeric_limits<std::size_t>::max();
+    filter.magic       = filterOpts.magic;
+    filter.magicOffset = static_cast<std::size_t>(filterOpts.magicOffset);
+    filter.checksum    = filterOpts.checksum;
+    filter.typeOffset  = static_cast<std::size_t>(filterOpts.typeOffset);
+    for (char type : filterOpts.dropTypes) {
+      filter.dropTypes.set(static_cast<unsigned char>(type));
+    }
+
+    for (std::size_t route = 0; route < options.routes.size(); route++) {
+      if (0 == filterOpts.port || options.routes[route].port == filterOpts.port) {
+        this->routes[route].push_back(&filter);
+      }
+    }
+  }
+}
+
+FilterVerdict PayloadFilter::check(std::size_t route, const Packet& packet) const {
+  const auto* data = reinterpret_cast<const unsigned char*>(packet.data);  // NOLINT
+  const auto  len  = static_cast<std::size_t>(packet.len);
+
+  for (const Filter* filter : this->routes[route]) {
+    if (len < filter->minLength || len > filter->maxLength) {
+      return FilterVerdict::Length;
+    }
+    if (filter->dropTypes.any() && (len <= filter->typeOffset || filter->dropTypes.test(data[filter->typeOffset]))) {
+      return FilterVerdict::Type;
+    }
+    if (!filter->magic.empty() && (len < filter->magicOffset + filter->magic.size() ||
+                                   0 != std::memcmp(data + filter->magicOffset, filter->magic.data(),
+                                                    filter->magic.size()))) {
+      return FilterVerdict::Magic;
+    }
+
+    if (ChecksumType::None != filter->checksum) {
+      if (len < CHECKSUM_SIZE) {
+        return FilterVerdict::Checksum;
+      }
+      std::uint32_t expected{0};
+      std::memcpy(&expected, data + len - CHECKSUM_SIZE, CHECKSUM_SIZE);
+      std::uint32_t actual = ChecksumType::Crc32c == filter->checksum ? Crc32::castagnoli(data, len - CHECKSUM_SIZE)
+                                                                        : Crc32::ieee(data, len - CHECKSUM_SIZE);
+      if (actual != ntohl(expected)) {
+        return FilterVerdict::Checksum;
+      }
+    }
+  }
+  return FilterVerdict::Pass;
+}
@@ -0,0 +1,78 @@
+/**
+ * @file      PayloadFilter.h
+ * @brief     Validation of the received datagrams, before they are published
+ *
+ * @copyright (c) consider it GmbH, 2020
+ */
+
+#ifndef _PAYLOADFILTER_H
+#define _PAYLOADFILTER_H
+
+#include <bitset>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#include "AppOptions.h"
+#include "Packet.h"
+
+/**
+ * @brief Why a datagram was dropped by the payload filters
+ */
+enum class FilterVerdict {
+  Pass,
+  Length,    // shorter than minlen or longer than maxlen
+  Type,      // message type in droptypes or too short to have one
+  Magic,     // the magic bytes do not match
+  Checksum,  // the CRC of the trailer does not match
+};
+
+/**
+ * @brief Payload filters of the configuration, compiled per route
+ *
+ * The checks of a filter run from the cheapest to the most expensive one, so malformed or
+ * irrelevant datagrams are dropped with a few comparisons: the length, then the message type
+ * (a bitset lookup), the magic bytes (memcmp) and at last the checksum (see Crc32). Datagrams,
+ * which are too short for a check, fail it.
+ *
+ * A filter holds no state per datagram, it is rebuilt from each reloaded configuration.
+ */
+class PayloadFilter {
+public:
+  explicit PayloadFilter(const AppOptions& options);
+
+  PayloadFilter(const PayloadFilter&) = delete;
+  PayloadFilter& operator=(const PayloadFilter&) = delete;
+  PayloadFilter(PayloadFilter&&)                 = delete;
+  PayloadFilter& operator=(PayloadFilter&&) = delete;
+  ~PayloadFilter()                          = default;
+
+  /**
+   * @brief Returns True, if any filter is configured
+   */
+  bool enabled() const { return !this->filters.empty(); }
+
+  /**
+   * @brief Run the filters of the route on a received datagram
+   *
+   * @param route   Index of the route (socket), which received the packet
+   * @return        Returns Pass, if the datagram passed all filters, otherwise the check it failed
+   */
+  FilterVerdict check(std::size_t route, const Packet& packet) const;
+
+private:
+  struct Filter {
+    std::size_t      minLength;
+    std::size_t      maxLength;
+    std::string      magic;
+    std::size_t      magicOffset;
+    ChecksumType     checksum;
+    std::bitset<256> dropTypes;
+    std::size_t      typeOffset;
+  };
+
+  std::vector<Filter>                     filters;
+  std::vector<std::vector<const Filter*>> routes;  // filters of each route, index is the route
+};
+
+#endif /* _PAYLOADFILTER_H */
@@ -0,0 +1,585 @@
+/**
+ * @file      Pipeline.cpp
+ * @brief     Two-stage pipeline of a receiver thread and publisher threads
+ *
+ * @copyright (c) consider it GmbH, 2020
+ */
+
+#include "Pipeline.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <utility>
+
+#include <thread>
+
+#include <pthread.h>
+#include <sched.h>
+#include <sys/epoll.h>
+#include <unistd.h>
+
+#include "Hash.h"
+#include "IpAddress.h"
+#include "Log.h"
+
+// static configuration values
+#define QUEUE_WAIT_TIMEOUT std::chrono::milliseconds(100)
+#define DROP_REPORT_INTERVAL std::chrono::seconds(1)
+#define DRAIN_POLL_INTERVAL std::chrono::milliseconds(10)
+#define WAKEUP_SIGNAL SIGUSR1  // interrupts the blocking calls of the receiver thread, to stop it
+
+namespace {
+
+/**
+ * @brief Packets can be in the rings and fair queues of the lanes, one at each publisher, and in the receive batch or
+ * the io_uring buffer ring
+ */
+std::size_t poolSize(const AppOptions& options, std::size_t lanes) {
+  std::size_t size = (PublishLane::capacity(options) + 1) * lanes + options.udpBatchSize;
+  if (0 != options.udpIoUring) {
+    size += static_cast<std::size_t>(options.udpIoUringBuffers);
+  }
+  return size;
+}
+
+/**
+ * @brief Space for the header of the kernel in front of each packet
+ */
+std::size_t poolHeadroom(const AppOptions& options) {
+#ifdef UDPMQTTGW_IO_URING
+  if (0 != options.udpIoUring) {
+    return UringReceiver::headroom(options.latencyProbe);
+  }
+#else
+  (void)options;
+#endif
+  return 0;
+}
+
+void onWakeup(int /*signum*/) {}
+
+}  // namespace
+
+Pipeline::Pipeline(const AppOptions& options, ConfigStore& config, int worker, std::vector<int> sockets,
+                   const std::vector<PublishTarget>& targets, WorkerStats& stats, Deduplicator& dedup, int cpu,
+                   int receiverCpu) :
+    options{options},
+    config{config},
+    sockets{std::move(sockets)},
+    stats{stats},
+    dedup{dedup},
+    cpu{cpu},
+    receiverCpu{receiverCpu},
+    pool{poolSize(options, targets.size() * targets.front().publishers.size()),
+         static_cast<std::size_t>(options.udpMaxDatagramSize), poolHeadroom(options)},
+    receiver{options.udpBatchSize, static_cast<std::size_t>(options.udpMaxDatagramSize), stats, options.latencyProbe},
+#ifdef UDPMQTTGW_IO_URING
+    uring{options, pool, stats},
+#endif
+    limiter{options},
+    capture{options, worker},
+    targets{targets.size()},
+    connections{targets.front().publishers.size()},
+    snapshot{config.current()},
+    snapshotGeneration{config.generation()},
+    router{new TopicRouter(*snapshot)},
+    filter{new PayloadFilter(*snapshot)},
+    batch(options.udpBatchSize, nullptr),
+    spinTime{options.udpSpinTime} {
+  // the spill files are numbered over all lanes, so they stay the same as before with one connection per worker,
+  // the lanes of the additional brokers follow the ones of MqttUrl
+  for (std::size_t target = 0; target < this->targets; target++) {
+    for (std::size_t i = 0; i < this->connections; i++) {
+      int lane = (static_cast<int>(target) * options.workers + worker) * static_cast<int>(this->connections) +
+                 static_cast<int>(i);
+      this->lanes.emplace_back(new PublishLane(*targets[target].options, target, lane, *targets[target].publishers[i],
+                                               stats, this->pool));
+    }
+  }
+}
+
+void Pipeline::start() {
+  // the handler does nothing, the blocking calls just return with EINTR, as they are not restarted (SA_RESTART)
+  struct sigaction wakeup {};
+  wakeup.sa_handler = onWakeup;
+  sigaction(WAKEUP_SIGNAL, &wakeup, nullptr);
+
+  this->receiving.store(true);
+  this->receiveThread = std::thread([this]() {
+    this->receiveLoop();
+    this->receiving.store(false);
+  });
+  for (auto& lane : this->lanes) {
+    this->publishThreads.emplace_back(&PublishLane::run, lane.get());
+  }
+
+  if (this->receiverCpu >= 0) {
+    pinThread(this->receiveThread, this->receiverCpu);
+  } else if (this->cpu >= 0) {
+    pinThread(this->receiveThread, this->cpu);
+  }
+  if (this->cpu >= 0) {
+    for (auto& thread : this->publishThreads) {
+      pinThread(thread, this->cpu);
+    }
+  }
+  if (0 != this->options.receiverPriority) {
+    this->setReceiverPriority();
+  }
+}
+
+void Pipeline::pinThread(std::thread& thread, int cpu) {
+  cpu_set_t cpuSet;
+  CPU_ZERO(&cpuSet);
+  CPU_SET(cpu, &cpuSet);  // NOLINT(hicpp-signed-bitwise)
+
+  int rc = pthread_setaffinity_np(thread.native_handle(), sizeof(cpuSet), &cpuSet);
+  if (0 != rc) {
+    LOG_WARN("Could not pin thread to CPU " << cpu << ": " << std::strerror(rc));
+  }
+}
+
+void Pipeline::setReceiverPriority() {
+  // real-time scheduling needs CAP_SYS_NICE or an RLIMIT_RTPRIO, the receiver keeps working without it
+  struct sched_param param {};
+  param.sched_priority = this->options.receiverPriority;
+
+  int rc = pthread_setschedparam(this->receiveThread.native_handle(), SCHED_FIFO, &param);
+  if (0 != rc) {
+    LOG_WARN("Could not set SCHED_FIFO priority " << param.sched_priority
+             << " of the receiver thread: " << std::strerror(rc));
+  }
+}
+
+void Pipeline::join() {
+  if (this->receiveThread.joinable()) {
+    this->receiveThread.join();
+  }
+  for (auto& thread : this->publishThreads) {
+    if (thread.joinable()) {
+      thread.join();
+    }
+  }
+}
+
+void Pipeline::stopReceiving() {
+  // the signal can arrive, before the thread blocks again, so it is repeated until the thread returned
+  this->stopping.store(true);
+  while (this->receiving.load()) {
+    pthread_kill(this->receiveThread.native_handle(), WAKEUP_SIGNAL);
+    std::this_thread::sleep_for(DRAIN_POLL_INTERVAL);
+  }
+  if (this->receiveThread.joinable()) {
+    this->receiveThread.join();
+  }
+  this->capture.close();
+}
+
+bool Pipeline::waitForReplay() {
+  if (this->receiveThread.joinable()) {
+    this->receiveThread.join();
+  }
+  return this->replayed.load();
+}
+
+void Pipeline::receiveLoop() {
+  if (!this->options.replayFile.empty()) {
+    this->replayLoop();
+    return;
+  }
+
+#ifdef UDPMQTTGW_IO_URING
+  // io_uring serves all sockets at once, while datagrams keep arriving without system calls
+  if (0 != this->options.udpIoUring) {
+    if (this->uring.start(this->sockets)) {
+      while (!this->stopping.load(std::memory_order_relaxed)) {
+        this->receiveUring(!this->spinning());
+      }
+      return;
+    }
+    LOG_WARN("Receiving with recvmmsg instead of io_uring");
+  }
+#endif
+
+  // a single socket is read with blocking calls, multiple sockets are multiplexed with epoll
+  // with UdpSpinTime, the thread keeps polling without blocking for a while after each datagram,
+  // so the next one does not have to wait for the wakeup of the thread
+  if (1 == this->sockets.size()) {
+    while (!this->stopping.load(std::memory_order_relaxed)) {
+      this->receiveFrom(0, !this->spinning());
+    }
+    return;
+  }
+
+  int epollfd = epoll_create1(0);
+  if (0 > epollfd) {
+    LOG_ERROR("Could not create epoll instance: " << std::strerror(errno));
+    return;
+  }
+  for (std::size_t route = 0; route < this->sockets.size(); route++) {
+    struct epoll_event event {};
+    event.events   = EPOLLIN;
+    event.data.u32 = static_cast<std::uint32_t>(route);
+    if (0 > epoll_ctl(epollfd, EPOLL_CTL_ADD, this->sockets[route], &event)) {
+      LOG_ERROR("Could not add UDP socket to epoll: " << std::strerror(errno));
+      close(epollfd);
+      return;
+    }
+  }
+
+  std::vector<struct epoll_event> events(this->sockets.size());
+  while (!this->stopping.load(std::memory_order_relaxed)) {
+    int ready = epoll_wait(epollfd, events.data(), static_cast<int>(events.size()), this->spinning() ? 0 : -1);
+    if (0 > ready && EINTR != errno) {
+      LOG_ERROR("Failed to wait for UDP datagrams: " << std::strerror(errno));
+    }
+
+    for (int i = 0; i < ready; i++) {
+      this->receiveFrom(events[i].data.u32, false);
+    }
+  }
+  close(epollfd);
+}
+
+bool Pipeline::spinning() const {
+  return 0 != this->spinTime.count() && std::chrono::steady_clock::now() - this->lastReceived < this->spinTime;
+}
+
+int Pipeline::receiveFrom(std::size_t route, bool blocking) {
+  while (this->batchFilled < this->options.udpBatchSize) {
+    Packet* packet = this->pool.acquire();
+    if (nullptr == packet) {
+      break;
+    }
+    this->batch[this->batchFilled++] = packet;
+  }
+  if (0 == this->batchFilled) {
+    this->waitForPackets();
+    return 0;
+  }
+
+  // fetch new UDP packets
+  int count = this->receiver.receive(this->sockets[route], blocking, this->batch.data(), this->batchFilled);
+
+  if (0 != count && this->options.verbosity >= 2) {
+    LOG_DEBUG("Got " << count << " new message(s) on UDP port " << this->options.routes[route].port);
+  }
+  for (int i = 0; i < count; i++) {
+    this->batch[i]->route = static_cast<std::uint32_t>(route);
+  }
+  this->dispatch(this->batch.data(), count);
+
+  // keep the unused packets for the next batch
+  std::copy(this->batch.begin() + count, this->batch.begin() + this->batchFilled, this->batch.begin());
+  this->batchFilled -= count;
+  return count;
+}
+
+#ifdef UDPMQTTGW_IO_URING
+void Pipeline::receiveUring(bool blocking) {
+  int count = this->uring.receive(blocking, this->batch.data(), static_cast<int>(this->batch.size()));
+  if (0 == count && this->uring.starved()) {
+    this->waitForPackets();
+  }
+
+  if (0 != count && this->options.verbosity >= 2) {
+    LOG_DEBUG("Got " << count << " new message(s) from io_uring");
+  }
+  this->dispatch(this->batch.data(), count);
+}
+#endif
+
+void Pipeline::replayLoop() {
+  CaptureReader reader;
+  if (!reader.open(this->options.replayFile)) {
+    return;
+  }
+
+  const auto    start = std::chrono::steady_clock::now();
+  std::int64_t  first{0};
+  std::uint64_t count{0};
+  std::uint64_t skipped{0};
+  int           filled{0};
+
+  const CaptureRecord* record{nullptr};
+  const char*          payload{nullptr};
+  while (reader.next(record, payload)) {
+    // the datagrams of UDP ports without a route in this configuration are left out
+    std::size_t route{0};
+    while (route < this->options.routes.size() && this->options.routes[route].port != record->port) {
+      route++;
+    }
+    if (route == this->options.routes.size()) {
+      skipped++;
+      continue;
+    }
+    if (record->length > this->pool.bufferSize()) {
+      this->stats.truncated.add();
+      continue;
+    }
+
+    // the time is taken from the start of the replay, so oversleeping does not add up
+    if (0 != this->options.replaySpeed) {
+      if (0 == first) {
+        first = record->timestamp;
+      }
+      auto due = start + std::chrono::nanoseconds(static_cast<std::int64_t>(
+                             static_cast<double>(record->timestamp - first) / this->options.replaySpeed));
+      if (due > std::chrono::steady_clock::now()) {
+        this->dispatch(this->batch.data(), filled);
+        filled = 0;
+        std::this_thread::sleep_until(due);
+      }
+    }
+
+    Packet* packet = this->pool.acquire();
+    while (nullptr == packet) {
+      this->dispatch(this->batch.data(), filled);
+      filled = 0;
+      this->waitForPackets();
+      packet = this->pool.acquire();
+    }
+
+    struct sockaddr_storage source {};
+    IpAddress::fromBytes(record->source).toSockaddr(source, record->sourcePort);
+    std::memcpy(&packet->source, &source, sizeof(packet->source));
+    std::memcpy(packet->data, payload, record->length);
+    packet->len     = static_cast<int>(record->length);
+    packet->route   = static_cast<std::uint32_t>(route);
+    packet->arrival = 0;  // the recorded arrival lies in the past
+
+    this->batch[filled++] = packet;
+    if (filled == this->options.udpBatchSize) {
+      this->dispatch(this->batch.data(), filled);
+      filled = 0;
+    }
+    count++;
+  }
+  this->dispatch(this->batch.data(), filled);
+  this->drain(std::chrono::steady_clock::now() + std::chrono::milliseconds(this->options.shutdownTimeout));
+
+  std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+  LOG_INFO("Replayed " << count << " datagram(s) from " << this->options.replayFile << " in "
+           << elapsed.count() << " s (" << static_cast<std::uint64_t>(count / std::max(elapsed.count(), 1e-6))
+           << " msg/s)");
+  if (0 != skipped) {
+    LOG_WARN("Skipped " << skipped << " datagram(s) of UDP ports without a route");
+  }
+  this->replayed.store(true);
+}
+
+bool Pipeline::drain(std::chrono::steady_clock::time_point deadline) {
+  // after a publisher thread ran idle twice, it took every packet queued before and flushed its coalesced messages
+  for (auto& lane : this->lanes) {
+    lane->flushWhenIdle();
+    std::uint64_t idle = lane->idleCount();
+    lane->notify();
+    while (lane->idleCount() < idle + 2 && std::chrono::steady_clock::now() < deadline) {
+      std::this_thread::sleep_for(DRAIN_POLL_INTERVAL);
+    }
+  }
+
+  // the buffered messages of an outage are replayed, if the broker comes back in time
+  auto pending = [this]() {
+    return this->stats.delivered.get() + this->stats.deliveryFailures.get() < this->stats.published.get() ||
+           this->stats.spilled.get() > this->stats.replayed.get();
+  };
+  while (pending() && std::chrono::steady_clock::now() < deadline) {
+    std::this_thread::sleep_for(DRAIN_POLL_INTERVAL);
+  }
+  return !pending();
+}
+
+void Pipeline::dispatch(Packet** packets, int count) {
+  if (this->config.generation() != this->snapshotGeneration) {
+    this->applySnapshot();
+  }
+  if (!this->retiredRouters.empty()) {
+    this->releaseRetired();
+  }
+
+  if (0 == count) {
+    this->reportDrops();  // the batch may have been truncated datagrams only
+    return;
+  }
+
+  if (this->capture.enabled()) {
+    auto wallClock = std::chrono::system_clock::now().time_since_epoch();
+    this->capture.record(packets, count, std::chrono::duration_cast<std::chrono::nanoseconds>(wallClock).count());
+  }
+
+  auto          now = std::chrono::steady_clock::now();
+  std::uint64_t bytes{0};
+  this->lastReceived = now;
+  for (int i = 0; i < count; i++) {
+    Packet*           packet = packets[i];
+    const std::size_t route  = packet->route;
+    packet->received         = now;
+    bytes += static_cast<std::uint64_t>(packet->len);
+
+    // malformed and irrelevant datagrams are dropped first, so they do not take any state, then redundant copies
+    // and datagrams of sources above their rate, all before the topic lookup
+    if (this->filter->enabled()) {
+      FilterVerdict verdict = this->filter->check(route, *packet);
+      if (FilterVerdict::Pass != verdict) {
+        this->pool.release(packet);
+        this->countFiltered(verdict);
+        continue;
+      }
+    }
+    if (this->dedup.enabled() && this->dedup.duplicate(route, packet->data, packet->len, now)) {
+      this->pool.release(packet);
+      this->stats.duplicates.add();
+      continue;
+    }
+    if (this->limiter.enabled() && !this->limiter.admit(*packet, now)) {
+      this->pool.release(packet);
+      this->stats.rateLimited.add();
+      continue;
+    }
+
+    packet->topic       = this->router->topicFor(route, *packet);
+    packet->compression = this->snapshot->routes[route].compression;
+    packet->qos         = static_cast<std::int8_t>(this->snapshot->routes[route].qos);
+    packet->priority    = this->snapshot->routes[route].priority;
+    this->forward(packet);
+  }
+  this->stats.received.add(static_cast<std::uint64_t>(count));
+  this->stats.receivedBytes.add(bytes);
+  for (auto& lane : this->lanes) {
+    lane->notify();
+  }
+
+  this->reportDrops();
+}
+
+void Pipeline::countFiltered(FilterVerdict verdict) {
+  switch (verdict) {
+  case FilterVerdict::Length:
+    this->stats.filteredLength.add();
+    break;
+  case FilterVerdict::Type:
+    this->stats.filteredType.add();
+    break;
+  case FilterVerdict::Magic:
+    this->stats.filteredMagic.add();
+    break;
+  case FilterVerdict::Checksum:
+    this->stats.filteredChecksum.add();
+    break;
+  case FilterVerdict::Pass:
+    break;
+  }
+}
+
+void Pipeline::applySnapshot() {
+  std::vector<std::uint64_t> idle{};
+  for (const auto& lane : this->lanes) {
+    idle.push_back(lane->idleCount());
+  }
+  this->retiredRouters.push_back({std::move(this->router), std::move(this->snapshot), std::move(idle)});
+
+  this->snapshotGeneration = this->config.generation();
+  this->snapshot           = this->config.current();
+  this->router.reset(new TopicRouter(*this->snapshot));
+  this->filter.reset(new PayloadFilter(*this->snapshot));
+  this->limiter.reconfigure(*this->snapshot);
+}
+
+void Pipeline::releaseRetired() {
+  // after a publisher thread ran idle twice, it took every packet queued before the swap
+  auto expired = [this](const RetiredRouter& retired) {
+    for (std::size_t i = 0; i < this->lanes.size(); i++) {
+      if (this->lanes[i]->idleCount() < retired.idle[i] + 2) {
+        return false;
+      }
+    }
+    return true;
+  };
+  this->retiredRouters.erase(std::remove_if(this->retiredRouters.begin(), this->retiredRouters.end(), expired),
+                             this->retiredRouters.end());
+}
+
+std::size_t Pipeline::shardFor(const Packet& packet) const {
+  if (1 == this->connections) {
+    return 0;
+  }
+
+  std::uint64_t key{0};
+  if (ShardKey::Source == this->options.mqttShardKey) {
+    key = IpAddress::of(packet.source).prefix(this->options.sourceMask, this->options.sourceMask6).hash();
+  } else {
+    key = Xxh64::hash(packet.topic->data(), packet.topic->size());
+  }
+  return static_cast<std::size_t>(JumpHash::bucket(key, static_cast<int>(this->connections)));
+}
+
+void Pipeline::forward(Packet* packet) {
+  const std::size_t shard = this->shardFor(*packet);
+  if (1 == this->targets) {
+    this->lanes[shard]->enqueue(packet);
+    return;
+  }
+
+  // the references are set before the first lane can release the packet
+  if (TargetMode::FanOut == this->options.mqttTargetMode) {
+    packet->references.store(static_cast<std::uint32_t>(this->targets), std::memory_order_relaxed);
+    for (std::size_t target = 0; target < this->targets; target++) {
+      this->lanes[target * this->connections + shard]->enqueue(packet);
+    }
+    return;
+  }
+
+  // while no broker is connected, the packets are buffered by the lane of the primary one
+  std::size_t active{0};
+  for (std::size_t target = 0; target < this->targets; target++) {
+    if (this->lanes[target * this->connections + shard]->connected()) {
+      active = target;
+      break;
+    }
+  }
+  this->lanes[active * this->connections + shard]->enqueue(packet);
+}
+
+void Pipeline::waitForPackets() {
+  // all packets are in use, the publishers have to catch up first, the fullest lane frees one most likely
+  PublishLane* fullest = this->lanes.front().get();
+  for (auto& lane : this->lanes) {
+    if (lane->queued() > fullest->queued()) {
+      fullest = lane.get();
+    }
+  }
+  fullest->waitForSpace(QUEUE_WAIT_TIMEOUT);
+}
+
+void Pipeline::reportDrops() {
+  std::uint64_t drops =
+      this->stats.droppedOldest.get() + this->stats.droppedNewest.get() + this->stats.fairDropped.get();
+  std::uint64_t truncated = this->stats.truncated.get();
+  if (drops == this->reportedDrops && truncated == this->reportedTruncated) {
+    return;
+  }
+
+  auto now = std::chrono::steady_clock::now();
+  if (now - this->lastDropReport < DROP_REPORT_INTERVAL) {
+    return;
+  }
+
+  if (drops != this->reportedDrops) {
+    LOG_WARN("Publish queue is full, dropped " << (drops - this->reportedDrops) << " message(s), total: " << drops);
+  }
+  if (truncated != this->reportedTruncated) {
+    std::size_t largest = this->receiver.largestTruncated();
+#ifdef UDPMQTTGW_IO_URING
+    largest = std::max(largest, this->uring.largestTruncated());
+#endif
+    LOG_WARN("Dropped " << (truncated - this->reportedTruncated)
+             << " datagram(s) larger than UdpMaxDatagramSize, total: " << truncated
+             << ", largest: " << largest << " bytes");
+  }
+  this->reportedDrops     = drops;
+  this->reportedTruncated = truncated;
+  this->lastDropReport    = now;
+}
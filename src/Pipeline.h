@@ -0,0 +1,249 @@
+/**
+ * @file      Pipeline.h
+ * @brief     Two-stage pipeline of a receiver thread and publisher threads
+ *
+ * @copyright (c) consider it GmbH, 2020
+ */
+
+#ifndef _PIPELINE_H
+#define _PIPELINE_H
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "AppOptions.h"
+#include "Capture.h"
+#include "ConfigStore.h"
+#include "Deduplicator.h"
+#include "MqttPublisher.h"
+#include "Packet.h"
+#include "PayloadFilter.h"
+#include "PublishLane.h"
+#include "SourceLimiter.h"
+#include "Stats.h"
+#include "TopicRouter.h"
+#include "UdpReceiver.h"
+#ifdef UDPMQTTGW_IO_URING
+#include "UringReceiver.h"
+#endif
+
+/**
+ * @brief MQTT broker of a pipeline, with its connections
+ */
+struct PublishTarget {
+  const AppOptions*           options;     // with the connection parameters of the broker (see targetOptions())
+  std::vector<MqttPublisher*> publishers;  // MqttConnections connections to the broker
+};
+
+/**
+ * @brief Receives datagrams on one thread and publishes them on others
+ *
+ * All UDP sockets (routes) are served by the same receiver thread. The receiver thread fills
+ * packets from the pool and hands them to the publish lanes, one for each MQTT connection of the
+ * worker, which publish them on their own threads (see PublishLane).
+ *
+ * With multiple connections (MqttConnections), a packet goes to the lane picked by a consistent
+ * hash of its topic or its source (MqttShardKey), so the messages of a topic/ source keep their
+ * order, while the connections (and their TLS encryption) run in parallel.
+ *
+ * With several brokers (MqttTarget), every broker has its own lanes. The shard of a packet is
+ * the same for all of them. With fan-out, the packet is queued to the lanes of all brokers,
+ * with failover, to the one of the first broker, whose connection of the shard is up.
+ *
+ * With io_uring (UDPMQTTGW_IO_URING), the kernel receives the datagrams of all sockets directly
+ * into the pool and the receiver thread only collects them, if the kernel does not support it,
+ * the sockets are read with recvmmsg.
+ *
+ * The receiver thread takes a reloaded configuration snapshot before its next batch. The queued
+ * packets still point to topics of the previous router, so it is kept until every publisher
+ * thread ran out of packets twice (a grace period like RCU).
+ *
+ * With CaptureFile, the receiver thread records each batch, before it is filtered. In replay
+ * mode (-r=FILE), it reads the datagrams from a capture file instead of the sockets and
+ * dispatches them with their recorded timing, the sources and the routes (by their UDP port) are
+ * restored, so the filters, rules and shards see the same datagrams as the live gateway.
+ */
+class Pipeline {
+public:
+  /**
+   * @param options     Application configuration
+   * @param config      Reloadable configuration snapshot (routes and limits)
+   * @param worker      Number of the worker
+   * @param sockets     Bound UDP sockets to receive from, one for each route of the configuration
+   * @param targets     MQTT brokers to publish to, each connection gets its own publish lane
+   * @param stats       Statistics of this worker
+   * @param dedup       Set of recently received payloads, shared by all workers
+   * @param cpu         CPU to pin all threads to, -1 to let the scheduler decide
+   * @param receiverCpu CPU to pin the receiver thread to instead, -1 to use the one of the publishers
+   */
+  Pipeline(const AppOptions& options, ConfigStore& config, int worker, std::vector<int> sockets,
+           const std::vector<PublishTarget>& targets, WorkerStats& stats, Deduplicator& dedup, int cpu,
+           int receiverCpu);
+
+  Pipeline(const Pipeline&) = delete;
+  Pipeline& operator=(const Pipeline&) = delete;
+  Pipeline(Pipeline&&)                 = delete;
+  Pipeline& operator=(Pipeline&&) = delete;
+  ~Pipeline()                     = default;
+
+  /**
+   * @brief Start the receiver and the publisher threads
+   */
+  void start();
+
+  /**
+   * @brief Wait for all threads to finish
+   */
+  void join();
+
+  /**
+   * @brief Stop the receiver thread and wait for it, for the shutdown
+   *
+   * The datagrams, which were received before, stay queued for the publisher threads.
+   */
+  void stopReceiving();
+
+  /**
+   * @brief Wait until the lanes published the queued packets and the MQTT library delivered them
+   *
+   * This includes the messages buffered during a broker outage. The pending coalesced messages are
+   * published without waiting for their linger time. The receiver thread has to be stopped, the
+   * publisher threads keep running.
+   *
+   * @return    Returns False, if messages were still pending at the deadline
+   */
+  bool drain(std::chrono::steady_clock::time_point deadline);
+
+  /**
+   * @brief Wait until the capture file was replayed and its messages were delivered (replay mode only)
+   *
+   * @return    Returns False, if the capture file could not be read
+   */
+  bool waitForReplay();
+
+private:
+  const AppOptions& options;
+  ConfigStore&      config;
+  std::vector<int>  sockets;  // index is the route
+  WorkerStats&      stats;
+  Deduplicator&     dedup;
+  int               cpu;
+  int               receiverCpu;
+
+  PacketPool  pool;
+  UdpReceiver receiver;
+#ifdef UDPMQTTGW_IO_URING
+  UringReceiver uring;  // receiver thread only
+#endif
+  SourceLimiter limiter;  // receiver thread only
+  CaptureWriter capture;  // receiver thread only
+
+  const std::size_t                         targets;      // brokers
+  const std::size_t                         connections;  // per broker
+  std::vector<std::unique_ptr<PublishLane>> lanes;        // index is target * connections + connection
+
+  // latest configuration snapshot and the router built from it (receiver thread only)
+  std::shared_ptr<const AppOptions> snapshot;
+  std::uint64_t                     snapshotGeneration{0};
+  std::unique_ptr<TopicRouter>      router;
+  std::unique_ptr<PayloadFilter>    filter;
+
+  struct RetiredRouter {
+    std::unique_ptr<TopicRouter>      router;
+    std::shared_ptr<const AppOptions> snapshot;
+    std::vector<std::uint64_t>        idle;  // idleCount() of the lanes, when it was replaced
+  };
+  std::vector<RetiredRouter> retiredRouters;  // receiver thread only
+
+  std::vector<Packet*> batch;           // packets for the next receive call (receiver thread only)
+  int                  batchFilled{0};  // batch[0, batchFilled) holds packets from the pool
+
+  const std::chrono::microseconds       spinTime;        // UdpSpinTime
+  std::chrono::steady_clock::time_point lastReceived{};  // of the last datagram (receiver thread only)
+
+  std::thread              receiveThread;
+  std::vector<std::thread> publishThreads;  // one per lane
+
+  std::atomic<bool> stopping{false};   // the receiver thread has to return
+  std::atomic<bool> receiving{false};  // the receiver thread is running
+  std::atomic<bool> replayed{false};   // the capture file was read completely
+
+  std::uint64_t                         reportedDrops{0};
+  std::uint64_t                         reportedTruncated{0};
+  std::chrono::steady_clock::time_point lastDropReport{};
+
+  static void pinThread(std::thread& thread, int cpu);
+  void        setReceiverPriority();
+  void receiveLoop();
+
+  /**
+   * @brief Dispatch the datagrams of the capture file (replay mode), instead of receiving them
+   */
+  void replayLoop();
+
+  /**
+   * @brief Receive a batch of datagrams from the socket of a route and hand them to the lanes
+   *
+   * @return    Returns the number of received datagrams
+   */
+  int receiveFrom(std::size_t route, bool blocking);
+
+#ifdef UDPMQTTGW_IO_URING
+  /**
+   * @brief Collect a batch of datagrams from io_uring and hand them to the lanes
+   */
+  void receiveUring(bool blocking);
+#endif
+
+  /**
+   * @brief Filter the received packets and hand them to their lanes
+   */
+  void dispatch(Packet** packets, int count);
+
+  /**
+   * @brief Count a datagram, which was dropped by a payload filter
+   */
+  void countFiltered(FilterVerdict verdict);
+
+  /**
+   * @brief Take the latest configuration snapshot and retire the previous router
+   */
+  void applySnapshot();
+
+  /**
+   * @brief Free the retired routers, which no queued packet can point to any more
+   */
+  void releaseRetired();
+
+  /**
+   * @brief Returns True, while the sockets are polled without blocking after the last datagram
+   */
+  bool spinning() const;
+
+  /**
+   * @brief Pick the connection of a packet by its shard key (MqttShardKey)
+   */
+  std::size_t shardFor(const Packet& packet) const;
+
+  /**
+   * @brief Queue a packet to the lane of its shard, of every broker or of the active one (MqttTargetMode)
+   */
+  void forward(Packet* packet);
+
+  /**
+   * @brief Wait until a publisher thread released packets, when all of them are in use
+   */
+  void waitForPackets();
+
+  /**
+   * @brief Print a warning about dropped and truncated packets (at most once per second)
+   */
+  void reportDrops();
+};
+
+#endif /* _PIPELINE_H */
@@ -0,0 +1,181 @@
+/**
+ * @file      PublishLane.cpp
+ * @brief     Publisher stage of a pipeline, which serves one MQTT connection
+ *
+ * @copyright (c) consider it GmbH, 2020
+ */
+
+#include "PublishLane.h"
+
+#include <algorithm>
+
+#include "Log.h"
+
+// static configuration values
+#define QUEUE_WAIT_TIMEOUT std::chrono::milliseconds(100)
+#define REPLAY_INTERVAL std::chrono::milliseconds(10)  // wake up interval, while buffered messages are waiting
+#define URGENT_QUEUE_FRACTION 4                        // the ring of the critical routes holds QueueCapacity / 4
+#define LATENCY_SMOOTHING 16                           // packets, weight of the moving average of the queue latency
+
+namespace {
+
+/**
+ * @brief Packets in the ring and the fair queue, from which on a lane is overloaded
+ */
+std::size_t shedDepthOf(const AppOptions& options, std::size_t ringCapacity) {
+  std::size_t capacity = ringCapacity;
+  if (0 != options.fairQueuing) {
+    capacity += static_cast<std::size_t>(options.queueCapacity);
+  }
+  return std::max<std::size_t>(1, capacity * static_cast<std::size_t>(options.shedQueueDepth) / 100);
+}
+
+}  // namespace
+
+PublishLane::PublishLane(const AppOptions& options, std::size_t target, int lane, MqttPublisher& publisher,
+                         WorkerStats& stats, PacketPool& pool) :
+    options{options},
+    publisher{publisher},
+    stats{stats},
+    pool{pool},
+    ring{static_cast<std::size_t>(options.queueCapacity)},
+    urgent{static_cast<std::size_t>(options.queueCapacity / URGENT_QUEUE_FRACTION)},
+    fairQueue{options, target},
+    outbox{options, lane, publisher, stats},
+    coalescer{options, outbox},
+    shedDepth{shedDepthOf(options, this->ring.capacity())},
+    shedLatency{static_cast<std::int64_t>(options.shedLatency) * 1000} {}
+
+std::size_t PublishLane::capacity(const AppOptions& options) {
+  std::size_t ringCapacity = SpscRing<Packet*>::capacityFor(static_cast<std::size_t>(options.queueCapacity));
+  std::size_t urgentCapacity =
+      SpscRing<Packet*>::capacityFor(static_cast<std::size_t>(options.queueCapacity / URGENT_QUEUE_FRACTION));
+  return ringCapacity * (0 != options.fairQueuing ? 2 : 1) + urgentCapacity;
+}
+
+void PublishLane::run() {
+  while (true) {
+    Packet* packet = this->dequeue();
+    if (nullptr == packet) {
+      // nothing is waiting any more, so the lane is not behind
+      this->latency.store(0, std::memory_order_relaxed);
+      if (this->flushing.load()) {
+        this->coalescer.flushAll();
+      }
+      this->idle.fetch_add(1, std::memory_order_release);
+      auto now = Coalescer::Clock::now();
+      this->coalescer.flushExpired(now);
+      this->outbox.replay(now);
+      this->ring.waitNotEmpty(
+          this->coalescer.timeUntilFlush(now, this->outbox.backlog() ? REPLAY_INTERVAL : QUEUE_WAIT_TIMEOUT),
+          [this] { return !this->urgent.empty(); });
+      continue;
+    }
+    if (0 != this->shedLatency) {
+      this->updateLatency(packet->received, Coalescer::Clock::now());
+    }
+
+    // the replay must not starve, while the ring never runs empty
+    if (this->outbox.backlog()) {
+      this->outbox.replay(Outbox::Clock::now());
+    }
+
+    // bulk routes give up the acknowledgements of the broker first
+    int qos = 0 <= packet->qos ? packet->qos : this->options.mqttQosLevel;
+    if (RoutePriority::Bulk == packet->priority && 0 != qos && this->overloaded()) {
+      qos = 0;
+      this->stats.degraded.add();
+    }
+
+    if (this->coalescer.enabled() && RoutePriority::Critical != packet->priority) {
+      auto now = Coalescer::Clock::now();
+      this->coalescer.add(*packet->topic, packet->data, packet->len, packet->compression, packet->received,
+                          packet->arrival, qos, now);
+      this->pool.release(packet);
+      this->coalescer.flushExpired(now);
+      continue;
+    }
+
+    // publish message to MQTT (without waiting for the acknowledgement)
+    bool published = this->outbox.send(*packet->topic, packet->data, packet->len, packet->compression,
+                                       packet->received, packet->arrival, qos);
+    this->pool.release(packet);
+
+    if (published && this->options.verbosity >= 2) {
+      LOG_DEBUG("Successfully published message to MQTT");
+    }
+  }
+}
+
+void PublishLane::enqueue(Packet* packet) {
+  if (RoutePriority::Bulk == packet->priority && this->overloaded()) {
+    this->pool.release(packet);
+    this->stats.shed.add();
+    return;
+  }
+
+  // the publisher thread sleeps on the condition of the main ring, also for the critical packets
+  SpscRing<Packet*>& target = RoutePriority::Critical == packet->priority ? this->urgent : this->ring;
+  switch (this->options.queueOverflowPolicy) {
+  case OverflowPolicy::DropNewest:
+    if (!target.push(packet)) {
+      this->pool.release(packet);
+      this->stats.droppedNewest.add();
+    }
+    break;
+
+  case OverflowPolicy::DropOldest:
+    while (!target.push(packet)) {
+      Packet* oldest{nullptr};
+      if (target.pop(oldest)) {
+        this->pool.release(oldest);
+        this->stats.droppedOldest.add();
+      }
+    }
+    break;
+
+  case OverflowPolicy::Block:
+    while (!target.push(packet)) {
+      this->ring.notifyConsumer();
+      target.waitNotFull(QUEUE_WAIT_TIMEOUT);
+    }
+    break;
+  }
+}
+
+void PublishLane::updateLatency(Coalescer::Clock::time_point received, Coalescer::Clock::time_point now) {
+  std::int64_t sample  = std::chrono::duration_cast<std::chrono::microseconds>(now - received).count();
+  std::int64_t average = this->latency.load(std::memory_order_relaxed);
+  this->latency.store(average + (sample - average) / LATENCY_SMOOTHING, std::memory_order_relaxed);
+}
+
+Packet* PublishLane::dequeue() {
+  Packet* packet{nullptr};
+  if (this->urgent.pop(packet)) {
+    this->urgent.notifyProducer();
+    return packet;
+  }
+  if (!this->fairQueue.enabled()) {
+    if (!this->ring.pop(packet)) {
+      return nullptr;
+    }
+    this->ring.notifyProducer();
+    return packet;
+  }
+
+  // with the blocking policy, the ring fills up and stops the receiver, when the fair queue is full
+  bool moved{false};
+  while ((OverflowPolicy::Block != this->options.queueOverflowPolicy || !this->fairQueue.full()) &&
+         this->ring.pop(packet)) {
+    Packet* dropped = this->fairQueue.push(packet);
+    if (nullptr != dropped) {
+      this->pool.release(dropped);
+      this->stats.fairDropped.add();
+    }
+    moved = true;
+  }
+  if (moved) {
+    this->ring.notifyProducer();
+  }
+  return this->fairQueue.pop();
+}
@@ -0,0 +1,156 @@
+/**
+ * @file      PublishLane.h
+ * @brief     Publisher stage of a pipeline, which serves one MQTT connection
+ *
+ * @copyright (c) consider it GmbH, 2020
+ */
+
+#ifndef _PUBLISHLANE_H
+#define _PUBLISHLANE_H
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+#include "AppOptions.h"
+#include "Coalescer.h"
+#include "FairQueue.h"
+#include "MqttPublisher.h"
+#include "Outbox.h"
+#include "Packet.h"
+#include "SpscRing.h"
+#include "Stats.h"
+
+/**
+ * @brief Queue and publisher thread of one MQTT connection of a worker
+ *
+ * The receiver thread pushes the packets to a lock-free ring, the publisher thread of the lane
+ * drains it. So a stalled broker connection does not stop the reception of datagrams, until the
+ * ring is full. What happens then, is defined by the configured overflow policy.
+ *
+ * With FairQueuing, the publisher thread moves the packets from the ring to per source queues
+ * and publishes them round robin, so the ring only hands them over.
+ *
+ * Packets of critical routes are pushed to a second, smaller ring, which the publisher thread
+ * always drains first, and they are not coalesced. When the ring and the fair queue together are
+ * filled above ShedQueueDepth percent of their capacity or the queue latency exceeds ShedLatency,
+ * the lane is overloaded: new packets of bulk routes are dropped (shed) then, and the queued ones
+ * are published with QoS 0, so the critical and normal routes keep the queue and the
+ * acknowledgements of the broker.
+ *
+ * While the broker is unreachable, the publisher thread keeps draining the ring into the outbox,
+ * which buffers the messages until they can be replayed.
+ *
+ * With several brokers (MqttTarget), every broker has its own lanes in each worker. A packet,
+ * which is fanned out, is shared by the lanes and only released to the pool by the last one.
+ */
+class PublishLane {
+public:
+  /**
+   * @param options   Application configuration, with the connection parameters of the broker
+   * @param target    Index of the broker (0 is MqttUrl), selects the link of the packets in the fair queue
+   * @param lane      Number of the lane over all brokers and workers, to name its spill files
+   * @param publisher MQTT connection to publish to
+   * @param stats     Statistics of the worker
+   * @param pool      Pool of the worker, the published packets are released to
+   */
+  PublishLane(const AppOptions& options, std::size_t target, int lane, MqttPublisher& publisher, WorkerStats& stats,
+              PacketPool& pool);
+
+  PublishLane(const PublishLane&) = delete;
+  PublishLane& operator=(const PublishLane&) = delete;
+  PublishLane(PublishLane&&)                 = delete;
+  PublishLane& operator=(PublishLane&&) = delete;
+  ~PublishLane()                        = default;
+
+  /**
+   * @brief Packets, which can be held by the ring and the fair queue of a lane
+   */
+  static std::size_t capacity(const AppOptions& options);
+
+  /**
+   * @brief Publish the queued packets, runs on the publisher thread of the lane and never returns
+   */
+  void run();
+
+  /**
+   * @brief Push a packet to the ring of its priority, apply the overflow policy if it is full (receiver thread only)
+   */
+  void enqueue(Packet* packet);
+
+  /**
+   * @brief Publish the pending coalesced messages without their linger time, whenever the lane runs idle (drain)
+   */
+  void flushWhenIdle() { this->flushing.store(true); }
+
+  /**
+   * @brief Wake up the publisher thread, if it is sleeping (receiver thread, after a batch)
+   */
+  void notify() { this->ring.notifyConsumer(); }
+
+  /**
+   * @brief Sleep until the publisher thread took a packet or the timeout expired (receiver thread only)
+   */
+  void waitForSpace(std::chrono::milliseconds timeout) { this->ring.waitNotFull(timeout); }
+
+  /**
+   * @brief Number of packets waiting in the rings
+   */
+  std::size_t queued() const { return this->ring.size() + this->urgent.size(); }
+
+  /**
+   * @brief Number of times the publisher thread found no packet, it holds none of the packets queued before then
+   */
+  std::uint64_t idleCount() const { return this->idle.load(std::memory_order_acquire); }
+
+  /**
+   * @brief Returns True, if the MQTT connection of the lane is established
+   */
+  bool connected() const { return this->publisher.connected(); }
+
+private:
+  const AppOptions& options;
+  MqttPublisher&    publisher;
+  WorkerStats&      stats;
+  PacketPool&       pool;
+
+  SpscRing<Packet*> ring;
+  SpscRing<Packet*> urgent;     // packets of the critical routes, published first
+  FairQueue         fairQueue;  // publisher thread only
+  Outbox            outbox;     // publisher thread only
+  Coalescer         coalescer;  // publisher thread only
+
+  std::atomic<std::uint64_t> idle{0};
+  std::atomic<bool>          flushing{false};  // see flushWhenIdle()
+
+  // overload thresholds, see overloaded()
+  const std::size_t         shedDepth;    // packets in the ring and the fair queue
+  const std::int64_t        shedLatency;  // microseconds, 0: disabled
+  std::atomic<std::int64_t> latency{0};   // moving average of the queue latency, microseconds
+
+  /**
+   * @brief Take the next packet to publish from the ring, or from the fair queue if enabled
+   *
+   * @return    Returns nullptr, if no packet is waiting
+   */
+  Packet* dequeue();
+
+  /**
+   * @brief Returns True, if the queues are filled above ShedQueueDepth or the queue latency exceeds ShedLatency
+   *
+   * With FairQueuing, the publisher thread moves the packets from the ring to the fair queue
+   * right away, so both are counted.
+   */
+  bool overloaded() const {
+    return this->ring.size() + this->fairQueue.size() >= this->shedDepth ||
+           (0 != this->shedLatency && this->latency.load(std::memory_order_relaxed) >= this->shedLatency);
+  }
+
+  /**
+   * @brief Update the moving average of the queue latency with a dequeued packet (publisher thread only)
+   */
+  void updateLatency(Coalescer::Clock::time_point received, Coalescer::Clock::time_point now);
+};
+
+#endif /* _PUBLISHLANE_H */
@@ -0,0 +1,148 @@
+/**
+ * @file      SourceLimiter.cpp
+ * @brief     Rate limiting of the received datagrams per source
+ *
+ * @copyright (c) consider it GmbH, 2020
+ */
+
+#include "SourceLimiter.h"
+
+#include <algorithm>
+
+// static configuration values
+#define LOAD_FACTOR 2  // index slots per source
+
+namespace {
+
+unsigned indexBitsFor(const AppOptions& options) {
+  unsigned bits{1};
+  while ((std::size_t{1} << bits) < static_cast<std::size_t>(options.sourceTableSize) * LOAD_FACTOR) {
+    bits++;
+  }
+  return bits;
+}
+
+}  // namespace
+
+SourceLimiter::SourceLimiter(const AppOptions& options) :
+    rate{static_cast<double>(options.sourceRateLimit)},
+    burst{static_cast<double>(options.sourceRateBurst)},
+    mask4{options.sourceMask},
+    mask6{options.sourceMask6},
+    indexBits{indexBitsFor(options)} {
+  if (this->enabled()) {
+    this->sources.resize(static_cast<std::size_t>(options.sourceTableSize));
+    this->index.resize(std::size_t{1} << this->indexBits, 0);
+  }
+}
+
+void SourceLimiter::reconfigure(const AppOptions& options) {
+  this->rate  = static_cast<double>(options.sourceRateLimit);
+  this->burst = static_cast<double>(options.sourceRateBurst);
+
+  // the tables are only allocated, once a limit is configured
+  if (this->enabled() && this->sources.empty()) {
+    this->sources.resize(static_cast<std::size_t>(options.sourceTableSize));
+    this->index.resize(std::size_t{1} << this->indexBits, 0);
+  }
+}
+
+bool SourceLimiter::admit(const Packet& packet, Clock::time_point received) {
+  const IpAddress key  = IpAddress::of(packet.source).prefix(this->mask4, this->mask6);
+  std::size_t     slot = this->find(key);
+  std::uint32_t   pos{0};
+
+  if (0 != this->index[slot]) {
+    pos = this->index[slot] - 1;
+    if (pos != this->newest) {
+      this->unlink(pos);
+      this->pushFront(pos);
+    }
+  } else {
+    // a new source takes the place of the least recently seen one, if the table is full
+    if (this->used == this->sources.size()) {
+      pos = this->oldest;
+      this->erase(this->sources[pos].key);
+      this->unlink(pos);
+      slot = this->find(key);
+    } else {
+      pos = this->used++;
+    }
+
+    this->sources[pos].key    = key;
+    this->sources[pos].tokens = this->burst;
+    this->sources[pos].last   = received;
+    this->index[slot]         = pos + 1;
+    this->pushFront(pos);
+  }
+
+  Source&                       source  = this->sources[pos];
+  std::chrono::duration<double> elapsed = received - source.last;
+  source.tokens = std::min(this->burst, source.tokens + std::max(0.0, elapsed.count()) * this->rate);
+  source.last   = received;
+  if (source.tokens < 1) {
+    return false;
+  }
+  source.tokens -= 1;
+  return true;
+}
+
+std::size_t SourceLimiter::home(const IpAddress& key) const {
+  return static_cast<std::size_t>(key.hash() >> (64U - this->indexBits));
+}
+
+std::size_t SourceLimiter::find(const IpAddress& key) const {
+  const std::size_t slotMask = this->index.size() - 1;
+  std::size_t       slot     = this->home(key);
+  while (0 != this->index[slot] && this->sources[this->index[slot] - 1].key != key) {
+    slot = (slot + 1) & slotMask;
+  }
+  return slot;
+}
+
+void SourceLimiter::erase(const IpAddress& key) {
+  // backward shift deletion, so the probe sequences of the following entries stay intact
+  const std::size_t slotMask = this->index.size() - 1;
+  std::size_t       hole     = this->find(key);
+  std::size_t       slot     = hole;
+  while (true) {
+    slot = (slot + 1) & slotMask;
+    if (0 == this->index[slot]) {
+      break;
+    }
+
+    // an entry may move into the hole, if the hole is on its probe sequence (from its home to its slot)
+    std::size_t entryHome = this->home(this->sources[this->index[slot] - 1].key);
+    if (((slot - entryHome) & slotMask) >= ((slot - hole) & slotMask)) {
+      this->index[hole] = this->index[slot];
+      hole              = slot;
+    }
+  }
+  this->index[hole] = 0;
+}
+
+void SourceLimiter::unlink(std::uint32_t pos) {
+  Source& source = this->sources[pos];
+  if (NONE != source.prev) {
+    this->sources[source.prev].next = source.next;
+  } else {
+    this->newest = source.next;
+  }
+  if (NONE != source.next) {
+    this->sources[source.next].prev = source.prev;
+  } else {
+    this->oldest = source.prev;
+  }
+}
+
+void SourceLimiter::pushFront(std::uint32_t pos) {
+  Source& source = this->sources[pos];
+  source.prev    = NONE;
+  source.next    = this->newest;
+  if (NONE != this->newest) {
+    this->sources[this->newest].prev = pos;
+  } else {
+    this->oldest = pos;
+  }
+  this->newest = pos;
+}
@@ -0,0 +1,90 @@
+/**
+ * @file      SourceLimiter.h
+ * @brief     Rate limiting of the received datagrams per source
+ *
+ * @copyright (c) consider it GmbH, 2020
+ */
+
+#ifndef _SOURCELIMITER_H
+#define _SOURCELIMITER_H
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "AppOptions.h"
+#include "IpAddress.h"
+#include "Packet.h"
+
+/**
+ * @brief Token bucket for every source address (or subnet), in a flat hash map with LRU eviction
+ *
+ * The buckets are kept in a fixed array of SourceTableSize entries, which is indexed by an
+ * open-addressed table of 32 bit positions, so a lookup touches two cache lines and nothing
+ * is allocated after startup. When the table is full, the least recently seen source is
+ * evicted and starts again with a full bucket, when it comes back.
+ *
+ * A limiter is not thread-safe, each receiver thread needs its own instance. As the kernel
+ * distributes the flows between the workers, the limit applies per worker.
+ */
+class SourceLimiter {
+public:
+  using Clock = std::chrono::steady_clock;
+
+  explicit SourceLimiter(const AppOptions& options);
+
+  SourceLimiter(const SourceLimiter&) = delete;
+  SourceLimiter& operator=(const SourceLimiter&) = delete;
+  SourceLimiter(SourceLimiter&&)                 = delete;
+  SourceLimiter& operator=(SourceLimiter&&) = delete;
+  ~SourceLimiter()                          = default;
+
+  /**
+   * @brief Returns True, if a rate limit is configured
+   */
+  bool enabled() const { return 0 != this->rate; }
+
+  /**
+   * @brief Take a token from the bucket of the packet's source
+   *
+   * @return    Returns False, if the source exceeded its rate and the packet should be dropped
+   */
+  bool admit(const Packet& packet, Clock::time_point received);
+
+  /**
+   * @brief Apply the rate and burst of a reloaded configuration, the buckets are kept
+   */
+  void reconfigure(const AppOptions& options);
+
+private:
+  static constexpr std::uint32_t NONE = UINT32_MAX;
+
+  struct Source {
+    IpAddress         key;   // source address prefix (SourcePrefixLength/ SourcePrefixLength6)
+    std::uint32_t     prev;  // more recently seen source
+    std::uint32_t     next;  // less recently seen source
+    double            tokens;
+    Clock::time_point last;
+  };
+
+  double              rate;   // tokens per second
+  double              burst;  // tokens
+  const IpAddress     mask4;  // of the IPv4 source addresses
+  const IpAddress     mask6;  // of the IPv6 source addresses
+
+  std::vector<Source>        sources;  // fixed capacity, [0, used) are in use
+  std::vector<std::uint32_t> index;    // positions in sources + 1, 0: empty
+  unsigned                   indexBits;
+  std::uint32_t              used{0};
+  std::uint32_t              newest{NONE};
+  std::uint32_t              oldest{NONE};
+
+  std::size_t home(const IpAddress& key) const;
+  std::size_t find(const IpAddress& key) const;
+  void        erase(const IpAddress& key);
+  void        unlink(std::uint32_t pos);
+  void        pushFront(std::uint32_t pos);
+};
+
+#endif /* _SOURCELIMITER_H */
@@ -0,0 +1,336 @@
+/**
+ * @file      SpillQueue.cpp
+ * @brief     Bounded buffer for MQTT messages, which could not be published during a broker outage
+ *
+ * @copyright (c) consider it GmbH, 2020
+ */
+
+#include "SpillQueue.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "Log.h"
+
+// static configuration values
+#define RECORD_ALIGNMENT 8
+#define WRAP_MARKER 0xFFFFU  // topic length of the record, which marks the wrap-around of the memory buffer
+
+namespace {
+
+/**
+ * @brief Header of a buffered message, followed by the topic and the payload
+ *
+ * A topic length of 0 marks the end of a segment file, so the zero filled rest of a new file is
+ * never read as a message.
+ */
+struct RecordHeader {
+  std::uint32_t payloadLen;
+  std::uint16_t topicLen;
+  std::uint8_t  encoding;  // Compression of the payload
+  std::uint8_t  qos;       // MQTT QoS level of the message
+  std::int64_t  arrival;   // kernel arrival of the (first) datagram, 0 if unknown
+};
+
+constexpr std::size_t HEADER_SIZE = sizeof(RecordHeader);
+
+std::size_t recordSize(std::size_t topicLen, std::size_t payloadLen) {
+  std::size_t size = HEADER_SIZE + topicLen + payloadLen;
+  return (size + RECORD_ALIGNMENT - 1) / RECORD_ALIGNMENT * RECORD_ALIGNMENT;
+}
+
+RecordHeader readHeader(const char* record) {
+  RecordHeader header{};
+  std::memcpy(&header, record, HEADER_SIZE);
+  return header;
+}
+
+/**
+ * @brief Write a record, the header last, so an interrupted write leaves the end marker in place
+ */
+void writeRecord(char* record, const std::string& topic, const char* payload, int payloadLen, std::int64_t arrival,
+                 Compression encoding, int qos) {
+  RecordHeader header{};
+  header.payloadLen = static_cast<std::uint32_t>(payloadLen);
+  header.topicLen   = static_cast<std::uint16_t>(topic.size());
+  header.encoding   = static_cast<std::uint8_t>(encoding);
+  header.qos        = static_cast<std::uint8_t>(qos);
+  header.arrival    = arrival;
+
+  std::memcpy(record + HEADER_SIZE, topic.data(), topic.size());
+  std::memcpy(record + HEADER_SIZE + topic.size(), payload, static_cast<std::size_t>(payloadLen));
+  std::memcpy(record, &header, HEADER_SIZE);
+}
+
+/**
+ * @brief Length of the complete records at the beginning of a segment file
+ */
+std::size_t validLength(const char* data, std::size_t size, std::size_t& records) {
+  std::size_t offset{0};
+  records = 0;
+  while (offset + HEADER_SIZE <= size) {
+    RecordHeader header = readHeader(data + offset);
+    std::size_t  length = recordSize(header.topicLen, header.payloadLen);
+    if (0 == header.topicLen || offset + length > size) {
+      break;
+    }
+    offset += length;
+    records++;
+  }
+  return offset;
+}
+
+}  // namespace
+
+SpillQueue::SpillQueue(const AppOptions& options, int worker, WorkerStats& stats) :
+    options{options},
+    worker{worker},
+    stats{stats},
+    memory(static_cast<std::size_t>(options.spillMemorySize)) {
+  if (!this->options.spillDirectory.empty()) {
+    this->recoverSegments();
+  }
+}
+
+SpillQueue::~SpillQueue() {
+  // the segment files are kept for the next run, only the memory buffer is lost
+  for (auto& segment : this->segments) {
+    this->closeSegment(segment, false);
+  }
+}
+
+bool SpillQueue::push(const std::string& topic, const char* payload, int payloadLen, std::int64_t arrival,
+                      Compression encoding, int qos) {
+  std::size_t size = recordSize(topic.size(), static_cast<std::size_t>(payloadLen));
+
+  // once messages are on disk, the new ones have to go there, too
+  bool stored = !topic.empty() && topic.size() < WRAP_MARKER &&
+                ((this->segments.empty() &&
+                  this->pushMemory(topic, payload, payloadLen, arrival, encoding, qos, size)) ||
+                 (!this->options.spillDirectory.empty() &&
+                  this->pushDisk(topic, payload, payloadLen, arrival, encoding, qos, size)));
+  if (stored) {
+    this->stats.spilled.add();
+  } else {
+    this->stats.spillDropped.add();
+  }
+  return stored;
+}
+
+bool SpillQueue::front(std::string& topic, const char*& payload, int& payloadLen, std::int64_t& arrival,
+                       Compression& encoding, int& qos) {
+  const char* record{nullptr};
+  if (0 != this->memoryCount) {
+    record = this->memoryFront();
+  } else if (!this->segments.empty()) {
+    record = this->segments.front().data + this->segments.front().readOffset;
+  } else {
+    return false;
+  }
+
+  RecordHeader header = readHeader(record);
+  topic.assign(record + HEADER_SIZE, header.topicLen);
+  payload    = record + HEADER_SIZE + header.topicLen;
+  payloadLen = static_cast<int>(header.payloadLen);
+  arrival    = header.arrival;
+  encoding   = static_cast<Compression>(header.encoding);
+  qos        = header.qos;
+  return true;
+}
+
+void SpillQueue::pop() {
+  if (0 != this->memoryCount) {
+    RecordHeader header = readHeader(this->memoryFront());
+    this->memoryRead += recordSize(header.topicLen, header.payloadLen);
+    this->memoryCount--;
+    if (0 == this->memoryCount) {
+      this->memoryRead  = 0;
+      this->memoryWrite = 0;
+    }
+    return;
+  }
+  if (this->segments.empty()) {
+    return;
+  }
+
+  // a segment is deleted, as soon as all of its messages were read
+  Segment&     segment = this->segments.front();
+  RecordHeader header  = readHeader(segment.data + segment.readOffset);
+  segment.readOffset += recordSize(header.topicLen, header.payloadLen);
+  if (segment.readOffset >= segment.writeOffset) {
+    this->closeSegment(segment, true);
+    this->segments.pop_front();
+  }
+}
+
+bool SpillQueue::pushMemory(const std::string& topic, const char* payload, int payloadLen, std::int64_t arrival,
+                            Compression encoding, int qos, std::size_t size) {
+  const std::size_t capacity = this->memory.size();
+  if (size > capacity || (0 != this->memoryCount && this->memoryWrite == this->memoryRead)) {
+    return false;
+  }
+
+  if (this->memoryWrite >= this->memoryRead) {
+    // free space at the end, and at the beginning in front of the oldest message
+    if (size > capacity - this->memoryWrite) {
+      if (size > this->memoryRead) {
+        return false;
+      }
+      if (capacity - this->memoryWrite >= HEADER_SIZE) {
+        RecordHeader marker{};
+        marker.topicLen = WRAP_MARKER;
+        std::memcpy(&this->memory[this->memoryWrite], &marker, HEADER_SIZE);
+      }
+      this->memoryWrite = 0;
+    }
+  } else if (size > this->memoryRead - this->memoryWrite) {
+    return false;
+  }
+
+  writeRecord(&this->memory[this->memoryWrite], topic, payload, payloadLen, arrival, encoding, qos);
+  this->memoryWrite += size;
+  this->memoryCount++;
+  return true;
+}
+
+const char* SpillQueue::memoryFront() {
+  // the writer wraps around, when the rest of the buffer is too small for the next record
+  if (this->memory.size() - this->memoryRead < HEADER_SIZE ||
+      WRAP_MARKER == readHeader(&this->memory[this->memoryRead]).topicLen) {
+    this->memoryRead = 0;
+  }
+  return &this->memory[this->memoryRead];
+}
+
+bool SpillQueue::pushDisk(const std::string& topic, const char* payload, int payloadLen, std::int64_t arrival,
+                          Compression encoding, int qos, std::size_t size) {
+  if (size > static_cast<std::size_t>(this->options.spillSegmentSize)) {
+    return false;
+  }
+
+  if (this->segments.empty() || !this->segments.back().writable ||
+      this->segments.back().writeOffset + size > this->segments.back().size) {
+    if (this->segments.size() >= static_cast<std::size_t>(this->options.spillMaxSegments) || !this->openSegment()) {
+      return false;
+    }
+  }
+
+  Segment& segment = this->segments.back();
+  writeRecord(segment.data + segment.writeOffset, topic, payload, payloadLen, arrival, encoding, qos);
+  segment.writeOffset += size;
+  return true;
+}
+
+bool SpillQueue::openSegment() {
+  Segment segment{};
+  segment.seq      = this->nextSeq++;
+  segment.path     = this->segmentPrefix() + std::to_string(segment.seq) + ".spill";
+  segment.size     = static_cast<std::size_t>(this->options.spillSegmentSize);
+  segment.writable = true;
+
+  // the mapping stays valid after closing the file descriptor
+  int fd = open(segment.path.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, S_IRUSR | S_IWUSR);
+  if (0 <= fd && 0 == ftruncate(fd, static_cast<off_t>(segment.size))) {
+    void* data = mmap(nullptr, segment.size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (MAP_FAILED != data) {
+      segment.data = static_cast<char*>(data);
+    }
+  }
+  int error = errno;
+  if (0 <= fd) {
+    close(fd);
+  }
+
+  if (nullptr == segment.data) {
+    if (!this->diskErrorReported) {
+      LOG_ERROR("Could not create spill file " << segment.path << ": " << std::strerror(error));
+      this->diskErrorReported = true;
+    }
+    unlink(segment.path.c_str());
+    return false;
+  }
+
+  this->diskErrorReported = false;
+  this->segments.push_back(segment);
+  return true;
+}
+
+void SpillQueue::closeSegment(Segment& segment, bool remove) {
+  munmap(segment.data, segment.size);
+  segment.data = nullptr;
+  if (remove) {
+    unlink(segment.path.c_str());
+  }
+}
+
+void SpillQueue::recoverSegments() {
+  DIR* dir = opendir(this->options.spillDirectory.c_str());
+  if (nullptr == dir) {
+    LOG_WARN("Could not open SpillDirectory " << this->options.spillDirectory << ": " << std::strerror(errno));
+    return;
+  }
+
+  // segment files of this worker are named <prefix><seq>.spill
+  const std::string          prefix = this->segmentPrefix();
+  const std::string          name   = prefix.substr(prefix.rfind('/') + 1);
+  std::vector<std::uint64_t> seqs{};
+  while (struct dirent* entry = readdir(dir)) {
+    char* end{nullptr};
+    if (0 == std::strncmp(entry->d_name, name.c_str(), name.size())) {
+      std::uint64_t seq = std::strtoull(entry->d_name + name.size(), &end, 10);
+      if (end != entry->d_name + name.size() && 0 == std::strcmp(end, ".spill")) {
+        seqs.push_back(seq);
+      }
+    }
+  }
+  closedir(dir);
+  std::sort(seqs.begin(), seqs.end());
+
+  for (auto seq : seqs) {
+    Segment segment{};
+    segment.seq  = seq;
+    segment.path = prefix + std::to_string(seq) + ".spill";
+
+    int         fd = open(segment.path.c_str(), O_RDWR | O_CLOEXEC);
+    struct stat info {};
+    if (0 > fd || 0 > fstat(fd, &info) || 0 == info.st_size) {
+      if (0 <= fd) {
+        close(fd);
+      }
+      unlink(segment.path.c_str());
+      continue;
+    }
+    segment.size = static_cast<std::size_t>(info.st_size);
+    void* data   = mmap(nullptr, segment.size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (MAP_FAILED == data) {
+      LOG_WARN("Could not map spill file " << segment.path << ": " << std::strerror(errno));
+      continue;
+    }
+    segment.data = static_cast<char*>(data);
+
+    std::size_t records{0};
+    segment.writeOffset = validLength(segment.data, segment.size, records);
+    this->nextSeq       = std::max(this->nextSeq, seq + 1);
+    if (0 == records) {
+      this->closeSegment(segment, true);
+      continue;
+    }
+
+    LOG_INFO("Recovered " << records << " buffered message(s) from " << segment.path);
+    this->stats.spilled.add(records);
+    this->segments.push_back(segment);
+  }
+}
+
+std::string SpillQueue::segmentPrefix() const {
+  return this->options.spillDirectory + "/udpmqttgw-" + std::to_string(this->worker) + "-";
+}
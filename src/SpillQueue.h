@@ -0,0 +1,115 @@
+/**
+ * @file      SpillQueue.h
+ * @brief     Bounded buffer for MQTT messages, which could not be published during a broker outage
+ *
+ * @copyright (c) consider it GmbH, 2020
+ */
+
+#ifndef _SPILLQUEUE_H
+#define _SPILLQUEUE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <vector>
+
+#include "AppOptions.h"
+#include "Stats.h"
+
+/**
+ * @brief FIFO of MQTT messages in a memory buffer, which overflows into files on disk
+ *
+ * Messages are kept in a preallocated circular buffer of SpillMemorySize bytes first. When it is
+ * full and a SpillDirectory is configured, further messages are appended to memory mapped segment
+ * files of SpillSegmentSize bytes (at most SpillMaxSegments per worker). Once anything is on disk,
+ * new messages are appended there as well, so the order of the messages is kept. What does not
+ * fit anywhere, is dropped and counted.
+ *
+ * Segment files, which were left behind by a previous run, are replayed first. A segment is only
+ * deleted after it was read completely, so messages can be published twice after a crash
+ * (at-least-once), but no message of a completed write is lost when the gateway is restarted.
+ *
+ * A spill queue is not thread-safe, it is meant to be used by the publisher thread only.
+ */
+class SpillQueue {
+public:
+  /**
+   * @param options Application configuration
+   * @param worker  Number of the worker, to name its segment files
+   * @param stats   Statistics to count the spilled and dropped messages in
+   */
+  SpillQueue(const AppOptions& options, int worker, WorkerStats& stats);
+
+  SpillQueue(const SpillQueue&) = delete;
+  SpillQueue& operator=(const SpillQueue&) = delete;
+  SpillQueue(SpillQueue&&)                 = delete;
+  SpillQueue& operator=(SpillQueue&&) = delete;
+  ~SpillQueue();
+
+  /**
+   * @brief Append a message at the end of the queue
+   *
+   * @param encoding  Compression of the payload, restored by front()
+   * @param qos       QoS to publish the message with, restored by front()
+   * @return          Returns False, if the message was dropped, because the buffers are full
+   */
+  bool push(const std::string& topic, const char* payload, int payloadLen, std::int64_t arrival, Compression encoding,
+            int qos);
+
+  /**
+   * @brief Returns True, if no message is buffered (neither in memory nor on disk)
+   */
+  bool empty() const { return 0 == this->memoryCount && this->segments.empty(); }
+
+  /**
+   * @brief Oldest message of the queue, the pointers are valid until the next call of pop() or push()
+   *
+   * @return    Returns False, if the queue is empty
+   */
+  bool front(std::string& topic, const char*& payload, int& payloadLen, std::int64_t& arrival, Compression& encoding,
+             int& qos);
+
+  /**
+   * @brief Remove the oldest message from the queue
+   */
+  void pop();
+
+private:
+  struct Segment {
+    std::uint64_t seq{0};
+    std::string   path{};
+    char*         data{nullptr};
+    std::size_t   size{0};
+    std::size_t   writeOffset{0};
+    std::size_t   readOffset{0};
+    bool          writable{false};  // segments of a previous run are only read
+  };
+
+  const AppOptions& options;
+  const int         worker;
+  WorkerStats&      stats;
+
+  // circular buffer of records, memory[memoryRead, memoryWrite) unless wrapped
+  std::vector<char> memory;
+  std::size_t       memoryRead{0};
+  std::size_t       memoryWrite{0};
+  std::size_t       memoryCount{0};
+
+  std::deque<Segment> segments;  // oldest first
+  std::uint64_t       nextSeq{0};
+
+  bool diskErrorReported{false};  // report a failing disk only once, until it works again
+
+  bool        pushMemory(const std::string& topic, const char* payload, int payloadLen, std::int64_t arrival,
+                         Compression encoding, int qos, std::size_t size);
+  bool        pushDisk(const std::string& topic, const char* payload, int payloadLen, std::int64_t arrival,
+                       Compression encoding, int qos, std::size_t size);
+  const char* memoryFront();
+  bool        openSegment();
+  void        closeSegment(Segment& segment, bool remove);
+  void        recoverSegments();
+  std::string segmentPrefix() const;
+};
+
+#endif /* _SPILLQUEUE_H */
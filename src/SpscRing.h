@@ -0,0 +1,170 @@
+/**
+ * @file      SpscRing.h
+ * @brief     Bounded lock-free single-producer/single-consumer ring buffer
+ *
+ * @copyright (c) consider it GmbH, 2020
+ */
+
+#ifndef _SPSCRING_H
+#define _SPSCRING_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+
+#define CACHE_LINE_SIZE 64
+
+/**
+ * @brief Bounded ring of trivially copyable items (e.g. pointers) between two threads
+ *
+ * push() must only be called by the producer thread. pop() is meant for the consumer thread,
+ * but may also be called by the producer to discard the oldest item, when the ring is full.
+ *
+ * Both sides only spin on atomics. If one side has nothing to do, it can sleep with
+ * waitNotEmpty()/ waitNotFull(), the other side then has to call notifyConsumer()/
+ * notifyProducer() after pushing/ popping. These calls are cheap, if nobody is sleeping.
+ */
+template <typename T>
+class SpscRing {
+public:
+  /**
+   * @param minCapacity Minimum number of items, the capacity is rounded up to a power of two
+   */
+  explicit SpscRing(std::size_t minCapacity) : mask{capacityFor(minCapacity) - 1} {
+    this->slots.reset(new std::atomic<T>[this->mask + 1]);  // NOLINT(cppcoreguidelines-avoid-c-arrays)
+  }
+
+  SpscRing(const SpscRing&) = delete;
+  SpscRing& operator=(const SpscRing&) = delete;
+  SpscRing(SpscRing&&)                 = delete;
+  SpscRing& operator=(SpscRing&&) = delete;
+  ~SpscRing()                     = default;
+
+  /**
+   * @brief Append an item (producer only)
+   *
+   * @return    Returns False, if the ring is full
+   */
+  bool push(T item) {
+    const std::size_t head = this->head.load(std::memory_order_relaxed);
+    if (head - this->tail.load(std::memory_order_acquire) > this->mask) {
+      return false;
+    }
+
+    this->slots[head & this->mask].store(item, std::memory_order_relaxed);
+    this->head.store(head + 1, std::memory_order_seq_cst);
+    return true;
+  }
+
+  /**
+   * @brief Remove the oldest item (consumer, or producer to drop the oldest item)
+   *
+   * @return    Returns False, if the ring is empty
+   */
+  bool pop(T& item) {
+    std::size_t tail = this->tail.load(std::memory_order_relaxed);
+    while (tail != this->head.load(std::memory_order_acquire)) {
+      item = this->slots[tail & this->mask].load(std::memory_order_relaxed);
+      if (this->tail.compare_exchange_weak(tail, tail + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  // sequentially consistent, to pair with the sleeping flags in the wait functions
+  std::size_t size() const { return this->head.load() - this->tail.load(); }
+  bool        empty() const { return 0 == this->size(); }
+  std::size_t capacity() const { return this->mask + 1; }
+
+  /**
+   * @brief Capacity of a ring created with the minimum capacity (rounded up to a power of two)
+   */
+  static std::size_t capacityFor(std::size_t minCapacity) {
+    std::size_t result = 1;
+    while (result < minCapacity) {
+      result <<= 1U;
+    }
+    return result;
+  }
+
+  /**
+   * @brief Sleep until the ring is not empty any more or the timeout expired (consumer only)
+   *
+   * @return    Returns False, if the ring is still empty
+   */
+  bool waitNotEmpty(std::chrono::milliseconds timeout) {
+    return this->waitNotEmpty(timeout, [] { return false; });
+  }
+
+  /**
+   * @brief Sleep until the ring is not empty, the condition is met or the timeout expired (consumer only)
+   *
+   * For a consumer with another source, e.g. a second ring, whose producer calls notifyConsumer() of this one.
+   *
+   * @return    Returns False, if the ring is still empty and the condition not met
+   */
+  template <typename Predicate>
+  bool waitNotEmpty(std::chrono::milliseconds timeout, Predicate condition) {
+    std::unique_lock<std::mutex> lock(this->mutex);
+    this->consumerSleeping.store(true);
+    bool ready = this->changed.wait_for(lock, timeout, [this, &condition] { return !this->empty() || condition(); });
+    this->consumerSleeping.store(false);
+    return ready;
+  }
+
+  /**
+   * @brief Sleep until the ring is not full any more or the timeout expired (producer only)
+   *
+   * @return    Returns False, if the ring is still full
+   */
+  bool waitNotFull(std::chrono::milliseconds timeout) {
+    std::unique_lock<std::mutex> lock(this->mutex);
+    this->producerSleeping.store(true);
+    bool ready = this->changed.wait_for(lock, timeout, [this] { return this->size() <= this->mask; });
+    this->producerSleeping.store(false);
+    return ready;
+  }
+
+  /**
+   * @brief Wake up the consumer, if it is sleeping (call after push)
+   */
+  void notifyConsumer() {
+    if (this->consumerSleeping.load()) {
+      std::lock_guard<std::mutex> lock(this->mutex);
+      this->changed.notify_all();
+    }
+  }
+
+  /**
+   * @brief Wake up the producer, if it is sleeping (call after pop)
+   */
+  void notifyProducer() {
+    if (this->producerSleeping.load()) {
+      std::lock_guard<std::mutex> lock(this->mutex);
+      this->changed.notify_all();
+    }
+  }
+
+private:
+  const std::size_t                 mask;
+  std::unique_ptr<std::atomic<T>[]> slots;  // NOLINT(cppcoreguidelines-avoid-c-arrays,modernize-avoid-c-arrays)
+
+  // keep the indices on separate cache lines, so producer and consumer do not invalidate each other
+  // (padding instead of alignas, because C++14 does not support over-aligned heap allocations)
+  char                     padSlots[CACHE_LINE_SIZE]{};  // NOLINT(modernize-avoid-c-arrays)
+  std::atomic<std::size_t> head{0};                      // next slot to write
+  char                     padHead[CACHE_LINE_SIZE]{};   // NOLINT(modernize-avoid-c-arrays)
+  std::atomic<std::size_t> tail{0};                      // next slot to read
+  char                     padTail[CACHE_LINE_SIZE]{};   // NOLINT(modernize-avoid-c-arrays)
+
+  std::atomic<bool>       consumerSleeping{false};
+  std::atomic<bool>       producerSleeping{false};
+  std::mutex              mutex;
+  std::condition_variable changed;
+};
+
+#endif /* _SPSCRING_H */
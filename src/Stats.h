@@ -0,0 +1,155 @@
+/**
+ * @file      Stats.h
+ * @brief     Lock-free counters and latency histograms of the gateway
+ *
+ * @copyright (c) consider it GmbH, 2020
+ */
+
+#ifndef _STATS_H
+#define _STATS_H
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+
+#include "SpscRing.h"
+
+/**
+ * @brief Monotonic event counter, cheap enough for the hot path
+ */
+class Counter {
+public:
+  void          add(std::uint64_t value = 1) { this->count.fetch_add(value, std::memory_order_relaxed); }
+  std::uint64_t get() const { return this->count.load(std::memory_order_relaxed); }
+
+private:
+  std::atomic<std::uint64_t> count{0};
+};
+
+/**
+ * @brief Histogram of latencies in nanoseconds with logarithmic buckets (HDR-style)
+ *
+ * Every power of two is split into 8 linear sub-buckets, so each bucket is at most 12.5 %
+ * wide. Recording is a few shifts and one atomic increment, values up to 2^48 ns (3 days).
+ */
+class LatencyHistogram {
+public:
+  static constexpr unsigned    SUB_BUCKET_BITS = 3;
+  static constexpr unsigned    SUB_BUCKETS     = 1U << SUB_BUCKET_BITS;
+  static constexpr unsigned    MAX_VALUE_BITS  = 48;
+  static constexpr std::size_t BUCKETS         = (MAX_VALUE_BITS - SUB_BUCKET_BITS + 1) * SUB_BUCKETS;
+
+  void record(std::chrono::nanoseconds latency) {
+    auto value = static_cast<std::uint64_t>(std::max<std::chrono::nanoseconds::rep>(latency.count(), 0));
+    value      = std::min<std::uint64_t>(value, (1ULL << MAX_VALUE_BITS) - 1);
+
+    this->buckets[bucketOf(value)].fetch_add(1, std::memory_order_relaxed);
+    this->count.fetch_add(1, std::memory_order_relaxed);
+    this->sum.fetch_add(value, std::memory_order_relaxed);
+  }
+
+  std::uint64_t samples() const { return this->count.load(std::memory_order_relaxed); }
+  std::uint64_t total() const { return this->sum.load(std::memory_order_relaxed); }
+  std::uint64_t bucketCount(std::size_t bucket) const {
+    return this->buckets[bucket].load(std::memory_order_relaxed);
+  }
+
+  /**
+   * @brief Exclusive upper bound of the values in a bucket
+   */
+  static std::uint64_t upperBound(std::size_t bucket) {
+    if (bucket < SUB_BUCKETS) {
+      return bucket + 1;
+    }
+    std::size_t shift = bucket / SUB_BUCKETS - 1;
+    return (SUB_BUCKETS + bucket % SUB_BUCKETS + 1) << shift;
+  }
+
+  /**
+   * @brief Upper bound of the latency in nanoseconds, below which the given fraction of samples lies
+   */
+  std::uint64_t quantile(double fraction) const {
+    auto          threshold = static_cast<std::uint64_t>(fraction * static_cast<double>(this->samples()));
+    std::uint64_t seen{0};
+    for (std::size_t bucket = 0; bucket < BUCKETS; bucket++) {
+      seen += this->bucketCount(bucket);
+      if (seen > threshold) {
+        return upperBound(bucket);
+      }
+    }
+    return 0;
+  }
+
+private:
+  std::array<std::atomic<std::uint64_t>, BUCKETS> buckets{};
+  std::atomic<std::uint64_t>                      count{0};
+  std::atomic<std::uint64_t>                      sum{0};
+
+  static std::size_t bucketOf(std::uint64_t value) {
+    if (value < SUB_BUCKETS) {
+      return value;
+    }
+    unsigned msb   = 63U - static_cast<unsigned>(__builtin_clzll(value));
+    unsigned shift = msb - SUB_BUCKET_BITS;
+    return (shift + 1) * SUB_BUCKETS + ((value >> shift) & (SUB_BUCKETS - 1));
+  }
+};
+
+/**
+ * @brief Statistics of one worker (pipeline and MQTT connection)
+ *
+ * The counters are grouped by the thread updating them and each group starts on its own cache
+ * line, so the threads do not slow each other down. As C++14 does not support over-aligned heap
+ * allocations, the workers allocate the statistics with the aligned operator new below.
+ */
+struct WorkerStats {
+  static void* operator new(std::size_t size) {
+    void* memory{nullptr};
+    if (0 != posix_memalign(&memory, alignof(WorkerStats), size)) {
+      throw std::bad_alloc();
+    }
+    return memory;
+  }
+  static void operator delete(void* memory) noexcept { std::free(memory); }
+
+  // receiver thread
+  alignas(CACHE_LINE_SIZE) Counter received;       // valid datagrams
+  Counter                          receivedBytes;  // payload bytes of the valid datagrams
+  Counter                          truncated;      // datagrams larger than UdpMaxDatagramSize
+  Counter                          droppedOldest;  // discarded from the full queue
+  Counter                          droppedNewest;  // not queued, because the queue was full
+  Counter                          duplicates;     // dropped, because the same payload was received within DedupWindow
+  Counter                          rateLimited;    // dropped, because the source exceeded SourceRateLimit
+  Counter                          shed;           // bulk datagrams not queued, because the lane was overloaded
+
+  Counter filteredLength;    // dropped by a PayloadFilter, because of their length
+  Counter filteredType;      // dropped by a PayloadFilter, because of their message type
+  Counter filteredMagic;     // dropped by a PayloadFilter, because the magic bytes did not match
+  Counter filteredChecksum;  // dropped by a PayloadFilter, because the checksum did not match
+
+  LatencyHistogram receiveLatency;  // kernel arrival until fetched from the socket (LatencyProbe only)
+
+  // publisher thread
+  alignas(CACHE_LINE_SIZE) Counter published;         // MQTT messages handed over to the MQTT library
+  Counter                          publishFailures;   // MQTT messages rejected by the MQTT library
+  LatencyHistogram                 queueLatency;      // UDP reception until hand over to the MQTT library (no replays)
+  Counter                          spilled;           // MQTT messages buffered, while the broker was unreachable
+  Counter                          spillDropped;      // MQTT messages lost, because the buffers were full
+  Counter                          replayed;          // buffered MQTT messages handed over to the MQTT library
+  Counter                          fairDropped;       // dropped from the longest source queue, the fair queue was full
+  Counter                          compressedInput;   // payload bytes before the compression
+  Counter                          compressedOutput;  // payload bytes after the compression
+  Counter                          degraded;          // bulk datagrams published with QoS 0, as the lane was overloaded
+
+  // threads of the MQTT library
+  alignas(CACHE_LINE_SIZE) Counter delivered;         // MQTT messages sent (QoS 0) or acknowledged (QoS>0)
+  Counter                          deliveryFailures;  // MQTT messages lost after the hand over
+  LatencyHistogram                 ackLatency;        // hand over until acknowledged by the broker
+};
+
+#endif /* _STATS_H */
@@ -0,0 +1,330 @@
+/**
+ * @file      StatsReporter.cpp
+ * @brief     Periodic statistics log line and Prometheus HTTP endpoint
+ *
+ * @copyright (c) consider it GmbH, 2020
+ */
+
+#include "StatsReporter.h"
+
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+#include <utility>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include "Log.h"
+
+// static configuration values
+#define POLL_INTERVAL_MS 500  // how fast the thread reacts to stop()
+#define CLIENT_TIMEOUT_S 1    // seconds to wait for the request of a client
+#define REQUEST_SIZE 1024     // only the beginning of the request is read
+
+namespace {
+
+// upper bounds of the Prometheus histogram buckets in nanoseconds
+const std::array<std::uint64_t, 19> HISTOGRAM_BOUNDS_NS{
+    10000,    25000,    50000,     100000,    250000,    500000,     1000000,    2500000,    5000000,   10000000,
+    25000000, 50000000, 100000000, 250000000, 500000000, 1000000000, 2500000000, 5000000000, 10000000000};
+
+using Workers = std::vector<const WorkerStats*>;
+
+/**
+ * @brief Sum of one counter over all workers
+ */
+std::uint64_t sumOf(const Workers& workers, Counter WorkerStats::*counter) {
+  std::uint64_t sum{0};
+  for (const auto* worker : workers) {
+    sum += (worker->*counter).get();
+  }
+  return sum;
+}
+
+void writeCounter(std::ostream& out, const Workers& workers, const char* name, const char* help,
+                  Counter WorkerStats::*counter) {
+  out << "# HELP " << name << " " << help << "\n";
+  out << "# TYPE " << name << " counter\n";
+  for (std::size_t i = 0; i < workers.size(); i++) {
+    out << name << "{worker=\"" << i << "\"} " << (workers[i]->*counter).get() << "\n";
+  }
+}
+
+void writeHistogram(std::ostream& out, const Workers& workers, const char* name, const char* help,
+                    LatencyHistogram WorkerStats::*member) {
+  out << "# HELP " << name << " " << help << "\n";
+  out << "# TYPE " << name << " histogram\n";
+  for (std::size_t i = 0; i < workers.size(); i++) {
+    const LatencyHistogram& histogram = workers[i]->*member;
+
+    // a bucket of the histogram counts for a bound, if all of its values are below the bound
+    std::uint64_t cumulative{0};
+    std::size_t   bucket{0};
+    for (auto bound : HISTOGRAM_BOUNDS_NS) {
+      while (bucket < LatencyHistogram::BUCKETS && LatencyHistogram::upperBound(bucket) <= bound) {
+        cumulative += histogram.bucketCount(bucket++);
+      }
+      out << name << "_bucket{worker=\"" << i << "\",le=\"" << static_cast<double>(bound) / 1e9 << "\"} "
+          << cumulative << "\n";
+    }
+    while (bucket < LatencyHistogram::BUCKETS) {
+      cumulative += histogram.bucketCount(bucket++);
+    }
+    out << name << "_bucket{worker=\"" << i << "\",le=\"+Inf\"} " << cumulative << "\n";
+    out << name << "_sum{worker=\"" << i << "\"} " << static_cast<double>(histogram.total()) / 1e9 << "\n";
+    out << name << "_count{worker=\"" << i << "\"} " << cumulative << "\n";
+  }
+}
+
+/**
+ * @brief Quantiles of a histogram of all workers as "p50/p99/p99.9 us"
+ */
+std::string quantilesOf(const Workers& workers, LatencyHistogram WorkerStats::*member) {
+  std::ostringstream out;
+  std::uint64_t      p50{0};
+  std::uint64_t      p99{0};
+  std::uint64_t      p999{0};
+
+  // the workers are shown by their worst quantile, merging the histograms is not worth it here
+  for (const auto* worker : workers) {
+    p50  = std::max(p50, (worker->*member).quantile(0.5));
+    p99  = std::max(p99, (worker->*member).quantile(0.99));
+    p999 = std::max(p999, (worker->*member).quantile(0.999));
+  }
+  out << p50 / 1000 << "/" << p99 / 1000 << "/" << p999 / 1000 << " us";
+  return out.str();
+}
+
+}  // namespace
+
+StatsReporter::StatsReporter(const AppOptions& options, std::vector<const WorkerStats*> workers) :
+    options{options},
+    workers{std::move(workers)} {}
+
+StatsReporter::~StatsReporter() { this->stop(); }
+
+bool StatsReporter::start() {
+  if (0 == this->options.statsInterval && 0 == this->options.statsHttpPort) {
+    return true;
+  }
+
+  if (0 != this->options.statsHttpPort) {
+    struct sockaddr_in addr {};
+    addr.sin_family = AF_INET;
+    addr.sin_port   = htons(this->options.statsHttpPort);
+    if (1 != inet_pton(AF_INET, this->options.statsHttpAddress.c_str(), &addr.sin_addr)) {
+      LOG_ERROR("Invalid StatsHttpAddress " << this->options.statsHttpAddress);
+      return false;
+    }
+
+    this->listenfd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    int enable     = 1;
+    if (0 > this->listenfd ||
+        0 > setsockopt(this->listenfd, SOL_SOCKET, SO_REUSEADDR, &enable, sizeof(enable)) ||
+        0 > bind(this->listenfd,
+                 reinterpret_cast<struct sockaddr*>(&addr),  // NOLINT(cppcoreguidelines-pro-type-reinterpret-cast)
+                 sizeof(addr)) ||
+        0 > listen(this->listenfd, SOMAXCONN)) {
+      LOG_ERROR("Could not open statistics endpoint on " << this->options.statsHttpAddress << ":"
+                << this->options.statsHttpPort << ": " << std::strerror(errno));
+      if (0 <= this->listenfd) {
+        close(this->listenfd);
+        this->listenfd = -1;
+      }
+      return false;
+    }
+
+    if (this->options.verbosity >= 1) {
+      LOG_INFO("Serving statistics on http://" << this->options.statsHttpAddress << ":"
+               << this->options.statsHttpPort << "/metrics");
+    }
+  }
+
+  this->lastLog = std::chrono::steady_clock::now();
+  this->running = true;
+  this->thread  = std::thread(&StatsReporter::run, this);
+  return true;
+}
+
+void StatsReporter::stop() {
+  this->running = false;
+  if (this->thread.joinable()) {
+    this->thread.join();
+  }
+  if (0 <= this->listenfd) {
+    close(this->listenfd);
+    this->listenfd = -1;
+  }
+}
+
+void StatsReporter::run() {
+  const auto interval = std::chrono::seconds(this->options.statsInterval);
+
+  while (this->running) {
+    struct pollfd pfd {};
+    pfd.fd     = this->listenfd;
+    pfd.events = POLLIN;
+
+    // poll ignores negative file descriptors, so this is just a sleep without endpoint
+    int ready = poll(&pfd, 1, POLL_INTERVAL_MS);
+    if (0 < ready && 0 != (pfd.revents & POLLIN)) {
+      int clientfd = accept4(this->listenfd, nullptr, nullptr, SOCK_CLOEXEC);
+      if (0 <= clientfd) {
+        this->serveClient(clientfd);
+        close(clientfd);
+      }
+    }
+
+    auto now = std::chrono::steady_clock::now();
+    if (0 != this->options.statsInterval && now - this->lastLog >= interval) {
+      this->logLine();
+      this->lastLog = now;
+    }
+  }
+}
+
+void StatsReporter::logLine() {
+  std::uint64_t received   = sumOf(this->workers, &WorkerStats::received);
+  std::uint64_t published  = sumOf(this->workers, &WorkerStats::published);
+  std::uint64_t truncated  = sumOf(this->workers, &WorkerStats::truncated);
+  std::uint64_t duplicates = sumOf(this->workers, &WorkerStats::duplicates);
+  std::uint64_t limited    = sumOf(this->workers, &WorkerStats::rateLimited);
+  std::uint64_t filtered   = sumOf(this->workers, &WorkerStats::filteredLength) +
+                           sumOf(this->workers, &WorkerStats::filteredType) +
+                           sumOf(this->workers, &WorkerStats::filteredMagic) +
+                           sumOf(this->workers, &WorkerStats::filteredChecksum);
+  std::uint64_t failures =
+      sumOf(this->workers, &WorkerStats::publishFailures) + sumOf(this->workers, &WorkerStats::deliveryFailures);
+  std::uint64_t dropped = sumOf(this->workers, &WorkerStats::droppedOldest) +
+                          sumOf(this->workers, &WorkerStats::droppedNewest) +
+                          sumOf(this->workers, &WorkerStats::fairDropped) +
+                          sumOf(this->workers, &WorkerStats::shed) +
+                          sumOf(this->workers, &WorkerStats::spillDropped);
+  std::uint64_t backlog = sumOf(this->workers, &WorkerStats::spilled) - sumOf(this->workers, &WorkerStats::replayed);
+
+  auto seconds = static_cast<std::uint64_t>(this->options.statsInterval);
+  std::ostringstream line;
+  line << "Stats: received " << received << " (" << (received - this->lastReceived) / seconds << "/s), published "
+       << published << " (" << (published - this->lastPublished) / seconds << "/s), failed " << failures
+       << ", dropped " << dropped << ", truncated " << truncated << ", duplicates " << duplicates << ", limited "
+       << limited << ", filtered " << filtered << ", buffered " << backlog << ", latency p50/p99/p99.9";
+  if (LatencyProbe::Off != this->options.latencyProbe) {
+    line << " receive " << quantilesOf(this->workers, &WorkerStats::receiveLatency) << ",";
+  }
+  line << " queue " << quantilesOf(this->workers, &WorkerStats::queueLatency) << ", ack "
+       << quantilesOf(this->workers, &WorkerStats::ackLatency);
+  LOG_INFO(line.str());
+
+  this->lastReceived  = received;
+  this->lastPublished = published;
+}
+
+void StatsReporter::serveClient(int clientfd) const {
+  struct timeval timeout {};
+  timeout.tv_sec = CLIENT_TIMEOUT_S;
+  setsockopt(clientfd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+  setsockopt(clientfd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+
+  // every request gets the metrics, so the request is only read to be polite to the client
+  std::array<char, REQUEST_SIZE> request{};
+  if (0 > recv(clientfd, request.data(), request.size(), 0)) {
+    return;
+  }
+
+  std::string        body = this->prometheusText();
+  std::ostringstream response;
+  response << "HTTP/1.0 200 OK\r\n"
+           << "Content-Type: text/plain; version=0.0.4\r\n"
+           << "Content-Length: " << body.size() << "\r\n"
+           << "Connection: close\r\n\r\n"
+           << body;
+
+  std::string data = response.str();
+  std::size_t sent{0};
+  while (sent < data.size()) {
+    ssize_t rc = send(clientfd, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+    if (0 >= rc) {
+      return;
+    }
+    sent += static_cast<std::size_t>(rc);
+  }
+}
+
+std::string StatsReporter::prometheusText() const {
+  std::ostringstream out;
+
+  writeCounter(out, this->workers, "udpmqttgw_received_datagrams_total", "Valid UDP datagrams received",
+               &WorkerStats::received);
+  writeCounter(out, this->workers, "udpmqttgw_received_bytes_total", "Payload bytes of the valid UDP datagrams",
+               &WorkerStats::receivedBytes);
+  writeCounter(out, this->workers, "udpmqttgw_truncated_datagrams_total",
+               "UDP datagrams dropped, because they were larger than UdpMaxDatagramSize", &WorkerStats::truncated);
+  writeCounter(out, this->workers, "udpmqttgw_dropped_oldest_total",
+               "Queued datagrams dropped to make room for new ones", &WorkerStats::droppedOldest);
+  writeCounter(out, this->workers, "udpmqttgw_dropped_newest_total",
+               "Received datagrams dropped, because the queue was full", &WorkerStats::droppedNewest);
+  writeCounter(out, this->workers, "udpmqttgw_duplicate_datagrams_total",
+               "Received datagrams dropped, because the same payload was seen within DedupWindow",
+               &WorkerStats::duplicates);
+  writeCounter(out, this->workers, "udpmqttgw_rate_limited_datagrams_total",
+               "Received datagrams dropped, because their source exceeded SourceRateLimit", &WorkerStats::rateLimited);
+  writeCounter(out, this->workers, "udpmqttgw_filtered_length_total",
+               "Received datagrams dropped by a PayloadFilter, because of their length", &WorkerStats::filteredLength);
+  writeCounter(out, this->workers, "udpmqttgw_filtered_type_total",
+               "Received datagrams dropped by a PayloadFilter, because of their message type",
+               &WorkerStats::filteredType);
+  writeCounter(out, this->workers, "udpmqttgw_filtered_magic_total",
+               "Received datagrams dropped by a PayloadFilter, because the magic bytes did not match",
+               &WorkerStats::filteredMagic);
+  writeCounter(out, this->workers, "udpmqttgw_filtered_checksum_total",
+               "Received datagrams dropped by a PayloadFilter, because the checksum did not match",
+               &WorkerStats::filteredChecksum);
+  writeCounter(out, this->workers, "udpmqttgw_fair_queue_dropped_total",
+               "Queued datagrams dropped from the longest source queue, because the fair queue was full",
+               &WorkerStats::fairDropped);
+  writeCounter(out, this->workers, "udpmqttgw_shed_datagrams_total",
+               "Bulk datagrams dropped, because the queue of the lane exceeded ShedQueueDepth or ShedLatency",
+               &WorkerStats::shed);
+  writeCounter(out, this->workers, "udpmqttgw_degraded_datagrams_total",
+               "Bulk datagrams published with QoS 0, because the lane was overloaded", &WorkerStats::degraded);
+  writeCounter(out, this->workers, "udpmqttgw_published_messages_total",
+               "MQTT messages handed over to the MQTT library", &WorkerStats::published);
+  writeCounter(out, this->workers, "udpmqttgw_publish_failures_total", "MQTT messages rejected by the MQTT library",
+               &WorkerStats::publishFailures);
+  writeCounter(out, this->workers, "udpmqttgw_spilled_messages_total",
+               "MQTT messages buffered, while the broker was unreachable", &WorkerStats::spilled);
+  writeCounter(out, this->workers, "udpmqttgw_spill_dropped_messages_total",
+               "MQTT messages dropped, because the outage buffers were full", &WorkerStats::spillDropped);
+  writeCounter(out, this->workers, "udpmqttgw_replayed_messages_total",
+               "Buffered MQTT messages handed over to the MQTT library after reconnecting", &WorkerStats::replayed);
+  writeCounter(out, this->workers, "udpmqttgw_compression_input_bytes_total",
+               "Payload bytes of the compressed MQTT messages before the compression", &WorkerStats::compressedInput);
+  writeCounter(out, this->workers, "udpmqttgw_compression_output_bytes_total",
+               "Payload bytes of the compressed MQTT messages after the compression", &WorkerStats::compressedOutput);
+  writeCounter(out, this->workers, "udpmqttgw_delivered_messages_total",
+               "MQTT messages sent (QoS 0) or acknowledged by the broker (QoS>0)", &WorkerStats::delivered);
+  writeCounter(out, this->workers, "udpmqttgw_delivery_failures_total", "MQTT messages lost after the hand over",
+               &WorkerStats::deliveryFailures);
+
+  if (LatencyProbe::Off != this->options.latencyProbe) {
+    writeHistogram(out, this->workers, "udpmqttgw_receive_latency_seconds",
+                   "Time from the kernel arrival of the UDP datagram until it was fetched from the socket",
+                   &WorkerStats::receiveLatency);
+  }
+  writeHistogram(out, this->workers, "udpmqttgw_queue_latency_seconds",
+                 "Time from UDP reception until the message was handed over to the MQTT library",
+                 &WorkerStats::queueLatency);
+  writeHistogram(out, this->workers, "udpmqttgw_ack_latency_seconds",
+                 "Time from the hand over until the MQTT library reported the message as delivered",
+                 &WorkerStats::ackLatency);
+
+  return out.str();
+}
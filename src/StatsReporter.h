@@ -0,0 +1,74 @@
+/**
+ * @file      StatsReporter.h
+ * @brief     Periodic statistics log line and Prometheus HTTP endpoint
+ *
+ * @copyright (c) consider it GmbH, 2020
+ */
+
+#ifndef _STATSREPORTER_H
+#define _STATSREPORTER_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "AppOptions.h"
+#include "Stats.h"
+
+/**
+ * @brief Reports the statistics of all workers on its own thread
+ *
+ * Reading the statistics only loads the counters, so reporting never slows down the
+ * receiver and publisher threads.
+ */
+class StatsReporter {
+public:
+  /**
+   * @param options Application configuration (StatsInterval, StatsHttpAddress, StatsHttpPort)
+   * @param workers Statistics of all workers, index is the worker number
+   */
+  StatsReporter(const AppOptions& options, std::vector<const WorkerStats*> workers);
+
+  StatsReporter(const StatsReporter&) = delete;
+  StatsReporter& operator=(const StatsReporter&) = delete;
+  StatsReporter(StatsReporter&&)                 = delete;
+  StatsReporter& operator=(StatsReporter&&) = delete;
+  ~StatsReporter();
+
+  /**
+   * @brief Open the HTTP endpoint (if configured) and start the reporting thread
+   *
+   * @return    Returns False, if the HTTP endpoint could not be opened (which was already reported)
+   */
+  bool start();
+
+  /**
+   * @brief Stop the reporting thread and close the HTTP endpoint
+   */
+  void stop();
+
+  /**
+   * @brief Render the statistics in the Prometheus text exposition format
+   */
+  std::string prometheusText() const;
+
+private:
+  const AppOptions&               options;
+  std::vector<const WorkerStats*> workers;
+  int                             listenfd{-1};
+  std::atomic<bool>               running{false};
+  std::thread                     thread;
+
+  std::chrono::steady_clock::time_point lastLog{};
+  std::uint64_t                         lastReceived{0};
+  std::uint64_t                         lastPublished{0};
+
+  void run();
+  void logLine();
+  void serveClient(int clientfd) const;
+};
+
+#endif /* _STATSREPORTER_H */
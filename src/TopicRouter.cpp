@@ -0,0 +1,147 @@
+/**
+ * @file      TopicRouter.cpp
+ * @brief     Selection of the MQTT topic for each received datagram
+ *
+ * @copyright (c) consider it GmbH, 2020
+ */
+
+#include "TopicRouter.h"
+
+// static configuration values
+#define TOPIC_CACHE_SIZE 4096  // rendered topics per rule, further sources are rendered per packet
+#define EMPTY_PAYLOAD 256      // rule table index for datagrams without payload
+
+// parts of the cache key besides the source address: source port and route
+#define KEY_SRC_PORT 0xFFFF0000U
+#define KEY_ROUTE 0x0000FFFFU
+
+TopicRouter::TopicRouter(const AppOptions& options) : options{options}, rules(options.topicRules.size()) {
+  for (std::size_t i = 0; i < this->rules.size(); i++) {
+    const auto& ruleOpts = options.topicRules[i];
+    auto&       rule     = this->rules[i];
+
+    rule.port    = ruleOpts.port;
+    rule.srcAddr = ruleOpts.srcAddr;
+    rule.srcMask = ruleOpts.srcMask;
+    rule.srcPort = static_cast<std::uint16_t>(ruleOpts.srcPort);
+    rule.prefix     = ruleOpts.prefix;
+    rule.keySrcAddr = false;
+    rule.keyMask    = 0;
+
+    // split the topic at the placeholders (which were validated by the configuration parser)
+    std::string literal{};
+    std::size_t pos{0};
+    while (pos < ruleOpts.topic.size()) {
+      auto open = ruleOpts.topic.find('{', pos);
+      literal += ruleOpts.topic.substr(pos, open - pos);
+      if (std::string::npos == open) {
+        break;
+      }
+
+      auto        close = ruleOpts.topic.find('}', open);
+      std::string name  = ruleOpts.topic.substr(open, close - open + 1);
+      pos               = close + 1;
+
+      if ("{src_ip}" == name) {
+        rule.parts.push_back({literal, Placeholder::SrcIp});
+        rule.keySrcAddr = true;
+      } else if ("{src_port}" == name) {
+        rule.parts.push_back({literal, Placeholder::SrcPort});
+        rule.keyMask |= KEY_SRC_PORT;
+      } else {
+        rule.parts.push_back({literal, Placeholder::Port});
+        rule.keyMask |= KEY_ROUTE;
+      }
+      literal.clear();
+    }
+
+    if (rule.parts.empty()) {
+      rule.topic = literal;
+    } else {
+      rule.parts.push_back({literal, Placeholder::None});
+    }
+  }
+
+  // index the rules of each route by the first byte, they can match
+  this->tables.resize(options.routes.size());
+  for (std::size_t route = 0; route < options.routes.size(); route++) {
+    for (auto& rule : this->rules) {
+      if (0 != rule.port && options.routes[route].port != rule.port) {
+        continue;
+      }
+
+      if (rule.prefix.empty()) {
+        for (auto& candidates : this->tables[route]) {
+          candidates.push_back(&rule);
+        }
+      } else {
+        this->tables[route][static_cast<unsigned char>(rule.prefix[0])].push_back(&rule);
+      }
+    }
+  }
+}
+
+const std::string* TopicRouter::topicFor(std::size_t route, Packet& packet) {
+  const auto& candidates = this->tables[route][(packet.len > 0) ? static_cast<unsigned char>(packet.data[0])
+                                                                : EMPTY_PAYLOAD];
+  for (Rule* rule : candidates) {
+    if (!matches(*rule, packet)) {
+      continue;
+    }
+    if (rule->parts.empty()) {
+      return &rule->topic;
+    }
+
+    std::uint32_t portAndRoute =
+        (static_cast<std::uint32_t>(IpAddress::portOf(packet.source)) << 16U) | static_cast<std::uint32_t>(route);
+    CacheKey key{rule->keySrcAddr ? IpAddress::of(packet.source) : IpAddress{}, portAndRoute & rule->keyMask};
+
+    auto cached = rule->cache.find(key);
+    if (rule->cache.end() != cached) {
+      return &cached->second;
+    }
+
+    if (rule->cache.size() < TOPIC_CACHE_SIZE) {
+      auto& topic = rule->cache[key];
+      this->render(*rule, route, packet, topic);
+      return &topic;
+    }
+
+    // too many sources, so do not grow the cache any further
+    this->render(*rule, route, packet, packet.topicBuffer);
+    return &packet.topicBuffer;
+  }
+
+  return &this->options.routes[route].topic;
+}
+
+bool TopicRouter::matches(const Rule& rule, const Packet& packet) {
+  if ((IpAddress::of(packet.source) & rule.srcMask) != rule.srcAddr) {
+    return false;
+  }
+  if (0 != rule.srcPort && IpAddress::portOf(packet.source) != rule.srcPort) {
+    return false;
+  }
+  return packet.len >= static_cast<int>(rule.prefix.size()) &&
+         0 == rule.prefix.compare(0, std::string::npos, packet.data, rule.prefix.size());
+}
+
+void TopicRouter::render(const Rule& rule, std::size_t route, const Packet& packet, std::string& topic) const {
+  topic.clear();
+  for (const auto& part : rule.parts) {
+    topic += part.literal;
+    switch (part.placeholder) {
+    case Placeholder::None:
+      break;
+    case Placeholder::SrcIp:
+      topic += IpAddress::of(packet.source).toString();
+      break;
+    case Placeholder::SrcPort:
+      topic += std::to_string(IpAddress::portOf(packet.source));
+      break;
+    case Placeholder::Port:
+      topic += std::to_string(this->options.routes[route].port);
+      break;
+    }
+  }
+}
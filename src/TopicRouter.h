@@ -0,0 +1,101 @@
+/**
+ * @file      TopicRouter.h
+ * @brief     Selection of the MQTT topic for each received datagram
+ *
+ * @copyright (c) consider it GmbH, 2020
+ */
+
+#ifndef _TOPICROUTER_H
+#define _TOPICROUTER_H
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "AppOptions.h"
+#include "IpAddress.h"
+#include "Packet.h"
+
+/**
+ * @brief Topic rules of the configuration, compiled to a lookup table at startup
+ *
+ * For every route, the rules are indexed by the first payload byte (like the D2X message
+ * type). So a lookup only checks the few rules, which can match this byte, in configuration
+ * order. Topics without placeholders are rendered once at startup. Templated topics are
+ * rendered once per source and cached, so the hot path does no string formatting.
+ *
+ * A router is not thread-safe, each receiver thread needs its own instance.
+ */
+class TopicRouter {
+public:
+  explicit TopicRouter(const AppOptions& options);
+
+  TopicRouter(const TopicRouter&) = delete;
+  TopicRouter& operator=(const TopicRouter&) = delete;
+  TopicRouter(TopicRouter&&)                 = delete;
+  TopicRouter& operator=(TopicRouter&&) = delete;
+  ~TopicRouter()                        = default;
+
+  /**
+   * @brief Find the topic for a received datagram
+   *
+   * @param route   Index of the route (socket), which received the packet
+   * @param packet  Received packet, its topic buffer may be used for rarely seen sources
+   * @return        Topic, which stays valid as long as the router and the packet
+   */
+  const std::string* topicFor(std::size_t route, Packet& packet);
+
+private:
+  enum class Placeholder { None, SrcIp, SrcPort, Port };
+
+  struct TemplatePart {
+    std::string literal;      // text in front of the placeholder
+    Placeholder placeholder;  // None for the trailing text
+  };
+
+  // source of a rendered topic, only the parts with placeholders in the topic are set
+  struct CacheKey {
+    IpAddress     srcAddr;
+    std::uint32_t portAndRoute;
+
+    bool operator==(const CacheKey& other) const {
+      return this->srcAddr == other.srcAddr && this->portAndRoute == other.portAndRoute;
+    }
+  };
+
+  struct CacheKeyHash {
+    std::size_t operator()(const CacheKey& key) const {
+      return static_cast<std::size_t>(key.srcAddr.hash() ^ (key.portAndRoute * 0x9E3779B97F4A7C15ULL));
+    }
+  };
+
+  struct Rule {
+    int           port;
+    IpAddress     srcAddr;
+    IpAddress     srcMask;
+    std::uint16_t srcPort;  // 0: any
+    std::string   prefix;
+
+    std::string               topic;  // rendered topic, if there are no placeholders
+    std::vector<TemplatePart> parts;  // empty, if there are no placeholders
+    bool                      keySrcAddr;
+    std::uint32_t             keyMask;  // of CacheKey::portAndRoute
+
+    std::unordered_map<CacheKey, std::string, CacheKeyHash> cache;  // rendered topics by source
+  };
+
+  // one candidate list per first payload byte and one for empty payloads
+  using RuleTable = std::array<std::vector<Rule*>, 257>;
+
+  const AppOptions&      options;
+  std::vector<Rule>      rules;
+  std::vector<RuleTable> tables;  // index is the route
+
+  static bool matches(const Rule& rule, const Packet& packet);
+  void        render(const Rule& rule, std::size_t route, const Packet& packet, std::string& topic) const;
+};
+
+#endif /* _TOPICROUTER_H */
@@ -0,0 +1,110 @@
+/**
+ * @file      UdpReceiver.cpp
+ * @brief     Batched reception of UDP datagrams
+ *
+ * @copyright (c) consider it GmbH, 2020
+ */
+
+#include "UdpReceiver.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <ctime>
+
+#include <linux/errqueue.h>
+
+#include "Log.h"
+
+// static configuration values
+#define CONTROL_SIZE CMSG_SPACE(sizeof(struct scm_timestamping))  // large enough for both kinds of timestamps
+#define NS_PER_S 1000000000LL
+
+std::int64_t arrivalOf(struct msghdr& msg) {
+  struct timespec stamp {};
+  for (struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg); nullptr != cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+    if (SOL_SOCKET != cmsg->cmsg_level) {
+      continue;
+    }
+    if (SCM_TIMESTAMPNS == cmsg->cmsg_type) {
+      std::memcpy(&stamp, CMSG_DATA(cmsg), sizeof(stamp));
+    } else if (SCM_TIMESTAMPING == cmsg->cmsg_type) {
+      // ts[0] is the software, ts[2] the raw hardware timestamp
+      struct scm_timestamping stamps {};
+      std::memcpy(&stamps, CMSG_DATA(cmsg), sizeof(stamps));
+      stamp = (0 != stamps.ts[2].tv_sec) ? stamps.ts[2] : stamps.ts[0];
+    }
+  }
+  return static_cast<std::int64_t>(stamp.tv_sec) * NS_PER_S + stamp.tv_nsec;
+}
+
+UdpReceiver::UdpReceiver(int batchSize, std::size_t bufferSize, WorkerStats& stats, LatencyProbe probe) :
+    bufferSize{bufferSize},
+    stats{stats},
+    probe{probe},
+    iovecs(batchSize),
+    msgs(batchSize),
+    controls(LatencyProbe::Off != probe ? batchSize * CONTROL_SIZE : 0) {}
+
+int UdpReceiver::receive(int sockfd, bool blocking, Packet** packets, int count) {
+  count = std::min(count, static_cast<int>(this->msgs.size()));
+
+  // the kernel overwrites the name lengths, so re-initialize the headers for every call
+  for (int i = 0; i < count; i++) {
+    this->iovecs[i].iov_base = packets[i]->data;
+    this->iovecs[i].iov_len  = this->bufferSize;
+
+    std::memset(&this->msgs[i], 0, sizeof(this->msgs[i]));
+    this->msgs[i].msg_hdr.msg_name    = &packets[i]->source;
+    this->msgs[i].msg_hdr.msg_namelen = sizeof(packets[i]->source);
+    this->msgs[i].msg_hdr.msg_iov     = &this->iovecs[i];
+    this->msgs[i].msg_hdr.msg_iovlen  = 1;
+    if (LatencyProbe::Off != this->probe) {
+      this->msgs[i].msg_hdr.msg_control    = &this->controls[i * CONTROL_SIZE];
+      this->msgs[i].msg_hdr.msg_controllen = CONTROL_SIZE;
+    }
+  }
+
+  // with MSG_TRUNC the kernel reports the real length of truncated datagrams
+  int flags    = (blocking ? MSG_WAITFORONE : MSG_DONTWAIT) | MSG_TRUNC;
+  int received = recvmmsg(sockfd, this->msgs.data(), count, flags, nullptr);
+  if (received < 0) {
+    if (EINTR != errno && EAGAIN != errno) {
+      LOG_ERROR("Failed to receive UDP datagrams: " << std::strerror(errno));
+    }
+    return 0;
+  }
+
+  // the timestamps of the kernel are wall clock times
+  std::int64_t now{0};
+  if (LatencyProbe::Off != this->probe) {
+    struct timespec realtime {};
+    clock_gettime(CLOCK_REALTIME, &realtime);
+    now = static_cast<std::int64_t>(realtime.tv_sec) * NS_PER_S + realtime.tv_nsec;
+  }
+
+  int valid{0};
+  for (int i = 0; i < received; i++) {
+    auto& msg = this->msgs[i];
+    if (0 != (msg.msg_hdr.msg_flags & MSG_TRUNC) || msg.msg_len > this->bufferSize) {
+      this->stats.truncated.add();
+      if (msg.msg_len > this->largestTruncatedLen.load(std::memory_order_relaxed)) {
+        this->largestTruncatedLen.store(msg.msg_len, std::memory_order_relaxed);
+      }
+      continue;
+    }
+
+    packets[i]->len     = static_cast<int>(msg.msg_len);
+    packets[i]->arrival = 0;
+    if (LatencyProbe::Off != this->probe) {
+      packets[i]->arrival = arrivalOf(msg.msg_hdr);
+      if (0 != packets[i]->arrival) {
+        this->stats.receiveLatency.record(std::chrono::nanoseconds(now - packets[i]->arrival));
+      }
+    }
+    std::swap(packets[valid], packets[i]);
+    valid++;
+  }
+
+  return valid;
+}
@@ -0,0 +1,84 @@
+/**
+ * @file      UdpReceiver.h
+ * @brief     Batched reception of UDP datagrams
+ *
+ * @copyright (c) consider it GmbH, 2020
+ */
+
+#ifndef _UDPRECEIVER_H
+#define _UDPRECEIVER_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include <sys/socket.h>
+
+#include "AppOptions.h"
+#include "Packet.h"
+#include "Stats.h"
+
+/**
+ * @brief Receives up to a batch of datagrams per system call (recvmmsg) directly into packets
+ *
+ * Datagrams, which are larger than the packet buffers, are detected (MSG_TRUNC), counted and
+ * discarded, instead of forwarding a truncated payload.
+ *
+ * With a latency probe, the kernel arrival timestamps are read from the control messages of
+ * the datagrams, the socket has to be opened with the same probe.
+ */
+class UdpReceiver {
+public:
+  /**
+   * @param batchSize   Maximum number of datagrams per system call
+   * @param bufferSize  Size of the packet buffers
+   * @param stats       Statistics to count the truncated datagrams in
+   * @param probe       Source of the arrival timestamps
+   */
+  UdpReceiver(int batchSize, std::size_t bufferSize, WorkerStats& stats, LatencyProbe probe);
+
+  UdpReceiver(const UdpReceiver&) = delete;
+  UdpReceiver& operator=(const UdpReceiver&) = delete;
+  UdpReceiver(UdpReceiver&&)                 = delete;
+  UdpReceiver& operator=(UdpReceiver&&) = delete;
+  ~UdpReceiver()                        = default;
+
+  /**
+   * @brief Fetch all datagrams already queued at the socket (up to count)
+   *
+   * When blocking, the call waits for at least one datagram. Otherwise it returns immediately.
+   *
+   * The received datagrams are moved to the front of the array, in the order of reception.
+   * Packets holding a truncated datagram are moved behind them and can be reused.
+   *
+   * @param sockfd    Bound UDP socket
+   * @param blocking  Wait for the first datagram
+   * @param packets   Packets to receive into, at most batchSize are used
+   * @param count     Number of packets in the array
+   * @return          Number of valid datagrams, 0 on error, when interrupted or nothing was queued
+   */
+  int receive(int sockfd, bool blocking, Packet** packets, int count);
+
+  std::size_t largestTruncated() const { return this->largestTruncatedLen.load(std::memory_order_relaxed); }
+
+private:
+  std::size_t  bufferSize;
+  WorkerStats& stats;
+  LatencyProbe probe;
+
+  std::vector<struct iovec>   iovecs;
+  std::vector<struct mmsghdr> msgs;
+  std::vector<char>           controls;  // control message buffer of each datagram (LatencyProbe only)
+
+  std::atomic<std::size_t> largestTruncatedLen{0};
+};
+
+/**
+ * @brief Kernel arrival time of a datagram in ns since the Unix epoch, 0 if it has no timestamp
+ *
+ * @param msg   Header of the received datagram with its control messages
+ */
+std::int64_t arrivalOf(struct msghdr& msg);
+
+#endif /* _UDPRECEIVER_H */
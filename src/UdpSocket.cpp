@@ -0,0 +1,235 @@
+/**
+ * @file      UdpSocket.cpp
+ * @brief     Setup of the UDP input sockets
+ *
+ * @copyright (c) consider it GmbH, 2020
+ */
+
+#include "UdpSocket.h"
+
+#include <cerrno>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+#include <fcntl.h>
+#include <linux/net_tstamp.h>
+#include <net/if.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "IpAddress.h"
+#include "Log.h"
+
+// static configuration values
+#define LISTEN_FDS_START 3  // first file descriptor passed by systemd (SD_LISTEN_FDS_START)
+
+namespace {
+
+/**
+ * @brief Join the multicast groups of the configuration (IGMP for IPv4, MLD for IPv6 groups)
+ *
+ * @return    Returns False, if a group could not be joined (which was already reported)
+ */
+bool joinMulticastGroups(const AppOptions& options, int sockfd) {
+  unsigned interface{0};  // 0: the kernel picks it by the route to the group
+  if (!options.udpInterface.empty()) {
+    interface = if_nametoindex(options.udpInterface.c_str());
+    if (0 == interface) {
+      LOG_ERROR("Unknown UdpInterface " << options.udpInterface << ": " << std::strerror(errno));
+      return false;
+    }
+  }
+
+  // on a dual-stack socket, the IPv4 groups are joined on the IPv4 level
+  for (const auto& group : options.udpMulticastGroups) {
+    struct group_req request {};
+    request.gr_interface = interface;
+    group.toSockaddr(request.gr_group, 0);
+
+    // a socket taken over from systemd is still a member since the last run (EADDRINUSE)
+    int level = group.isV4() ? IPPROTO_IP : IPPROTO_IPV6;
+    if (0 > setsockopt(sockfd, level, MCAST_JOIN_GROUP, &request, sizeof(request)) && EADDRINUSE != errno) {
+      LOG_ERROR("Could not join multicast group " << group.toString() << ": " << std::strerror(errno));
+      return false;
+    }
+    if (options.verbosity >= 1) {
+      LOG_INFO("Joined multicast group " << group.toString());
+    }
+  }
+  return true;
+}
+
+/**
+ * @brief Set the socket options from the configuration, which do not have to be set before binding
+ *
+ * @return    Returns False, if an option could not be set (which was already reported)
+ */
+bool configureUdpSocket(const AppOptions& options, int sockfd) {
+  if (!joinMulticastGroups(options, sockfd)) {
+    return false;
+  }
+
+  if (0 != options.udpReceiveBufferSize) {
+    // SO_RCVBUFFORCE may exceed net.core.rmem_max, but needs CAP_NET_ADMIN
+    int size = options.udpReceiveBufferSize;
+    if (0 == options.udpReceiveBufferForce || 0 > setsockopt(sockfd, SOL_SOCKET, SO_RCVBUFFORCE, &size, sizeof(size))) {
+      if (0 != options.udpReceiveBufferForce) {
+        LOG_WARN("Could not force the UDP receive buffer size: " << std::strerror(errno));
+      }
+      if (0 > setsockopt(sockfd, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size))) {
+        LOG_WARN("Could not set the UDP receive buffer size: " << std::strerror(errno));
+      }
+    }
+  }
+
+  if (0 != options.udpBusyPoll) {
+    // the receive calls poll the device queue instead of sleeping until the interrupt, values above
+    // net.core.busy_read need CAP_NET_ADMIN
+    int usecs = options.udpBusyPoll;
+    if (0 > setsockopt(sockfd, SOL_SOCKET, SO_BUSY_POLL, &usecs, sizeof(usecs))) {
+      LOG_WARN("Could not enable SO_BUSY_POLL: " << std::strerror(errno));
+    }
+  }
+
+  // kernel arrival timestamps, hardware timestamps need SIOCSHWTSTAMP enabled on the interface (hwstamp_ctl)
+  if (LatencyProbe::Software == options.latencyProbe) {
+    int enable = 1;
+    if (0 > setsockopt(sockfd, SOL_SOCKET, SO_TIMESTAMPNS, &enable, sizeof(enable))) {
+      LOG_ERROR("Could not enable SO_TIMESTAMPNS: " << std::strerror(errno));
+      return false;
+    }
+  } else if (LatencyProbe::Hardware == options.latencyProbe) {
+    int flags = SOF_TIMESTAMPING_RX_HARDWARE | SOF_TIMESTAMPING_RAW_HARDWARE | SOF_TIMESTAMPING_RX_SOFTWARE |
+                SOF_TIMESTAMPING_SOFTWARE;
+    if (0 > setsockopt(sockfd, SOL_SOCKET, SO_TIMESTAMPING, &flags, sizeof(flags))) {
+      LOG_ERROR("Could not enable SO_TIMESTAMPING: " << std::strerror(errno));
+      return false;
+    }
+  }
+
+  return true;
+}
+
+int receiveBufferSize(int sockfd) {
+  int       rcvBuf{0};
+  socklen_t rcvBufLen = sizeof(rcvBuf);
+  getsockopt(sockfd, SOL_SOCKET, SO_RCVBUF, &rcvBuf, &rcvBufLen);
+  return rcvBuf;
+}
+
+}  // namespace
+
+int openUdpSocket(const AppOptions& options, int port, bool reusePort) {
+  // IPv4 addresses get an IPv4 socket, IPv6 ones a dual-stack socket, if the kernel supports IPv6
+  IpAddress bindAddress = options.udpBindAddress;
+  int       sockfd      = socket(bindAddress.isV4() ? AF_INET : AF_INET6, SOCK_DGRAM, 0);
+  if (0 > sockfd && !bindAddress.isV4() && bindAddress.isUnspecified() && EAFNOSUPPORT == errno) {
+    LOG_WARN("IPv6 is not available, receiving IPv4 datagrams only");
+    IpAddress::parse("0.0.0.0", bindAddress);
+    sockfd = socket(AF_INET, SOCK_DGRAM, 0);
+  }
+  if (0 > sockfd) {
+    LOG_ERROR("Could not create UDP socket: " << std::strerror(errno));
+    return -1;
+  }
+
+  if (!bindAddress.isV4()) {
+    int disable = 0;
+    if (0 > setsockopt(sockfd, IPPROTO_IPV6, IPV6_V6ONLY, &disable, sizeof(disable))) {
+      LOG_WARN("Could not enable dual-stack IPv4/ IPv6 reception: " << std::strerror(errno));
+    }
+  }
+
+  if (reusePort) {
+    // the kernel distributes the flows over all sockets bound to the same port
+    int enable = 1;
+    if (0 > setsockopt(sockfd, SOL_SOCKET, SO_REUSEPORT, &enable, sizeof(enable))) {
+      LOG_ERROR("Could not enable SO_REUSEPORT: " << std::strerror(errno));
+      close(sockfd);
+      return -1;
+    }
+  }
+
+  // before Linux 5.7, binding to an interface needs CAP_NET_RAW
+  if (!options.udpInterface.empty() &&
+      0 > setsockopt(sockfd, SOL_SOCKET, SO_BINDTODEVICE, options.udpInterface.c_str(),
+                     static_cast<socklen_t>(options.udpInterface.size()))) {
+    LOG_ERROR("Could not bind UDP socket to interface " << options.udpInterface << ": " << std::strerror(errno));
+    close(sockfd);
+    return -1;
+  }
+
+  struct sockaddr_storage udpServerAddr {};
+  socklen_t               udpServerAddrLen = bindAddress.toSockaddr(udpServerAddr, static_cast<std::uint16_t>(port));
+
+  auto retVal =
+      bind(sockfd,
+           reinterpret_cast<struct sockaddr*>(&udpServerAddr),  // NOLINT(cppcoreguidelines-pro-type-reinterpret-cast)
+           udpServerAddrLen);
+  if (0 > retVal) {
+    LOG_ERROR("Could not bind UDP socket to " << bindAddress.toString() << " port " << port << ": "
+              << std::strerror(errno));
+    close(sockfd);
+    return -1;
+  }
+
+  if (!configureUdpSocket(options, sockfd)) {
+    close(sockfd);
+    return -1;
+  }
+
+  if (options.verbosity >= 1) {
+    LOG_INFO("Successfully opened UDP port " << port << ", receive buffer: " << receiveBufferSize(sockfd) << " bytes");
+  }
+
+  return sockfd;
+}
+
+std::map<int, std::vector<int>> takeActivatedSockets() {
+  // the variables belong to this process only, if LISTEN_PID matches, child processes must not take them over
+  std::map<int, std::vector<int>> sockets{};
+  const char*                     listenPid = std::getenv("LISTEN_PID");
+  const char*                     listenFds = std::getenv("LISTEN_FDS");
+  if (nullptr == listenPid || nullptr == listenFds || std::to_string(getpid()) != listenPid) {
+    return sockets;
+  }
+  int count = std::atoi(listenFds);
+  unsetenv("LISTEN_PID");
+  unsetenv("LISTEN_FDS");
+  unsetenv("LISTEN_FDNAMES");
+
+  for (int sockfd = LISTEN_FDS_START; sockfd < LISTEN_FDS_START + count; sockfd++) {
+    fcntl(sockfd, F_SETFD, FD_CLOEXEC);
+
+    // a sockaddr_in fits into it, the port is at the same offset
+    int                 type{0};
+    socklen_t           typeLen = sizeof(type);
+    struct sockaddr_in6 address {};
+    socklen_t           addressLen = sizeof(address);
+    if (0 > getsockopt(sockfd, SOL_SOCKET, SO_TYPE, &type, &typeLen) || SOCK_DGRAM != type ||
+        0 > getsockname(sockfd, reinterpret_cast<struct sockaddr*>(&address), &addressLen) ||  // NOLINT
+        (AF_INET != address.sin6_family && AF_INET6 != address.sin6_family)) {
+      LOG_WARN("Ignoring file descriptor " << sockfd << " passed by systemd, it is no UDP socket");
+      close(sockfd);
+      continue;
+    }
+    sockets[IpAddress::portOf(address)].push_back(sockfd);
+  }
+  return sockets;
+}
+
+int adoptUdpSocket(const AppOptions& options, int sockfd, int port) {
+  if (!configureUdpSocket(options, sockfd)) {
+    close(sockfd);
+    return -1;
+  }
+
+  if (options.verbosity >= 1) {
+    LOG_INFO("Took over UDP port " << port << " from systemd, receive buffer: " << receiveBufferSize(sockfd)
+             << " bytes");
+  }
+  return sockfd;
+}
@@ -0,0 +1,48 @@
+/**
+ * @file      UdpSocket.h
+ * @brief     Setup of the UDP input sockets
+ *
+ * @copyright (c) consider it GmbH, 2020
+ */
+
+#ifndef _UDPSOCKET_H
+#define _UDPSOCKET_H
+
+#include <map>
+#include <vector>
+
+#include "AppOptions.h"
+
+/**
+ * @brief Open and bind an UDP socket with the socket options from the configuration
+ *
+ * @param options   Application configuration
+ * @param port      UDP port to bind to
+ * @param reusePort Set SO_REUSEPORT, so multiple sockets can share the port
+ * @return          File descriptor of the socket, or -1 on error (which was already reported)
+ */
+int openUdpSocket(const AppOptions& options, int port, bool reusePort);
+
+/**
+ * @brief Take over the UDP sockets passed by systemd socket activation (LISTEN_FDS)
+ *
+ * The sockets stay open while the gateway restarts, so the kernel keeps buffering the datagrams.
+ * The environment variables are removed, so they are not inherited by child processes.
+ *
+ * @return    File descriptors of the passed sockets by their UDP port, in the order of the socket unit
+ */
+std::map<int, std::vector<int>> takeActivatedSockets();
+
+/**
+ * @brief Set the socket options from the configuration on a socket taken over from systemd
+ *
+ * The socket unit binds the socket, so its bind address, interface and SO_REUSEPORT apply instead.
+ *
+ * @param options   Application configuration
+ * @param sockfd    Socket returned by takeActivatedSockets(), it is closed on error
+ * @param port      UDP port, the socket is bound to
+ * @return          File descriptor of the socket, or -1 on error (which was already reported)
+ */
+int adoptUdpSocket(const AppOptions& options, int sockfd, int port);
+
+#endif /* _UDPSOCKET_H */
@@ -0,0 +1,335 @@
+/**
+ * @file      UringReceiver.cpp
+ * @brief     Reception of UDP datagrams with io_uring
+ *
+ * @copyright (c) consider it GmbH, 2020
+ */
+
+#include "UringReceiver.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <ctime>
+
+#include <linux/errqueue.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "Log.h"
+#include "UdpReceiver.h"
+
+// static configuration values
+#define CONTROL_SIZE CMSG_SPACE(sizeof(struct scm_timestamping))  // large enough for both kinds of timestamps
+#define NS_PER_S 1000000000LL
+#define BUFFER_GROUP 0
+#define BUFFER_RING_LIMIT 32768  // entries of a provided buffer ring
+
+namespace {
+
+std::uint32_t nextPowerOfTwo(std::uint32_t value) {
+  std::uint32_t power{1};
+  while (power < value) {
+    power <<= 1U;
+  }
+  return power;
+}
+
+// the rings are shared with the kernel, so their indices are accessed like atomics
+std::uint32_t loadAcquire(const std::uint32_t* index) { return __atomic_load_n(index, __ATOMIC_ACQUIRE); }
+
+template <typename T> void storeRelease(T* index, T value) { __atomic_store_n(index, value, __ATOMIC_RELEASE); }
+
+}  // namespace
+
+UringReceiver::UringReceiver(const AppOptions& options, PacketPool& pool, WorkerStats& stats) :
+    pool{pool},
+    stats{stats},
+    probe{options.latencyProbe},
+    bufferSize{static_cast<std::size_t>(options.udpMaxDatagramSize)},
+    controlSize{LatencyProbe::Off != options.latencyProbe ? CONTROL_SIZE : 0},
+    buffers(std::min<std::uint32_t>(nextPowerOfTwo(static_cast<std::uint32_t>(options.udpIoUringBuffers)),
+                                    BUFFER_RING_LIMIT),
+            nullptr) {
+  for (std::size_t id = this->buffers.size(); id > 0; id--) {
+    this->freeBuffers.push_back(static_cast<std::uint16_t>(id - 1));
+  }
+}
+
+UringReceiver::~UringReceiver() { this->stop(); }
+
+std::size_t UringReceiver::headroom(LatencyProbe probe) {
+  // the kernel writes its header, the source address and the control messages in front of the payload
+  return sizeof(struct io_uring_recvmsg_out) + sizeof(struct sockaddr_in6) +
+         (LatencyProbe::Off != probe ? CONTROL_SIZE : 0);
+}
+
+bool UringReceiver::start(const std::vector<int>& sockets) {
+  this->sockets = sockets;
+  this->armed.assign(sockets.size(), false);
+  this->headers.assign(sockets.size(), {});
+
+  // every buffer in the ring can complete before the completion queue is read
+  struct io_uring_params params {};
+  params.flags      = IORING_SETUP_CQSIZE;
+  params.cq_entries = nextPowerOfTwo(static_cast<std::uint32_t>(this->buffers.size() + sockets.size()));
+
+  this->ringfd = static_cast<int>(
+      syscall(__NR_io_uring_setup, nextPowerOfTwo(static_cast<std::uint32_t>(sockets.size())), &params));
+  if (0 > this->ringfd) {
+    LOG_WARN("Could not set up io_uring: " << std::strerror(errno));
+    return false;
+  }
+  if (0 == (params.features & IORING_FEAT_SINGLE_MMAP)) {
+    LOG_WARN("Could not set up io_uring: the kernel is too old");
+    this->stop();
+    return false;
+  }
+
+  // the submission and completion queue share one mapping
+  this->ringSize = std::max(params.sq_off.array + params.sq_entries * sizeof(std::uint32_t),
+                            params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe));
+  this->ringMemory = mmap(nullptr, this->ringSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, this->ringfd,
+                          IORING_OFF_SQ_RING);
+  this->sqesSize = params.sq_entries * sizeof(struct io_uring_sqe);
+  void* sqesMemory =
+      mmap(nullptr, this->sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, this->ringfd, IORING_OFF_SQES);
+  if (MAP_FAILED == this->ringMemory || MAP_FAILED == sqesMemory) {
+    LOG_WARN("Could not map the io_uring queues: " << std::strerror(errno));
+    this->ringMemory = (MAP_FAILED == this->ringMemory) ? nullptr : this->ringMemory;
+    this->sqes       = (MAP_FAILED == sqesMemory) ? nullptr : static_cast<struct io_uring_sqe*>(sqesMemory);
+    this->stop();
+    return false;
+  }
+  this->sqes = static_cast<struct io_uring_sqe*>(sqesMemory);
+
+  char* base    = static_cast<char*>(this->ringMemory);
+  this->sqTail  = reinterpret_cast<std::uint32_t*>(base + params.sq_off.tail);        // NOLINT
+  this->sqMask  = *reinterpret_cast<std::uint32_t*>(base + params.sq_off.ring_mask);  // NOLINT
+  this->sqArray = reinterpret_cast<std::uint32_t*>(base + params.sq_off.array);       // NOLINT
+  this->cqHead  = reinterpret_cast<std::uint32_t*>(base + params.cq_off.head);        // NOLINT
+  this->cqTail  = reinterpret_cast<std::uint32_t*>(base + params.cq_off.tail);        // NOLINT
+  this->cqMask  = *reinterpret_cast<std::uint32_t*>(base + params.cq_off.ring_mask);  // NOLINT
+  this->cqes    = reinterpret_cast<struct io_uring_cqe*>(base + params.cq_off.cqes);  // NOLINT
+  for (std::uint32_t i = 0; i < params.sq_entries; i++) {
+    this->sqArray[i] = i;
+  }
+
+  // the buffer ring is plain memory, which is registered with the kernel (Linux 5.19)
+  this->bufferRingSize = this->buffers.size() * sizeof(struct io_uring_buf);
+  void* ringBuffers    = mmap(nullptr, this->bufferRingSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS,
+                              -1, 0);
+  if (MAP_FAILED == ringBuffers) {
+    LOG_WARN("Could not allocate the io_uring buffer ring: " << std::strerror(errno));
+    this->stop();
+    return false;
+  }
+  this->bufferRing = static_cast<struct io_uring_buf*>(ringBuffers);
+
+  struct io_uring_buf_reg registration {};
+  registration.ring_addr    = reinterpret_cast<std::uint64_t>(this->bufferRing);  // NOLINT
+  registration.ring_entries = static_cast<std::uint32_t>(this->buffers.size());
+  registration.bgid         = BUFFER_GROUP;
+  if (0 > syscall(__NR_io_uring_register, this->ringfd, IORING_REGISTER_PBUF_RING, &registration, 1)) {
+    LOG_WARN("Could not register the io_uring buffer ring: " << std::strerror(errno));
+    this->stop();
+    return false;
+  }
+
+  this->refill();
+  for (std::size_t route = 0; route < this->sockets.size(); route++) {
+    this->arm(route);
+  }
+  if (0 > this->enter(this->toSubmit, 0)) {
+    this->stop();
+    return false;
+  }
+
+  // invalid requests (multishot recvmsg needs Linux 6.0) complete right away, datagrams are left in the queue
+  for (std::uint32_t head = *this->cqHead; head != loadAcquire(this->cqTail); head++) {
+    const struct io_uring_cqe& cqe = this->cqes[head & this->cqMask];
+    if (0 > cqe.res && 0 == (cqe.flags & IORING_CQE_F_MORE)) {
+      LOG_WARN("Could not start multishot recvmsg: " << std::strerror(-cqe.res));
+      this->stop();
+      return false;
+    }
+  }
+
+  return true;
+}
+
+void UringReceiver::stop() {
+  // closing the ring cancels the requests, so the buffers are not used anymore afterwards
+  if (0 <= this->ringfd) {
+    close(this->ringfd);
+    this->ringfd = -1;
+  }
+  if (nullptr != this->sqes) {
+    munmap(this->sqes, this->sqesSize);
+    this->sqes = nullptr;
+  }
+  if (nullptr != this->ringMemory) {
+    munmap(this->ringMemory, this->ringSize);
+    this->ringMemory = nullptr;
+  }
+  if (nullptr != this->bufferRing) {
+    munmap(this->bufferRing, this->bufferRingSize);
+    this->bufferRing = nullptr;
+  }
+
+  // the fallback receives into the same pool
+  for (std::size_t id = 0; id < this->buffers.size(); id++) {
+    if (nullptr != this->buffers[id]) {
+      this->pool.release(this->buffers[id]);
+      this->buffers[id] = nullptr;
+      this->freeBuffers.push_back(static_cast<std::uint16_t>(id));
+    }
+  }
+}
+
+void UringReceiver::refill() {
+  const std::uint16_t mask = static_cast<std::uint16_t>(this->buffers.size() - 1);
+  const std::uint32_t len  = static_cast<std::uint32_t>(headroom(this->probe) + this->bufferSize);
+
+  bool added{false};
+  while (!this->freeBuffers.empty()) {
+    Packet* packet = this->pool.acquire();
+    if (nullptr == packet) {
+      break;
+    }
+    std::uint16_t id = this->freeBuffers.back();
+    this->freeBuffers.pop_back();
+    this->buffers[id] = packet;
+
+    struct io_uring_buf& buffer = this->bufferRing[this->bufferTail & mask];
+    buffer.addr = reinterpret_cast<std::uint64_t>(packet->data - headroom(this->probe));  // NOLINT
+    buffer.len  = len;
+    buffer.bid  = id;
+    this->bufferTail++;
+    added = true;
+  }
+
+  // the tail overlays the reserved field of the first entry
+  if (added) {
+    storeRelease(&this->bufferRing[0].resv, this->bufferTail);
+  }
+}
+
+void UringReceiver::arm(std::size_t route) {
+  struct msghdr& header = this->headers[route];
+  header                = {};
+  header.msg_namelen    = sizeof(struct sockaddr_in6);
+  header.msg_controllen = this->controlSize;
+
+  std::uint32_t        tail = *this->sqTail;
+  struct io_uring_sqe& sqe  = this->sqes[tail & this->sqMask];
+  std::memset(&sqe, 0, sizeof(sqe));
+  sqe.opcode    = IORING_OP_RECVMSG;
+  sqe.fd        = this->sockets[route];
+  sqe.addr      = reinterpret_cast<std::uint64_t>(&header);  // NOLINT
+  sqe.len       = 1;
+  sqe.msg_flags = MSG_TRUNC;  // report the real length of truncated datagrams
+  sqe.ioprio    = IORING_RECV_MULTISHOT;
+  sqe.flags     = IOSQE_BUFFER_SELECT;
+  sqe.buf_group = BUFFER_GROUP;
+  sqe.user_data = route;
+  storeRelease(this->sqTail, tail + 1);
+
+  this->toSubmit++;
+  this->armed[route] = true;
+}
+
+int UringReceiver::enter(std::uint32_t submit, std::uint32_t wait) {
+  int rc = static_cast<int>(
+      syscall(__NR_io_uring_enter, this->ringfd, submit, wait, 0 != wait ? IORING_ENTER_GETEVENTS : 0, nullptr, 0));
+  if (0 > rc) {
+    if (EINTR != errno && EAGAIN != errno && EBUSY != errno) {
+      LOG_ERROR("Failed to enter io_uring: " << std::strerror(errno));
+      return -1;
+    }
+    return 0;
+  }
+  this->toSubmit -= static_cast<std::uint32_t>(rc);
+  return rc;
+}
+
+int UringReceiver::receive(bool blocking, Packet** packets, int count) {
+  this->refill();
+  if (this->starved()) {
+    return 0;
+  }
+  for (std::size_t route = 0; route < this->sockets.size(); route++) {
+    if (!this->armed[route]) {
+      this->arm(route);
+    }
+  }
+
+  // while completions are waiting, they are read without any system call
+  std::uint32_t head = *this->cqHead;
+  std::uint32_t tail = loadAcquire(this->cqTail);
+  if (0 != this->toSubmit || (head == tail && blocking)) {
+    this->enter(this->toSubmit, (head == tail && blocking) ? 1 : 0);
+    tail = loadAcquire(this->cqTail);
+  }
+
+  // the timestamps of the kernel are wall clock times
+  std::int64_t now{0};
+  if (LatencyProbe::Off != this->probe && head != tail) {
+    struct timespec realtime {};
+    clock_gettime(CLOCK_REALTIME, &realtime);
+    now = static_cast<std::int64_t>(realtime.tv_sec) * NS_PER_S + realtime.tv_nsec;
+  }
+
+  int valid{0};
+  for (; head != tail && valid < count; head++) {
+    const struct io_uring_cqe& cqe   = this->cqes[head & this->cqMask];
+    const std::size_t          route = cqe.user_data;
+    if (0 == (cqe.flags & IORING_CQE_F_MORE)) {
+      this->armed[route] = false;
+    }
+    if (0 == (cqe.flags & IORING_CQE_F_BUFFER)) {
+      // ENOBUFS: the buffer ring ran empty, the request is armed again after the refill
+      if (0 > cqe.res && -ENOBUFS != cqe.res) {
+        LOG_ERROR("Failed to receive UDP datagrams: " << std::strerror(-cqe.res));
+      }
+      continue;
+    }
+
+    const auto id     = static_cast<std::uint16_t>(cqe.flags >> IORING_CQE_BUFFER_SHIFT);
+    Packet*    packet = this->buffers[id];
+    this->buffers[id] = nullptr;
+    this->freeBuffers.push_back(id);
+
+    char* frame = packet->data - headroom(this->probe);
+    auto* out   = reinterpret_cast<struct io_uring_recvmsg_out*>(frame);  // NOLINT
+    if (0 > cqe.res || 0 != (out->flags & MSG_TRUNC) || out->payloadlen > this->bufferSize) {
+      if (0 <= cqe.res) {
+        this->stats.truncated.add();
+        this->largestTruncatedLen = std::max<std::size_t>(this->largestTruncatedLen, out->payloadlen);
+      }
+      this->pool.release(packet);
+      continue;
+    }
+
+    char* name = frame + sizeof(struct io_uring_recvmsg_out);
+    std::memcpy(&packet->source, name, sizeof(packet->source));
+    packet->len     = static_cast<int>(out->payloadlen);
+    packet->route   = static_cast<std::uint32_t>(route);
+    packet->arrival = 0;
+    if (LatencyProbe::Off != this->probe) {
+      struct msghdr msg {};
+      msg.msg_control    = name + sizeof(struct sockaddr_in6);
+      msg.msg_controllen = out->controllen;
+      packet->arrival    = arrivalOf(msg);
+      if (0 != packet->arrival) {
+        this->stats.receiveLatency.record(std::chrono::nanoseconds(now - packet->arrival));
+      }
+    }
+    packets[valid++] = packet;
+  }
+  storeRelease(this->cqHead, head);
+
+  return valid;
+}
@@ -0,0 +1,133 @@
+/**
+ * @file      UringReceiver.h
+ * @brief     Reception of UDP datagrams with io_uring
+ *
+ * Only built with the CMake option UDPMQTTGW_IO_URING, it talks to the kernel interface
+ * directly (linux/io_uring.h), so it does not need liburing.
+ *
+ * @copyright (c) consider it GmbH, 2020
+ */
+
+#ifndef _URINGRECEIVER_H
+#define _URINGRECEIVER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include <linux/io_uring.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+#include "AppOptions.h"
+#include "Packet.h"
+#include "Stats.h"
+
+/**
+ * @brief Receives the datagrams of all sockets of a worker with multishot recvmsg requests
+ *
+ * Every socket has one multishot IORING_OP_RECVMSG request, which stays armed and completes once
+ * per datagram. The kernel picks the buffer for each datagram from a provided buffer ring, which
+ * is filled with packets of the pool. The buffer of a packet starts headroom() bytes in front of
+ * its payload, so the kernel's header, the source address and the control messages go there and
+ * the payload lands right at Packet::data. So the datagrams are neither copied nor do they need
+ * a system call each, while datagrams keep arriving, the receiver only reads the completion queue.
+ *
+ * A request ends, when the buffer ring ran empty (the datagrams wait in the socket meanwhile), and
+ * is armed again with the next call. The pool has to be created with headroom().
+ *
+ * The receiver is not thread-safe, it is meant to be used by the receiver thread only.
+ */
+class UringReceiver {
+public:
+  /**
+   * @param options Application configuration (UdpIoUringBuffers, UdpMaxDatagramSize, LatencyProbe)
+   * @param pool    Pool to take the buffers from, the packets are released to it by the consumer
+   * @param stats   Statistics to count the truncated datagrams in
+   */
+  UringReceiver(const AppOptions& options, PacketPool& pool, WorkerStats& stats);
+
+  UringReceiver(const UringReceiver&) = delete;
+  UringReceiver& operator=(const UringReceiver&) = delete;
+  UringReceiver(UringReceiver&&)                 = delete;
+  UringReceiver& operator=(UringReceiver&&) = delete;
+  ~UringReceiver();
+
+  /**
+   * @brief Space in front of the payload of each packet, which the kernel needs for its header
+   */
+  static std::size_t headroom(LatencyProbe probe);
+
+  /**
+   * @brief Set up the io_uring instance and the buffer ring for the sockets
+   *
+   * @param sockets   Bound UDP sockets, index is the route
+   * @return          Returns False, if the kernel does not support it (too old, or disabled by seccomp/ sysctl)
+   */
+  bool start(const std::vector<int>& sockets);
+
+  /**
+   * @brief Fetch the completed datagrams (up to count)
+   *
+   * Refills the buffer ring from the pool and re-arms ended requests first. When blocking, the
+   * call waits for at least one datagram, otherwise it only reads the completion queue.
+   *
+   * The route of every packet is set. Truncated datagrams are counted and their buffer reused.
+   *
+   * @param blocking  Wait for the first datagram
+   * @param packets   Set to the received packets
+   * @param count     Size of the array
+   * @return          Number of valid datagrams, 0 on error, when interrupted or nothing was received
+   */
+  int receive(bool blocking, Packet** packets, int count);
+
+  /**
+   * @brief Returns True, if the buffer ring is empty and the pool had nothing left to fill it
+   */
+  bool starved() const { return this->freeBuffers.size() == this->buffers.size(); }
+
+  std::size_t largestTruncated() const { return this->largestTruncatedLen; }
+
+private:
+  PacketPool&        pool;
+  WorkerStats&       stats;
+  const LatencyProbe probe;
+  const std::size_t  bufferSize;
+  const std::size_t  controlSize;
+
+  int ringfd{-1};
+
+  // submission and completion queue, shared with the kernel
+  void*                ringMemory{nullptr};
+  std::size_t          ringSize{0};
+  struct io_uring_sqe* sqes{nullptr};
+  std::size_t          sqesSize{0};
+  std::uint32_t*       sqTail{nullptr};
+  std::uint32_t        sqMask{0};
+  std::uint32_t*       sqArray{nullptr};
+  std::uint32_t*       cqHead{nullptr};
+  std::uint32_t*       cqTail{nullptr};
+  std::uint32_t        cqMask{0};
+  struct io_uring_cqe* cqes{nullptr};
+  std::uint32_t        toSubmit{0};
+
+  // provided buffer ring, shared with the kernel, the buffer ID is the index in buffers
+  struct io_uring_buf*       bufferRing{nullptr};
+  std::size_t                bufferRingSize{0};
+  std::uint16_t              bufferTail{0};
+  std::vector<Packet*>       buffers;
+  std::vector<std::uint16_t> freeBuffers;  // IDs of the buffers not in the ring
+
+  std::vector<int>           sockets;
+  std::vector<bool>          armed;  // per route, the multishot request is active
+  std::vector<struct msghdr> headers;
+
+  std::size_t largestTruncatedLen{0};
+
+  void stop();
+  void refill();
+  void arm(std::size_t route);
+  int  enter(std::uint32_t submit, std::uint32_t wait);
+};
+
+#endif /* _URINGRECEIVER_H */